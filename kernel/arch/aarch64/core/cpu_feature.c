@@ -52,6 +52,38 @@ int cpu_has_vhe(void)
 	return vhe_enable;
 }
 
+#define ID_FIELD(reg, shift)	(((reg) >> (shift)) & 0xf)
+
+/*
+ * the features which the user space can use directly, all the
+ * cpus are the same.
+ */
+unsigned long cpu_user_hwcap(void)
+{
+	uint64_t isar0 = read_sysreg(ID_AA64ISAR0_EL1);
+	uint64_t pfr0 = read_sysreg(ID_AA64PFR0_EL1);
+	unsigned long hwcap = 0;
+
+	if (ID_FIELD(pfr0, 16) != 0xf)
+		hwcap |= HWCAP_FP;
+	if (ID_FIELD(pfr0, 20) != 0xf)
+		hwcap |= HWCAP_ASIMD;
+	if (ID_FIELD(isar0, 4) >= 1)
+		hwcap |= HWCAP_AES;
+	if (ID_FIELD(isar0, 4) >= 2)
+		hwcap |= HWCAP_PMULL;
+	if (ID_FIELD(isar0, 8) >= 1)
+		hwcap |= HWCAP_SHA1;
+	if (ID_FIELD(isar0, 12) >= 1)
+		hwcap |= HWCAP_SHA2;
+	if (ID_FIELD(isar0, 16) >= 1)
+		hwcap |= HWCAP_CRC32;
+	if (ID_FIELD(isar0, 20) >= 2)
+		hwcap |= HWCAP_ATOMICS;
+
+	return hwcap;
+}
+
 static int arch_cpu_feature_init(void)
 {
 	unsigned long *cf;
@@ -93,6 +93,18 @@ static void inline flush_tlb_va_range(unsigned long va, size_t size)
 	flush_tlb_va_host(va, size);
 }
 
+/*
+ * the mapping of the process is nG, flush all the tlb of
+ * the asid, since the tlbi by va need the asid too.
+ */
+static void inline stage1_flush_tlb(struct vspace *vs, unsigned long va, size_t size)
+{
+	if (vs->asid)
+		flush_tlb_asid_all(vs->asid);
+	else
+		flush_tlb_va_range(va, size);
+}
+
 static inline void flush_dcache_pte(unsigned long addr)
 {
 	flush_dcache_range(addr, PAGE_SIZE);
@@ -238,9 +250,12 @@ static inline pmd_t stage1_pmd_attr(unsigned long phy, unsigned long flags)
 	if (flags & __VM_DEVMAP)
 		pmd |= S1_DEVMAP;
 
-	if (flags & (__VM_SHARED | __VM_PMA))
+	if (flags & (__VM_SHARED | __VM_PMA | __VM_ZERO))
 		pmd |= S1_SHARED;
 
+	if (flags & __VM_ZERO)
+		pmd |= S1_ZERO;
+
 	return pmd;
 }
 
@@ -285,9 +300,12 @@ static inline pte_t stage1_pte_attr(unsigned long phy, unsigned long flags)
 	if (flags & __VM_DEVMAP)
 		pte |= S1_DEVMAP;
 
-	if (flags & (__VM_SHARED | __VM_PMA))
+	if (flags & (__VM_SHARED | __VM_PMA | __VM_ZERO))
 		pte |= S1_SHARED;
 
+	if (flags & __VM_ZERO)
+		pte |= S1_ZERO;
+
 	return pte;
 }
 
@@ -300,6 +318,46 @@ static void add_release_page(struct vspace *vs, unsigned long addr)
 	vs->release_pages = page;
 }
 
+/*
+ * split a 2M block mapping to 512 page mappings with the same
+ * attribute, if the block is owned by the process, the block
+ * pages will also be splited, then they can be released one
+ * by one when unmap part of the block.
+ */
+static int stage1_split_pmd(struct vspace *vs, pmd_t *pmd, unsigned long addr)
+{
+	pmd_t old_pmd = *pmd;
+	unsigned long phy, attr;
+	struct page *page;
+	pte_t *ptep;
+	int i;
+
+	ptep = (pte_t *)stage1_get_free_page(0);
+	if (!ptep)
+		return -ENOMEM;
+
+	phy = old_pmd & S1_PHYSICAL_MASK & S1_PMD_MASK;
+	attr = (old_pmd & ~S1_PHYSICAL_MASK & ~0x3UL) | S1_DES_PAGE;
+	for (i = 0; i < PTRS_PER_S1_PTE; i++)
+		ptep[i] = attr | (phy + ((unsigned long)i << S1_PTE_SHIFT));
+
+	if (!(old_pmd & S1_PFNMAP) && !(old_pmd & S1_SHARED)) {
+		page = addr_to_page(ptov(phy));
+		if (page && (page_count(page) == PAGES_PER_BLOCK))
+			split_pages(page);
+	}
+
+	/*
+	 * break before make.
+	 */
+	stage1_pmd_clear(pmd);
+	stage1_flush_tlb(vs, addr & S1_PMD_MASK, S1_PMD_SIZE);
+	stage1_pmd_populate(pmd, (unsigned long)ptep,
+			(old_pmd & S1_nG) ? 0 : VM_HOST);
+
+	return 0;
+}
+
 static void stage1_unmap_pte_range(struct vspace *vs, pte_t *ptep,
 		unsigned long addr, unsigned long end, int flags)
 {
@@ -313,8 +371,12 @@ static void stage1_unmap_pte_range(struct vspace *vs, pte_t *ptep,
 			stage1_set_pte(pte, 0);
 
 			/* pfnmap and shared page don not free the page */
-			if (!(old_pte & S1_PFNMAP) && !(old_pte & S1_SHARED))
+			if (!(old_pte & S1_PFNMAP) && !(old_pte & S1_SHARED)) {
 				add_release_page(vs, ptov(stage1_phy_pte(old_pte)));
+				vs->rss_pages--;
+			} else if (old_pte & S1_ZERO) {
+				vs->zero_pages--;
+			}
 		}
 	} while (pte++, addr += PAGE_SIZE, addr != end);
 }
@@ -330,12 +392,22 @@ static void stage1_unmap_pmd_range(struct vspace *vs, pmd_t *pmdp,
 
 	do {
 		next = stage1_pmd_addr_end(addr, end);
+		/*
+		 * unmap part of a block, split it first.
+		 */
+		if (stage1_pmd_huge(*pmd) && (next - addr != S1_PMD_SIZE)) {
+			if (stage1_split_pmd(vs, pmd, addr))
+				pr_warn("split block 0x%x failed\n", addr);
+		}
+
 		if (!stage1_pmd_none(*pmd)) {
 			if (stage1_pmd_huge(*pmd)) {
 				pmd_t old_pmd = *pmd;
 				stage1_pmd_clear(pmd);
-				if (!(old_pmd & S1_PFNMAP) && !(old_pmd & S1_SHARED))
+				if (!(old_pmd & S1_PFNMAP) && !(old_pmd & S1_SHARED)) {
 					add_release_page(vs, ptov(stage1_phy_pte(old_pmd)));
+					vs->rss_pages -= PAGES_PER_BLOCK;
+				}
 			} else {
 				ptep = (pte_t *)ptov(stage1_pte_table_addr(*pmd));
 				stage1_unmap_pte_range(vs, ptep, addr, next, flags);
@@ -353,7 +425,7 @@ static int stage1_unmap_pud_range(struct vspace *vs,
 	pud_t *pud;
 	pmd_t *pmdp;
 
-	pud = stage1_pud_offset((pud_t *)vs->pgdp, end);
+	pud = stage1_pud_offset((pud_t *)vs->pgdp, addr);
 	do {
 		next = stage1_pud_addr_end(addr, end);
 		if (!stage1_pud_none(*pud)) {
@@ -428,6 +500,13 @@ static int stage1_map_pmd_range(struct vspace *vs, pmd_t *pmdp, unsigned long st
 			attr = stage1_pmd_attr(physical, flags);
 			stage1_set_pmd(pmd, attr);
 		} else {
+			if (stage1_pmd_huge(old_pmd)) {
+				ret = stage1_split_pmd(vs, pmd, start);
+				if (ret)
+					return ret;
+				old_pmd = *pmd;
+			}
+
 			if (stage1_pmd_none(old_pmd)) {
 				ptep = (pte_t *)stage1_get_free_page(flags);
 				if (!ptep)
@@ -490,7 +569,7 @@ static int stage1_get_leaf_entry(struct vspace *vs,
 	if (stage1_pud_none(*pudp))
 		return -ENOMEM;
 
-	pmdp = stage1_pmd_offset(stage1_pmd_table_addr(*pudp), va);
+	pmdp = stage1_pmd_offset(ptov(stage1_pmd_table_addr(*pudp)), va);
 	if (stage1_pmd_none(*pmdp))
 		return -ENOMEM;
 
@@ -499,7 +578,7 @@ static int stage1_get_leaf_entry(struct vspace *vs,
 		return 0;
 	}
 
-	ptep = stage1_pte_offset(stage1_pte_table_addr(*pmdp), va);
+	ptep = stage1_pte_offset(ptov(stage1_pte_table_addr(*pmdp)), va);
 	*ptepp = ptep;
 
 	return 0;
@@ -516,15 +595,29 @@ int arch_host_change_map(struct vspace *vs, unsigned long vir,
 	if (ret)
 		return ret;
 
+	/*
+	 * only change one page of the block, split the block.
+	 */
+	if (pmdp && !(flags & __VM_HUGE_2M)) {
+		ret = stage1_split_pmd(vs, pmdp, vir);
+		if (ret)
+			return ret;
+
+		pmdp = NULL;
+		ret = stage1_get_leaf_entry(vs, vir, &pmdp, &ptep);
+		if (ret)
+			return ret;
+	}
+
 	if (pmdp) {
 		stage1_set_pmd(pmdp, 0);
-		flush_tlb_va_range(vir, S1_PMD_SIZE);
+		stage1_flush_tlb(vs, vir & S1_PMD_MASK, S1_PMD_SIZE);
 		stage1_set_pmd(pmdp, stage1_pmd_attr(phy, flags));
 		return 0;
 	}
 
 	stage1_set_pte(ptep, 0);
-	flush_tlb_va_range(vir, S1_PTE_SIZE);
+	stage1_flush_tlb(vs, vir & S1_PTE_MASK, S1_PTE_SIZE);
 	stage1_set_pte(ptep, stage1_pte_attr(phy, flags));
 
 	return 0;
@@ -548,8 +641,8 @@ static inline phy_addr_t stage1_va_to_pa(struct vspace *vs, unsigned long va)
 		return 0;
 
 	if (stage1_pmd_huge(*pmdp)) {
-		phy = ((*pmdp) & S1_PHYSICAL_MASK) + pmd_offset;
-		return 0;
+		phy = ((*pmdp) & S1_PHYSICAL_MASK & S1_PMD_MASK) + pmd_offset;
+		return phy;
 	}
 
 	ptep = stage1_pte_offset(ptov(stage1_pte_table_addr(*pmdp)), va);
@@ -565,6 +658,20 @@ phy_addr_t arch_translate_va_to_pa(struct vspace *vs, unsigned long va)
 	return stage1_va_to_pa(vs, va);
 }
 
+int arch_host_block_none(struct vspace *vs, unsigned long va)
+{
+	pud_t *pudp;
+	pmd_t *pmdp;
+
+	pudp = stage1_pud_offset(vs->pgdp, va);
+	if (stage1_pud_none(*pudp))
+		return 1;
+
+	pmdp = stage1_pmd_offset(ptov(stage1_pmd_table_addr(*pudp)), va);
+
+	return stage1_pmd_none(*pmdp);
+}
+
 int arch_host_map(struct vspace *vs, unsigned long start, unsigned long end,
 		unsigned long physical, unsigned long flags)
 {
@@ -25,6 +25,7 @@
 #define S1_PFNMAP		(UL(1) << 55)	// 55 - 58 is for software
 #define S1_DEVMAP		(UL(1) << 56)	// 55 - 58 is for software
 #define S1_SHARED		(UL(1) << 57)	// 55 - 58 is for software
+#define S1_ZERO			(UL(1) << 58)	// 55 - 58 is for software
 
 #define S1_NS			(1 << 5)
 
@@ -3,7 +3,20 @@
 
 #define ARM_FEATURE_MPIDR_SHIFT	0
 
+/*
+ * the AT_HWCAP bits for the user space, same as Linux.
+ */
+#define HWCAP_FP		(1 << 0)
+#define HWCAP_ASIMD		(1 << 1)
+#define HWCAP_AES		(1 << 3)
+#define HWCAP_PMULL		(1 << 4)
+#define HWCAP_SHA1		(1 << 5)
+#define HWCAP_SHA2		(1 << 6)
+#define HWCAP_CRC32		(1 << 7)
+#define HWCAP_ATOMICS		(1 << 8)
+
 int cpu_has_feature(int feature);
 int cpu_has_vhe(void);
+unsigned long cpu_user_hwcap(void);
 
 #endif
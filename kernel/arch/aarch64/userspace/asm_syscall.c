@@ -115,7 +115,8 @@ static void __sys_map(gp_regs *regs)
 			(handle_t)regs->x1,
 			(unsigned long)regs->x2,
 			(size_t)regs->x3,
-			(right_t)regs->x4);
+			(right_t)regs->x4,
+			(unsigned long)regs->x5);
 }
 
 static void __sys_unmap(gp_regs *regs)
@@ -152,6 +152,13 @@ void cpu_idle(void)
 		 * state to avoid the interrupt happend before wfi
 		 */
 		while (!need_resched() && pcpu_can_idle(pcpu)) {
+			/*
+			 * fill the zero page pool before going to wfi,
+			 * one page each loop to keep the resched latency low.
+			 */
+			if (zero_pool_refill())
+				continue;
+
 			local_irq_disable();
 			if (pcpu_can_idle(pcpu)) {
 				pcpu->state = PCPU_STATE_IDLE;
@@ -185,10 +185,17 @@ static void alloc_pages_in_block(struct page *page, struct mem_section *ms)
 	unsigned long start = page_pa(page);
 	unsigned long base = ALIGN(start, BLOCK_SIZE);
 	unsigned long end = BALIGN(start + page->cnt * PAGE_SIZE, BLOCK_SIZE);
-	int size = ((end - base) >> PAGE_SHIFT) / PAGES_PER_BLOCK;
+	int size = (end - base) >> BLOCK_SHIFT;
+	int i;
 
-	start = (base - start) >> BLOCK_SHIFT;
-	bitmap_set(ms->block_bitmap, start, size);
+	/*
+	 * the block may already be used by other pages.
+	 */
+	start = (base - ms->phy_base) >> BLOCK_SHIFT;
+	for (i = 0; i < size; i++) {
+		if (!test_and_set_bit(start + i, ms->block_bitmap))
+			ms->free_block--;
+	}
 }
 
 static void free_pages_in_block(struct page *page, struct mem_section *ms)
@@ -319,6 +326,80 @@ static void bzero_pages(struct page *page, int pages)
 	memset((void *)page_va(page), 0, pages << PAGE_SHIFT);
 }
 
+/*
+ * pages which already been zeroed by the idle task, single
+ * page GFP_ZERO allocation will get page from here first.
+ */
+#define ZERO_POOL_MAX_PAGES	256
+
+static DEFINE_SPIN_LOCK(zero_pool_lock);
+static struct page *zero_pool_head;
+static struct zero_pool_stat zero_pool;
+
+static struct page *zero_pool_get_page(int flags, int count)
+{
+	struct page *page;
+
+	spin_lock(&zero_pool_lock);
+	page = zero_pool_head;
+	if (page) {
+		zero_pool_head = page->next;
+		zero_pool.nr_pages--;
+		zero_pool.hit++;
+	} else if (count) {
+		zero_pool.miss++;
+	}
+	spin_unlock(&zero_pool_lock);
+
+	if (page) {
+		page->next = NULL;
+		page->flags = (flags & PAGE_F_MASK) | PAGE_F_HEAD;
+	}
+
+	return page;
+}
+
+/*
+ * called by the idle loop with the irq enabled, zero one page
+ * each time so the idle cpu can respond to resched request quickly.
+ * return 1 if one page has been added to the pool.
+ */
+int zero_pool_refill(void)
+{
+	struct page *page;
+
+	if (zero_pool.nr_pages >= ZERO_POOL_MAX_PAGES)
+		return 0;
+
+	page = alloc_pages_from_section(1, 1, GFP_KERNEL);
+	if (!page)
+		return 0;
+
+	bzero_pages(page, 1);
+
+	spin_lock(&zero_pool_lock);
+	if (zero_pool.nr_pages >= ZERO_POOL_MAX_PAGES) {
+		spin_unlock(&zero_pool_lock);
+		__free_pages(page);
+		return 0;
+	}
+
+	page->next = zero_pool_head;
+	zero_pool_head = page;
+	zero_pool.nr_pages++;
+	zero_pool.fill++;
+	spin_unlock(&zero_pool_lock);
+
+	return 1;
+}
+
+void zero_pool_get_stat(struct zero_pool_stat *stat)
+{
+	spin_lock(&zero_pool_lock);
+	*stat = zero_pool;
+	spin_unlock(&zero_pool_lock);
+}
+
 struct page *__alloc_pages(int pages, int align, int flags)
 {
 	struct page *page;
@@ -326,12 +407,29 @@ struct page *__alloc_pages(int pages, int align, int flags)
 	if ((pages <= 0) || (align == 0))
 		return NULL;
 
+	if ((flags & __GFP_ZERO) && (pages == 1)) {
+		page = zero_pool_get_page(flags, 1);
+		if (page)
+			return page;
+	}
+
 	page = alloc_pages_from_section(pages, align, flags);
 	if (!page) {
-		pr_warn("no more pages\n");
-		return NULL;
+		/*
+		 * the zero pool may hold the last free pages of
+		 * the system, give them back when run out of memory.
+		 */
+		if (pages == 1)
+			page = zero_pool_get_page(flags, 0);
+		if (!page)
+			pr_warn("no more pages\n");
+
+		return page;
 	}
 
+	if (flags & __GFP_ZERO)
+		bzero_pages(page, pages);
+
 	return page;
 }
 
@@ -339,11 +437,9 @@ void *__get_free_pages(int pages, int align, int flags)
 {
 	struct page *page = NULL;
 
-	page = __alloc_pages(pages, align, flags);
-	if (page) {
-		bzero_pages(page, pages);
+	page = __alloc_pages(pages, align, flags | __GFP_ZERO);
+	if (page)
 		return (void *)page_va(page);
-	}
 
 	return NULL;
 }
@@ -475,7 +571,7 @@ static void *get_free_block_from_section(struct mem_section *ms, unsigned long f
 		return NULL;
 
 	start = find_next_zero_bit_loop(ms->block_bitmap,
-			ms->current_block, ms->total_block);
+			ms->total_block, ms->current_block);
 	if (start >= ms->total_block)
 		return NULL;
 
@@ -485,6 +581,7 @@ static void *get_free_block_from_section(struct mem_section *ms, unsigned long f
 	set_bit(start, ms->block_bitmap);
 
 	ms->free_block--;
+	ms->free_cnt -= PAGES_PER_BLOCK;
 	ms->current_block = start + 1;
 	if (ms->current_block == ms->total_block)
 		ms->current_block = 0;
@@ -520,7 +617,7 @@ static void *get_free_block_from_section(struct mem_section *ms, unsigned long f
 void *get_free_block(unsigned long flags)
 {
 	struct mem_section *ms;
-	void *base = 0;
+	void *base = NULL;
 	int i;
 
 	flags &= PAGE_F_MASK; 
@@ -536,10 +633,42 @@ void *get_free_block(unsigned long flags)
 		spin_unlock(&ms->lock);
 
 		if (base)
-			break;
+			return (void *)ptov(base);
 	}
 
-	return (void *)ptov(base);
+	return NULL;
+}
+
+/*
+ * split a multi-pages allocation to single pages, then each
+ * of them can be freed by itself, used when a 2M block
+ * mapping is split to page mappings.
+ */
+int split_pages(struct page *page)
+{
+	struct mem_section *section;
+	uint16_t flags, cnt;
+	uint32_t pfn;
+	int i;
+
+	section = addr_to_mem_section(page_va(page));
+	if (!section)
+		return -EFAULT;
+
+	spin_lock(&section->lock);
+	flags = page->flags;
+	cnt = page->cnt;
+	pfn = page->pfn;
+
+	for (i = 0; i < cnt; i++) {
+		page[i].cnt = 1;
+		page[i].flags = flags;
+		page[i].pfn = pfn + i;
+		page[i].next = NULL;
+	}
+	spin_unlock(&section->lock);
+
+	return 0;
 }
 
 void free_block(void *addr)
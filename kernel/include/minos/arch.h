@@ -25,6 +25,8 @@ int arch_get_asid_size(void);
 int arch_host_change_map(struct vspace *vs, unsigned long vir,
 		unsigned long phy, unsigned long flags);
 
+int arch_host_block_none(struct vspace *vs, unsigned long va);
+
 pgd_t *arch_alloc_process_page_table(void);
 
 void arch_task_sched_out(struct task *task);
@@ -17,6 +17,7 @@
 #define __VM_GUEST		(0x00004000)
 #define __VM_SHMEM		(0x00008000)	/* prviate memory, will not be shared */
 #define __VM_PMA		(0x00010000)
+#define __VM_ZERO		(0x00020000)	/* the global zero page, read only */
 
 #define __VM_RW_NON		(0x00000000)
 #define __VM_READ		(0x00100000)
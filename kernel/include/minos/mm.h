@@ -27,6 +27,14 @@ struct vspace {
 	 */
 	atomic_t inuse;
 	struct page *release_pages;
+
+	/*
+	 * pages owned by this vspace, and the mapping count of
+	 * the global zero page, protected by the lock.
+	 */
+	unsigned long rss_pages;
+	unsigned long zero_pages;
+
 	struct mm_notifier_ops *notifier_ops;
 	void *pdata;
 };
@@ -13,6 +13,7 @@
 #define __GFP_SLAB		0x00000020
 #define __GFP_HUGE		0x00000040
 #define __GFP_IO		0x00000080
+#define __GFP_ZERO		0x00010000
 
 #define GFP_KERNEL		__GFP_KERNEL
 #define GFP_USER		__GFP_USER
@@ -23,6 +24,7 @@
 #define GFP_SHARED_IO		(__GFP_SHARED | __GFP_IO)
 #define GFP_HUGE		(__GFP_USER | __GFP_HUGE)
 #define GFP_HUGE_IO		(__GFP_USER | __GFP_HUGE | __GFP_IO)
+#define GFP_ZERO		__GFP_ZERO
 
 struct page {
 	uint16_t cnt;
@@ -41,6 +43,7 @@ struct page *addr_to_page(unsigned long addr);
 void *__get_free_pages(int pages, int align, int flags);
 void *get_free_block(unsigned long flags);
 void free_block(void *addr);
+int split_pages(struct page *page);
 void page_init(void);
 void *get_io_pages(int pages);
 void free_io_pages(void *addr);
@@ -48,6 +51,16 @@ void free_io_pages(void *addr);
 int __free_pages(struct page *page);
 struct page *__alloc_pages(int pages, int align, int flags);
 
+struct zero_pool_stat {
+	unsigned long nr_pages;
+	unsigned long hit;
+	unsigned long miss;
+	unsigned long fill;
+};
+
+int zero_pool_refill(void);
+void zero_pool_get_stat(struct zero_pool_stat *stat);
+
 static inline struct page *alloc_pages(int pages, int flags)
 {
 	return __alloc_pages(pages, 1, flags);
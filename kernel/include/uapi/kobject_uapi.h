@@ -66,6 +66,7 @@ enum {
 	PMA_TYPE_DMA,
 	PMA_TYPE_PMEM,
 	PMA_TYPE_KCACHE,
+	PMA_TYPE_ANON,		// demand-zero region, pages allocated by kernel on fault.
 	PMA_TYPE_MAX
 };
 
@@ -82,6 +83,40 @@ struct pma_create_arg {
 	unsigned long size;
 };
 
+/*
+ * for irq kobject, in counter mode the kernel increases the count
+ * in the status page for each irq, and only wakes up the driver
+ * when it is waiting. kobject_read() unmasks the irq if it has
+ * been masked by the kernel and waits until count != seen.
+ */
+enum {
+	KOBJ_IRQ_SET_COUNTER_MODE = 0x5000,
+	KOBJ_IRQ_SET_COALESCE,
+};
+
+/*
+ * wake up the waiter after count irqs or usecs after the first
+ * irq, whichever comes first. 0 means no coalescing.
+ */
+#define KOBJ_IRQ_COALESCE(usecs, count)	\
+	((((unsigned long)(usecs) & 0xffffffff) << 16) | ((count) & 0xffff))
+
+struct irq_status_page {
+	volatile unsigned int count;	// updated by kernel
+	volatile unsigned int seen;	// updated by driver
+	volatile unsigned int waiting;	// driver is sleeping in kernel
+	volatile unsigned int masked;	// irq is masked by kernel
+	volatile unsigned long nr_wakes;
+};
+
+/*
+ * for endpoint kobject, reset the endpoint after the writer has
+ * closed it, then the owner can send it to a new client.
+ */
+enum {
+	KOBJ_ENDPOINT_RESET = 0x6000,
+};
+
 /*
  * for kobject poll
  */
@@ -13,6 +13,8 @@ struct task_stat {
 	int prio;
 	unsigned long long start_ns;
 	char cmd[PROC_NAME_SIZE];
+	unsigned long rss_pages;	// pages owned by the process.
+	unsigned long zero_pages;	// mappings of the shared zero page.
 };
 
 #endif
@@ -49,4 +49,7 @@ int init_proc_handles(struct process *proc);
 handle_t send_handle(struct process *psrc, struct process *pdst,
 		handle_t handle, right_t right_send);
 
+int restore_handle_right(struct process *proc, handle_t handle,
+		struct kobject *kobj, right_t right);
+
 #endif
@@ -57,6 +57,8 @@ int iqueue_reply(struct iqueue *iqueue, right_t right,
 
 int iqueue_close(struct iqueue *iqueue, right_t right, struct process *proc);
 
+void iqueue_reset(struct iqueue *iqueue);
+
 void iqueue_init(struct iqueue *iq, int mutil_writer, struct kobject *kobj);
 
 #endif
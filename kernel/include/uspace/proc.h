@@ -24,6 +24,12 @@ struct process {
 
 	struct vspace vspace;
 
+	/*
+	 * anon demand-zero regions, sorted by the start address
+	 * and protected by vspace.lock.
+	 */
+	struct list_head anon_list;
+
 	/*
 	 * handle_desc_table will store all the kobjects created
 	 * and kobjects connected by this process. and
@@ -30,7 +30,8 @@ extern int sys_unmap(handle_t proc_handle, handle_t pma_handle,
 		unsigned long virt, size_t size);
 
 extern int sys_map(handle_t proc_handle, handle_t pma_handle,
-		unsigned long virt, size_t size, right_t right);
+		unsigned long virt, size_t size, right_t right,
+		unsigned long offset);
 
 extern unsigned long sys_mtrans(unsigned long virt);
 
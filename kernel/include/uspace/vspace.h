@@ -63,6 +63,14 @@ void *uva_to_kva(struct vspace *vs, unsigned long va,
 
 int handle_page_fault(unsigned long virt, int write, unsigned long flags);
 
+int vspace_add_anon_region(struct process *proc, unsigned long start,
+		size_t size, right_t right);
+
+int vspace_del_anon_region(struct process *proc,
+		unsigned long start, size_t size);
+
+int handle_anon_page_fault(struct process *proc, unsigned long virt, int write);
+
 void inc_vspace_usage(struct vspace *vs);
 void dec_vspace_usage(struct vspace *vs);
 void add_released_page_to_vspace(struct vspace *vs, unsigned long addr);
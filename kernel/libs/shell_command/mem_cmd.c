@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2020 Min Le (lemin9538@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <minos/minos.h>
+#include <minos/page.h>
+#include <minos/shell_command.h>
+
+static int zpool_cmd(int argc, char **argv)
+{
+	struct zero_pool_stat stat;
+
+	zero_pool_get_stat(&stat);
+
+	printf("zero pool pages: %ld\n", stat.nr_pages);
+	printf("hit: %ld miss: %ld fill: %ld\n",
+			stat.hit, stat.miss, stat.fill);
+
+	return 0;
+}
+DEFINE_SHELL_COMMAND(zpool, "zpool", "Show zero page pool statistics", zpool_cmd, 0);
@@ -20,6 +20,7 @@
 #include <uspace/poll.h>
 #include <uspace/iqueue.h>
 #include <uspace/kobject.h>
+#include <uspace/handle.h>
 #include <uspace/uaccess.h>
 #include <uspace/vspace.h>
 #include <uspace/proc.h>
@@ -114,6 +115,42 @@ static int endpoint_munmap(struct kobject *kobj, right_t right)
 	return unmap_process_memory(current_proc, base, ep->shmem_size);
 }
 
+/*
+ * reuse the endpoint for a new client. the refcount can only come
+ * from the handle of the owner and this call, so no one else can
+ * still send to the endpoint or has its memory mapped, then the
+ * write right goes back to the owner.
+ */
+static long endpoint_reset(struct endpoint *ep, handle_t handle)
+{
+	if (atomic_read(&ep->kobj.ref) != 2)
+		return -EBUSY;
+
+	iqueue_reset(&ep->iqueue);
+
+	/*
+	 * the new client must not see the data of the old one.
+	 */
+	if (ep->shmem)
+		memset(ep->shmem, 0, ep->shmem_size);
+
+	return restore_handle_right(current_proc, handle,
+			&ep->kobj, KOBJ_RIGHT_WRITE);
+}
+
+static long endpoint_ctl(struct kobject *kobj, int req, unsigned long data)
+{
+	struct endpoint *ep = kobject_to_endpoint(kobj);
+
+	switch (req) {
+	case KOBJ_ENDPOINT_RESET:
+		return endpoint_reset(ep, (handle_t)data);
+	default:
+		pr_err("unknow action 0x%x for endpoint kobject\n", req);
+		return -ENOSYS;
+	}
+}
+
 static struct kobject_ops endpoint_kobject_ops = {
 	.send		= endpoint_send,
 	.recv		= endpoint_recv,
@@ -122,6 +159,7 @@ static struct kobject_ops endpoint_kobject_ops = {
 	.mmap		= endpoint_mmap,
 	.munmap		= endpoint_munmap,
 	.reply		= endpoint_reply,
+	.ctl		= endpoint_ctl,
 };
 
 static int endpoint_create(struct kobject **kobj, right_t *right, unsigned long data)
@@ -38,7 +38,6 @@ static struct handle_desc *new_handle_desc_table(uint32_t index)
 	dt = get_free_page(GFP_KERNEL);
 	if (!dt)
 		return NULL;
-	memset(dt, 0, PAGE_SIZE);
 
 	htd = to_handle_table_desc(dt);
 	htd->left = NR_DESC_PER_PAGE;
@@ -295,6 +294,37 @@ out:
 	return ret;
 }
 
+/*
+ * give the right back to the handle of the owner, the kobject
+ * must make sure that no one else holds the right now.
+ */
+int restore_handle_right(struct process *proc, handle_t handle,
+		struct kobject *kobj, right_t right)
+{
+	struct handle_table_desc *htd;
+	struct handle_desc *hdesc;
+	int ret;
+
+	if (WRONG_HANDLE(handle))
+		return -ENOENT;
+
+	spin_lock(&proc->lock);
+	ret = lookup_handle_desc(proc, handle, &hdesc, &htd);
+	if (ret)
+		goto out;
+
+	if (hdesc->kobj != kobj) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	hdesc->right |= right;
+out:
+	spin_unlock(&proc->lock);
+
+	return ret;
+}
+
 handle_t sys_grant(handle_t proc_handle, handle_t handle, right_t right)
 {
 	struct kobject *kobj_proc;
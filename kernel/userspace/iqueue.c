@@ -229,6 +229,21 @@ int iqueue_close(struct iqueue *iqueue, right_t right, struct process *proc)
 	return 0;
 }
 
+/*
+ * make the closed iqueue ready for a new writer, called when
+ * no one else can send to it.
+ */
+void iqueue_reset(struct iqueue *iqueue)
+{
+	wake_all_writer(iqueue, -EIO);
+
+	while ((int)sem_accept(&iqueue->isem) > 0)
+		;
+
+	iqueue->wstate = IQ_STAT_OPENED;
+	smp_wmb();
+}
+
 void iqueue_init(struct iqueue *iq, int mutil_writer, struct kobject *kobj)
 {
 	ASSERT((iq != NULL) && (kobj != NULL));
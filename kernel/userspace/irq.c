@@ -18,23 +18,89 @@
 #include <minos/mm.h>
 #include <minos/sched.h>
 #include <minos/irq.h>
+#include <minos/timer.h>
+#include <minos/time.h>
 #include <uspace/poll.h>
 #include <uspace/kobject.h>
 #include <uspace/uaccess.h>
 #include <uspace/proc.h>
+#include <uspace/vspace.h>
 
 struct irq_event {
 	struct kobject kobj;
 	struct irq_desc *idesc;
 	struct event event;
 	struct poll_event_kernel poll_event;
+
+	/*
+	 * counter mode, the status page is shared with the driver.
+	 */
+	struct irq_status_page *status;
+	int masked;
+	uint32_t wake_count;
+	uint32_t coalesce_count;
+	uint64_t coalesce_ns;
+	int timer_armed;
+	struct timer coalesce_timer;
 };
 
 #define kobj_to_irq_event(kobj) (struct irq_event *)kobj->data
 
-#define IRQ_RIGHT	KOBJ_RIGHT_RW
+#define IRQ_RIGHT	(KOBJ_RIGHT_RW | KOBJ_RIGHT_CTL | KOBJ_RIGHT_MMAP)
 #define IRQ_RIGHT_MASK	(0)
 
+static inline int irq_is_edge(struct irq_desc *idesc)
+{
+	return !!(idesc->flags & IRQ_FLAGS_EDGE_BOTH);
+}
+
+static void irq_coalesce_timeout(unsigned long data)
+{
+	struct irq_event *ievent = (struct irq_event *)data;
+
+	ievent->timer_armed = 0;
+	if (ievent->status->waiting) {
+		ievent->status->nr_wakes++;
+		wake(&ievent->event, 0);
+	}
+}
+
+/*
+ * the level irq is kept masked until the driver calls the
+ * ack+wait, the edge irq is not masked, so the irqs which come
+ * when the driver is running only increase the counter.
+ */
+static int do_handle_counter_irq(uint32_t irq, struct irq_event *ievent)
+{
+	struct irq_status_page *status = ievent->status;
+	uint32_t pending;
+
+	if (!irq_is_edge(ievent->idesc)) {
+		irq_mask(irq);
+		ievent->masked = 1;
+		status->masked = 1;
+	}
+
+	status->count++;
+	smp_mb();
+
+	if (!status->waiting)
+		return 0;
+
+	pending = status->count - ievent->wake_count;
+	if (ievent->coalesce_ns && (pending < ievent->coalesce_count)) {
+		if (!ievent->timer_armed) {
+			ievent->timer_armed = 1;
+			mod_timer(&ievent->coalesce_timer, NOW() + ievent->coalesce_ns);
+		}
+		return 0;
+	}
+
+	status->nr_wakes++;
+
+	return wake(&ievent->event, 0);
+}
+
 static int do_handle_userspace_irq(uint32_t irq, void *data)
 {
 	struct irq_event *ievent = (struct irq_event *)data;
@@ -43,6 +109,10 @@ static int do_handle_userspace_irq(uint32_t irq, void *data)
 	struct poll_struct *ps = kobj->poll_struct;
 
 	ASSERT(idesc != NULL);
+
+	if (ievent->status && !event_is_polled(ps, EV_IN))
+		return do_handle_counter_irq(irq, ievent);
+
 	irq_mask(irq);
 
 	/*
@@ -74,6 +144,32 @@ static int irq_kobj_open(struct kobject *kobj, handle_t handle, right_t rigt)
 	return request_user_irq(idesc->hno, idesc->flags, ievent);
 }
 
+/*
+ * ack + wait, unmask the irq if it is masked by the kernel and
+ * wait until the driver has unseen irqs.
+ */
+static long irq_counter_wait(struct irq_event *ievent, uint32_t timeout)
+{
+	struct irq_status_page *status = ievent->status;
+	long ret;
+
+	if (ievent->masked) {
+		ievent->masked = 0;
+		status->masked = 0;
+		irq_unmask(ievent->idesc->hno);
+	}
+
+	status->waiting = 1;
+	smp_mb();
+
+	ret = wait_event(&ievent->event, status->count != status->seen, timeout);
+
+	status->waiting = 0;
+	ievent->wake_count = status->count;
+
+	return ret;
+}
+
 static long irq_kobj_read(struct kobject *kobj, void __user *data,
 		size_t data_size, size_t *actual_data, void __user *extra,
 		size_t extra_size, size_t *actual_extra, uint32_t timeout)
@@ -85,6 +181,9 @@ static long irq_kobj_read(struct kobject *kobj, void __user *data,
 	if (event_is_polled(kobj->poll_struct, EV_IN))
 		return -EPERM;
 
+	if (ievent->status)
+		return irq_counter_wait(ievent, timeout);
+
 	ret = wait_event(&ievent->event,
 			test_and_clear_bit(IRQ_FLAGS_PENDING_BIT, &idesc->flags),
 			timeout);
@@ -110,11 +209,87 @@ static int irq_kobj_close(struct kobject *kobj, right_t right, struct process *p
 	return 0;
 }
 
+static int irq_kobj_mmap(struct kobject *kobj, right_t right,
+		void **addr, unsigned long *msize)
+{
+	struct irq_event *ievent = kobj_to_irq_event(kobj);
+	unsigned long base;
+	int ret;
+
+	if (!ievent->status)
+		return -ENOENT;
+
+	base = va2sva(ievent->status);
+	ret = map_process_memory(current_proc, base, PAGE_SIZE,
+			vtop(ievent->status), VM_RW | VM_SHARED);
+	if (ret)
+		return ret;
+
+	*addr = (void *)base;
+	*msize = PAGE_SIZE;
+
+	return 0;
+}
+
+static int irq_kobj_munmap(struct kobject *kobj, right_t right)
+{
+	struct irq_event *ievent = kobj_to_irq_event(kobj);
+
+	if (!ievent->status)
+		return -ENOENT;
+
+	return unmap_process_memory(current_proc,
+			va2sva(ievent->status), PAGE_SIZE);
+}
+
+static long irq_set_counter_mode(struct irq_event *ievent)
+{
+	struct irq_status_page *status;
+
+	if (ievent->status)
+		return 0;
+
+	status = get_free_page(GFP_USER);
+	if (!status)
+		return -ENOMEM;
+
+	memset(status, 0, PAGE_SIZE);
+	init_timer(&ievent->coalesce_timer, irq_coalesce_timeout,
+			(unsigned long)ievent);
+	smp_wmb();
+	ievent->status = status;
+
+	return 0;
+}
+
+static long irq_kobj_ctl(struct kobject *kobj, int req, unsigned long data)
+{
+	struct irq_event *ievent = kobj_to_irq_event(kobj);
+
+	switch (req) {
+	case KOBJ_IRQ_SET_COUNTER_MODE:
+		return irq_set_counter_mode(ievent);
+	case KOBJ_IRQ_SET_COALESCE:
+		if (!ievent->status)
+			return -EPERM;
+		ievent->coalesce_count = data & 0xffff;
+		ievent->coalesce_ns = MICROSECS(data >> 16);
+		return 0;
+	default:
+		break;
+	}
+
+	return -EINVAL;
+}
+
 static struct kobject_ops irq_kobj_ops = {
 	.open	= irq_kobj_open,
 	.recv	= irq_kobj_read,
 	.send	= irq_kobj_write,
 	.close	= irq_kobj_close,
+	.mmap	= irq_kobj_mmap,
+	.munmap	= irq_kobj_munmap,
+	.ctl	= irq_kobj_ctl,
 };
 
 int irq_kobject_create(struct kobject **rkobj, right_t *right, unsigned long data)
@@ -99,18 +99,24 @@ static int pma_mmap(struct kobject *kobj, right_t right,
 {
 	struct pma *p = (struct pma *)kobj->data;
 	unsigned long vstart, pstart, size;
+	unsigned long flags = p->vmflags;
 
 	if (!p->pstart)
 		return -EPERM;
 
 	/*
-	 * TBD
+	 * a handle without the write right, for example the one
+	 * a file server shares its page cache with, only gets a
+	 * read only mapping.
 	 */
+	if (!(right & KOBJ_RIGHT_WRITE))
+		flags &= ~__VM_WRITE;
+
 	vstart = PAGE_ALIGN(pa2sva(p->pstart));
 	pstart = PAGE_ALIGN(p->pstart);
 	size = PAGE_BALIGN(p->pstart + p->psize) - pstart;
 
-	if (map_process_memory(current_proc, vstart, size, pstart, p->vmflags))
+	if (map_process_memory(current_proc, vstart, size, pstart, flags))
 		return -EFAULT;
 
 	*addr = (void *)pa2sva(p->pstart);
@@ -158,15 +164,40 @@ static int pma_close(struct kobject *kobj, right_t right,
 		return unmap_process_memory(proc, pa2sva(p->pstart), p->psize);
 }
 
+/*
+ * the mapping can not have more rights than the handle of the
+ * mapper and the request.
+ */
+static unsigned long pma_map_flags(struct pma *p, right_t right, right_t right_pma)
+{
+	unsigned long flags = p->vmflags;
+
+	if (!(right & KOBJ_RIGHT_WRITE) || !(right_pma & KOBJ_RIGHT_WRITE))
+		flags &= ~__VM_WRITE;
+	if (!(right & KOBJ_RIGHT_EXEC))
+		flags &= ~__VM_EXEC;
+
+	return flags;
+}
+
 static void *__sys_pma_map(struct pma *p, struct process *proc,
-		unsigned long virt, size_t size)
+		unsigned long virt, size_t size, unsigned long offset,
+		unsigned long flags)
 {
 	struct page *page = p->page_list;
 	unsigned long start = virt;
 	struct pma_mapping_entry *pme;
+	size_t psize;
 	int ret;
 
-	size = (size > p->psize) ? p->psize : size;
+	/*
+	 * only the consequent PMA can be mapped from an offset, for
+	 * example one page of the page cache of a file server.
+	 */
+	if (offset && (!p->pstart || (offset >= p->psize)))
+		return ERROR_PTR(-EINVAL);
+
+	size = (size > p->psize - offset) ? p->psize - offset : size;
 	pme = zalloc(sizeof(struct pma_mapping_entry));
 	if (!pme)
 		return ERROR_PTR(-ENOMEM);
@@ -177,22 +208,27 @@ static void *__sys_pma_map(struct pma *p, struct process *proc,
 
 	if (p->pstart) {
 		ret = map_process_memory(proc, start,
-				size, p->pstart, p->vmflags);
+				size, p->pstart + offset, flags);
 	} else {
+		/*
+		 * the page in the list may be a 2M block.
+		 */
 		do {
+			psize = (size_t)page_count(page) << PAGE_SHIFT;
+			psize = (psize > size) ? size : psize;
 			ret = map_process_memory(proc, start,
-					PAGE_SIZE,page_pa(page), p->vmflags);
+					psize, page_pa(page), flags);
 			if (ret)
 				break;
 			page = page->next;
-			start += PAGE_SIZE;
-			size -= PAGE_SIZE;
+			start += psize;
+			size -= psize;
 		} while (size > 0);
 	}
 
 	if (ret) {
+		unmap_process_memory(proc, virt, pme->size);
 		free(pme);
-		unmap_process_memory(proc, virt, size);
 		return ERROR_PTR(ret);
 	}
 
@@ -236,7 +272,8 @@ static int __sys_pma_unmap(struct pma *p, struct process *proc,
 }
 
 static int sys_handle_pma(handle_t proc_handle, handle_t pma_handle,
-		unsigned long virt, size_t size, right_t right, int map)
+		unsigned long virt, size_t size, right_t right,
+		unsigned long offset, int map)
 {
 	right_t right_proc, right_pma;
 	struct kobject *kobj_proc = NULL;
@@ -277,9 +314,23 @@ static int sys_handle_pma(handle_t proc_handle, handle_t pma_handle,
 		goto out;
 	}
 
+	/*
+	 * anon pma only register or unregister the demand-zero
+	 * region, the page will be allocated when page fault.
+	 */
+	if (((struct pma *)kobj_pma->data)->type == PMA_TYPE_ANON) {
+		if (map)
+			ret = vspace_add_anon_region(proc, virt, size, right);
+		else
+			ret = vspace_del_anon_region(proc, virt, size);
+		goto out;
+	}
+
 	if (map) {
 		addr = __sys_pma_map((struct pma *)kobj_pma->data, proc,
-				virt, size);
+				virt, size, offset,
+				pma_map_flags((struct pma *)kobj_pma->data,
+					right, right_pma));
 		if (IS_ERROR_PTR(addr))
 			ret = (int)(unsigned long)addr;
 	} else {
@@ -297,15 +348,17 @@ out_pma_kobj:
 }
 
 int sys_map_pma(handle_t proc_handle, handle_t pma_handle,
-		unsigned long virt, size_t size, right_t right)
+		unsigned long virt, size_t size, right_t right,
+		unsigned long offset)
 {
-	return sys_handle_pma(proc_handle, pma_handle, virt, size, right, 1);
+	return sys_handle_pma(proc_handle, pma_handle, virt, size,
+			right, offset, 1);
 }
 
 int sys_unmap_pma(handle_t proc_handle, handle_t pma_handle,
 		unsigned long virt, size_t size)
 {
-	return sys_handle_pma(proc_handle, pma_handle, virt, size, 0, 0);
+	return sys_handle_pma(proc_handle, pma_handle, virt, size, 0, 0, 0);
 }
 
 static void pma_release(struct kobject *kobj)
@@ -336,7 +389,7 @@ static int pma_add_pages(struct kobject *kobj, int pages)
 		return -EPERM;
 
 	for (i = 0; i < pages; i++) {
-		page = alloc_pages(1, GFP_USER);
+		page = alloc_pages(1, GFP_USER | GFP_ZERO);
 		if (!page) {
 			free_pma_pages(head);
 			return -ENOMEM;
@@ -446,34 +499,76 @@ static inline unsigned long pma_flags(int type, right_t right)
 	else if (type == PMA_TYPE_PMEM)
 		flags |= __VM_PFNMAP;
 
-	flags |= VM_PMA;
+	/*
+	 * use 2M block mapping if the memory and the virtual
+	 * address are both 2M aligned.
+	 */
+	flags |= VM_PMA | VM_HUGE;
 
 	return flags;
 }
 
 static int allocate_pma_memory(struct pma *p, size_t size, int type)
 {
+	struct page *block_head = NULL, *block_tail = NULL;
 	size_t cnt = size >> PAGE_SHIFT;
+	size_t blocks = 0;
 	struct page *page;
+	void *mem = NULL;
 	int i;
 
 	/*
 	 * if this PMA need to shared among in different process
-	 * allocate a continuously memory region.
+	 * allocate a continuously memory region. try to get 2M
+	 * aligned memory first, then it can be mapped as block.
 	 */
 	if (p->consequent || (type == PMA_TYPE_DMA)) {
-		p->pstart = va2pa(get_free_pages(cnt, GFP_USER));
-		if (!p->pstart)
+		if (cnt >= PAGES_PER_BLOCK)
+			mem = __get_free_pages(cnt, PAGES_PER_BLOCK, GFP_USER);
+		if (!mem)
+			mem = get_free_pages(cnt, GFP_USER);
+		if (!mem)
 			return -ENOMEM;
 
+		p->pstart = va2pa(mem);
 		p->psize = cnt << PAGE_SHIFT;
 		p->pend = p->pstart + p->psize;
 		return 0;
 	}
 
+	/*
+	 * allocate 2M blocks for the normal pma if possible, the
+	 * blocks will be at the head of the page list, and mapped
+	 * at the beginning of the region.
+	 */
+	if (type == PMA_TYPE_NORMAL) {
+		blocks = cnt / PAGES_PER_BLOCK;
+		cnt = cnt % PAGES_PER_BLOCK;
+	}
+
+	for (i = 0; i < blocks; i++) {
+		mem = get_free_block(GFP_USER);
+		if (!mem) {
+			cnt += (blocks - i) * PAGES_PER_BLOCK;
+			break;
+		}
+
+		/*
+		 * get_free_block() does not clear the memory, the
+		 * block will be mapped to the user, zero it here.
+		 */
+		memset(mem, 0, BLOCK_SIZE);
+		page = addr_to_page((unsigned long)mem);
+		page->next = block_head;
+		block_head = page;
+		if (!block_tail)
+			block_tail = page;
+	}
+
 	for (i = 0; i < cnt; i++) {
-		page = alloc_pages(1, GFP_USER);
+		page = alloc_pages(1, GFP_USER | GFP_ZERO);
 		if (!page) {
+			free_pma_pages(block_head);
 			free_pma_memory(p);
 			return -ENOMEM;
 		}
@@ -482,6 +577,11 @@ static int allocate_pma_memory(struct pma *p, size_t size, int type)
 		p->page_list = page;
 	}
 
+	if (block_head) {
+		block_tail->next = p->page_list;
+		p->page_list = block_head;
+	}
+
 	return 0;
 }
 
@@ -588,6 +688,12 @@ static int pma_create(struct kobject **kobj, right_t *right, unsigned long data)
 		if (!proc_is_root(current_proc) && (args.size > HUGE_PAGE_SIZE))
 			return -E2BIG;
 		break;
+	case PMA_TYPE_ANON:
+		if (!proc_is_root(current_proc))
+			return -EPERM;
+		args.size = 0;
+		args.consequent = 0;
+		break;
 	default:
 		break;
 	}
@@ -135,7 +135,7 @@ static int __poll_hub_read(struct poll_hub *peh,
 	if (!user_ranges_ok((void *)events, max_event * sizeof(struct poll_event)))
 		return -EFAULT;
 
-	ret = wait_event(&peh->event, !is_list_empty(&peh->event_list), -1);
+	ret = wait_event(&peh->event, !is_list_empty(&peh->event_list), timeout);
 	if (ret)
 		return ret;
 
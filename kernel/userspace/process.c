@@ -167,6 +167,13 @@ int process_page_fault(struct process *proc, uint64_t virtaddr, uint64_t info)
 	struct imsg imsg;
 	int ret;
 
+	/*
+	 * anon demand-zero page, handle it directly.
+	 */
+	ret = handle_anon_page_fault(proc, virtaddr, info & KOBJ_RIGHT_WRITE);
+	if (ret != -ENOENT)
+		return ret;
+
 	imsg_init(&imsg, current);
 	spin_lock(&iqueue->lock);
 	list_add_tail(&iqueue->processing_list, &imsg.list);
@@ -66,11 +66,18 @@ void init_task_stat(struct task *task)
 void update_task_stat(struct task *task)
 {
 	struct task_stat *kstat = get_task_stat(task->tid);
+	struct process *proc;
 
 	kstat->state = task->state;
 	kstat->cpu = task->cpu;
 	kstat->cpu_usage = 0x0;
 	kstat->prio = task->prio;
+
+	if (!(task->flags & TASK_FLAGS_KERNEL)) {
+		proc = task_to_proc(task);
+		kstat->rss_pages = proc->vspace.rss_pages;
+		kstat->zero_pages = proc->vspace.zero_pages;
+	}
 }
 
 static int procinfo_switch_hook(void *item, void *data)
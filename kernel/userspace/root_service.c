@@ -328,7 +328,6 @@ static int setup_root_service_env(struct process *proc)
 	if (!env)
 		return -ENOMEM;
 
-	memset(env, 0, PAGE_SIZE);
 	env->magic = BOOTDATA_MAGIC;
 	ret = setup_user_memory_region(proc, env);
 	if (ret)
@@ -364,7 +363,7 @@ static void *setup_auxv(void *top)
 
 	NEW_AUX_ENT(auxp, AT_NULL, 0);
 	NEW_AUX_ENT(auxp, AT_PAGESZ, PAGE_SIZE);
-	NEW_AUX_ENT(auxp, AT_HWCAP, 0);		// TBD cpu feature.
+	NEW_AUX_ENT(auxp, AT_HWCAP, cpu_user_hwcap());
 
 	/*
 	 * root service will have it own memory management
@@ -28,10 +28,29 @@
 #define FIXED_KERNEL_ASID	1
 #define USER_ASID_BASE		2
 
+/*
+ * anonymous demand-zero region registered by the root service
+ * for brk, stack and anon mmap, the page fault in these regions
+ * is handled by kernel directly without a round trip to root
+ * service.
+ */
+struct anon_region {
+	unsigned long start;
+	unsigned long end;
+	unsigned long flags;
+	struct list_head list;
+};
+
 static DECLARE_BITMAP(asid_bitmap, MAX_ASID);
 static DEFINE_SPIN_LOCK(asid_lock);
 static int max_asid;
 
+/*
+ * the global read only zero page, mapped when a process
+ * read a anon page which has not been written yet.
+ */
+static unsigned long zero_page_pa;
+
 static int allocate_asid(void)
 {
 	int asid = 0;
@@ -171,10 +190,10 @@ static int __map_process_page_internal(struct process *proc,
 
 	spin_lock(&vs->lock);
 
-	for (i = 0; i < size >> PAGE_SHIFT; i++) {
+	for (i = 0; i < size >> PAGE_SHIFT; i++, virt += PAGE_SIZE) {
 		phy = arch_translate_va_to_pa(vs, virt);
 		if (phy != 0) {
-			pr_err("proc-%d 0x%x has been mapped\n", virt);
+			pr_err("proc-%d 0x%x has been mapped\n", proc->pid, virt);
 			continue;
 		}
 
@@ -190,10 +209,309 @@ static int __map_process_page_internal(struct process *proc,
 			break;
 		}
 
-		virt += PAGE_SIZE;
+		vs->rss_pages++;
+	}
+
+	spin_unlock(&vs->lock);
+	return ret;
+}
+
+static inline unsigned long right_to_vmflags(right_t right)
+{
+	unsigned long flags = 0;
+
+	if (right & KOBJ_RIGHT_READ)
+		flags |= __VM_READ;
+	if (right & KOBJ_RIGHT_WRITE)
+		flags |= __VM_WRITE;
+	if (right & KOBJ_RIGHT_EXEC)
+		flags |= __VM_EXEC;
+
+	return flags;
+}
+
+static struct anon_region *find_anon_region(struct process *proc,
+		unsigned long virt)
+{
+	struct anon_region *region;
+
+	list_for_each_entry(region, &proc->anon_list, list) {
+		if (virt < region->start)
+			break;
+		if (virt < region->end)
+			return region;
+	}
+
+	return NULL;
+}
+
+/*
+ * remove [start, end) from the anon region list, if one
+ * region need to be splited, the spare region will be used
+ * for the right part.
+ */
+static void __del_anon_range(struct process *proc, unsigned long start,
+		unsigned long end, struct anon_region **spare)
+{
+	struct anon_region *region, *tmp, *right;
+
+	list_for_each_entry_safe(region, tmp, &proc->anon_list, list) {
+		if (region->start >= end)
+			break;
+		if (region->end <= start)
+			continue;
+
+		if ((region->start >= start) && (region->end <= end)) {
+			list_del(&region->list);
+			free(region);
+		} else if ((region->start < start) && (region->end > end)) {
+			right = *spare;
+			*spare = NULL;
+			BUG_ON(!right);
+
+			right->start = end;
+			right->end = region->end;
+			right->flags = region->flags;
+			region->end = start;
+			list_add(&region->list, &right->list);
+			break;
+		} else if (region->start < start) {
+			region->end = start;
+		} else {
+			region->start = end;
+		}
+	}
+}
+
+int vspace_add_anon_region(struct process *proc, unsigned long start,
+		size_t size, right_t right)
+{
+	struct vspace *vs = &proc->vspace;
+	struct anon_region *new, *spare, *region, *prev;
+	struct list_head *head = &proc->anon_list;
+	unsigned long end = start + size;
+
+	if (!IS_PAGE_ALIGN(start) || !IS_PAGE_ALIGN(size) || (size == 0))
+		return -EINVAL;
+
+	new = zalloc(sizeof(struct anon_region));
+	spare = zalloc(sizeof(struct anon_region));
+	if (!new || !spare) {
+		if (new)
+			free(new);
+		if (spare)
+			free(spare);
+		return -ENOMEM;
+	}
+
+	new->start = start;
+	new->end = end;
+	new->flags = right_to_vmflags(right);
+
+	/*
+	 * the new region will override the old one, this is
+	 * how mprotect update the access right of the region.
+	 */
+	spin_lock(&vs->lock);
+	__del_anon_range(proc, start, end, &spare);
+
+	list_for_each_entry(region, head, list) {
+		if (region->start >= end)
+			break;
+	}
+	list_insert_before(&region->list, &new->list);
+
+	/*
+	 * merge with the neighbour if they have the same right.
+	 */
+	if (new->list.pre != head) {
+		prev = list_entry(new->list.pre, struct anon_region, list);
+		if ((prev->end == new->start) && (prev->flags == new->flags)) {
+			prev->end = new->end;
+			list_del(&new->list);
+			free(new);
+			new = prev;
+		}
+	}
+
+	if (new->list.next != head) {
+		region = list_entry(new->list.next, struct anon_region, list);
+		if ((region->start == new->end) && (region->flags == new->flags)) {
+			new->end = region->end;
+			list_del(&region->list);
+			free(region);
+		}
+	}
+	spin_unlock(&vs->lock);
+
+	if (spare)
+		free(spare);
+
+	return 0;
+}
+
+int vspace_del_anon_region(struct process *proc, unsigned long start, size_t size)
+{
+	struct vspace *vs = &proc->vspace;
+	struct anon_region *spare;
+
+	if (!IS_PAGE_ALIGN(start) || !IS_PAGE_ALIGN(size) || (size == 0))
+		return -EINVAL;
+
+	spare = zalloc(sizeof(struct anon_region));
+	if (!spare)
+		return -ENOMEM;
+
+	spin_lock(&vs->lock);
+	__del_anon_range(proc, start, start + size, &spare);
+	spin_unlock(&vs->lock);
+
+	if (spare)
+		free(spare);
+
+	return unmap_process_memory(proc, start, size);
+}
+
+static inline int anon_region_cover_block(struct anon_region *region,
+		unsigned long base)
+{
+	return (region->start <= base) && (region->end >= base + BLOCK_SIZE);
+}
+
+/*
+ * map a 2M block if the whole block is inside the region and
+ * nothing has been mapped in this block yet.
+ */
+static int map_anon_block(struct vspace *vs, struct anon_region *region,
+		unsigned long virt, unsigned long flags)
+{
+	unsigned long base = BLOCK_ALIGN(virt);
+	void *mem;
+	int ret;
+
+	if (!anon_region_cover_block(region, base) ||
+			!arch_host_block_none(vs, base))
+		return -EAGAIN;
+
+	mem = get_free_block(GFP_USER);
+	if (!mem)
+		return -ENOMEM;
+
+	memset(mem, 0, BLOCK_SIZE);
+	ret = __map_process_memory(vs, base, base + BLOCK_SIZE,
+			vtop(mem), flags | VM_HUGE);
+	if (ret)
+		free_block(mem);
+	else
+		vs->rss_pages += PAGES_PER_BLOCK;
+
+	return ret;
+}
+
+/*
+ * the first write to the zero page, replace it with a new
+ * page, no need to copy since the zero page is all zero.
+ */
+static int anon_zero_page_cow(struct vspace *vs,
+		unsigned long virt, unsigned long flags)
+{
+	void *mem;
+	int ret;
+
+	mem = get_free_page(GFP_USER);
+	if (!mem)
+		return -ENOMEM;
+
+	ret = arch_host_change_map(vs, virt, vtop(mem), flags);
+	if (ret) {
+		free_pages(mem);
+		return ret;
 	}
 
+	vs->zero_pages--;
+	vs->rss_pages++;
+
+	return 0;
+}
+
+/*
+ * return -ENOENT if the address is not in a anon region, then
+ * the caller need to send the page fault to the root service.
+ */
+int handle_anon_page_fault(struct process *proc, unsigned long virt, int write)
+{
+	struct vspace *vs = &proc->vspace;
+	struct anon_region *region;
+	unsigned long phy, flags;
+	void *mem;
+	int ret;
+
+	virt = PAGE_ALIGN(virt);
+
+	spin_lock(&vs->lock);
+	region = find_anon_region(proc, virt);
+	if (!region) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	flags = region->flags;
+	if (!(flags & __VM_READ) || (write && !(flags & __VM_WRITE))) {
+		pr_err("proc-%d access 0x%x with wrong right\n", proc->pid, virt);
+		ret = -EPERM;
+		goto out;
+	}
+
+	/*
+	 * the page may already mapped by other thread, or the
+	 * right of this region has been changed by mprotect.
+	 */
+	phy = arch_translate_va_to_pa(vs, virt);
+	if ((phy != 0) && (phy == zero_page_pa)) {
+		if (write)
+			ret = anon_zero_page_cow(vs, virt, flags);
+		else
+			ret = arch_host_change_map(vs, virt, phy,
+					(flags & ~__VM_WRITE) | __VM_ZERO);
+		goto out;
+	} else if (phy != 0) {
+		if (anon_region_cover_block(region, BLOCK_ALIGN(virt)))
+			flags |= VM_HUGE;
+		ret = arch_host_change_map(vs, virt, phy, flags);
+		goto out;
+	}
+
+	/*
+	 * read fault, map the zero page, the page will be
+	 * allocated when the process write it.
+	 */
+	if (!write && zero_page_pa) {
+		ret = __map_process_memory(vs, virt, virt + PAGE_SIZE,
+				zero_page_pa, (flags & ~__VM_WRITE) | __VM_ZERO);
+		if (ret == 0)
+			vs->zero_pages++;
+		goto out;
+	}
+
+	if (map_anon_block(vs, region, virt, flags) == 0) {
+		ret = 0;
+		goto out;
+	}
+
+	mem = get_free_page(GFP_USER);
+	if (!mem) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = __map_process_memory(vs, virt, virt + PAGE_SIZE, vtop(mem), flags);
+	if (ret)
+		free_pages(mem);
+	else
+		vs->rss_pages++;
+out:
 	spin_unlock(&vs->lock);
+
 	return ret;
 }
 
@@ -228,7 +546,7 @@ out:
 static int sys_map_anon(handle_t proc_handle, unsigned long virt,
 		size_t size, right_t right)
 {
-	unsigned long flags = 0;
+	unsigned long flags = right_to_vmflags(right);
 	struct kobject *kobj_proc;
 	right_t right_proc;
 	int ret;
@@ -244,13 +562,6 @@ static int sys_map_anon(handle_t proc_handle, unsigned long virt,
 		return -EINVAL;
 	}
 
-	if (right & KOBJ_RIGHT_READ)
-		flags |= __VM_READ;
-	if (right & KOBJ_RIGHT_WRITE)
-		flags |= __VM_WRITE;
-	if (right & KOBJ_RIGHT_EXEC)
-		flags |= __VM_EXEC;
-
 	/*
 	 * only root service can call this function, so the
 	 * proc_handle will awlays bigger than 0.
@@ -286,10 +597,12 @@ static int sys_unmap_anon(handle_t proc_handle, unsigned long virt, size_t size)
 }
 
 int sys_map(handle_t proc_handle, handle_t pma_handle,
-		unsigned long virt, size_t size, right_t right)
+		unsigned long virt, size_t size, right_t right,
+		unsigned long offset)
 {
 	extern int sys_map_pma(handle_t proc_handle, handle_t pma_handle,
-		unsigned long virt, size_t size, right_t right);
+		unsigned long virt, size_t size, right_t right,
+		unsigned long offset);
 
 	if (!user_ranges_ok((void *)virt, size))
 		return -EFAULT;
@@ -297,13 +610,13 @@ int sys_map(handle_t proc_handle, handle_t pma_handle,
 	if (!proc_can_vmctl(current_proc))
 		return -EPERM;
 
-	if (!IS_PAGE_ALIGN(virt) || !IS_PAGE_ALIGN(size))
+	if (!IS_PAGE_ALIGN(virt) || !IS_PAGE_ALIGN(size) || !IS_PAGE_ALIGN(offset))
 		return -EINVAL;
 
 	if (pma_handle <= 0)
-		return sys_map_anon(proc_handle, virt, size, right);
+		return offset ? -EINVAL : sys_map_anon(proc_handle, virt, size, right);
 	else
-		return sys_map_pma(proc_handle, pma_handle, virt, size, right);
+		return sys_map_pma(proc_handle, pma_handle, virt, size, right, offset);
 }
 
 int sys_unmap(handle_t proc_handle, handle_t pma_handle,
@@ -344,7 +657,7 @@ unsigned long sys_mtrans(unsigned long virt)
 
 static int handle_page_fault_ipc(struct process *proc, unsigned long virt, int write)
 {
-	uint64_t info = write ? KOBJ_RIGHT_READ : KOBJ_RIGHT_WRITE;
+	uint64_t info = write ? KOBJ_RIGHT_WRITE : KOBJ_RIGHT_READ;
 
 	return process_page_fault(proc, virt, info);
 }
@@ -400,6 +713,7 @@ int vspace_init(struct process *proc)
 
 	vs->asid = allocate_asid();
 	vs->pdata = proc;
+	init_list(&proc->anon_list);
 	vs->notifier_ops = &user_mm_notifier_ops;
 
 	return 0;
@@ -408,9 +722,15 @@ int vspace_init(struct process *proc)
 void vspace_deinit(struct process *proc)
 {
 	struct vspace *vs = &proc->vspace;
+	struct anon_region *region, *tmp;
 
 	unmap_process_memory(proc, 0, USER_PROCESS_ADDR_LIMIT);
 
+	list_for_each_entry_safe(region, tmp, &proc->anon_list, list) {
+		list_del(&region->list);
+		free(region);
+	}
+
 	if (vs->pgdp)
 		free(vs->pgdp);
 	if (vs->asid != 0)
@@ -419,6 +739,12 @@ void vspace_deinit(struct process *proc)
 
 static int umm_init(void)
 {
+	void *zero_page;
+
+	zero_page = get_free_page(GFP_USER);
+	ASSERT(zero_page != NULL);
+	zero_page_pa = vtop(zero_page);
+
 	max_asid = arch_get_asid_size();
 	pr_info("max asid %d\n", max_asid);
 	max_asid = max_asid > MAX_ASID ? MAX_ASID : max_asid;
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2022 Min Le (lemin9538@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ext4_crc32.h>
+
+/*
+ * host side check of the lwext4 crc32 and crc32c, build it with
+ * the host gcc and run "make check". the known answers are checked
+ * for the table and the instruction paths, then the two paths are
+ * compared for all the head alignments and lengths. on a host
+ * without the crc32 instructions the instruction path falls back
+ * to the table, only the known answers are meaningful there.
+ */
+#define CRCTEST_BUF_SIZE	4096
+#define CRCTEST_MAX_LEN		520
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const void *buf, uint32_t size);
+
+struct crc_kat {
+	const char *name;
+	crc_fn fn;
+	uint32_t check;
+};
+
+/*
+ * the lwext4 routines neither invert the input nor the output, the
+ * standard check value of "123456789" is ~fn(~0, "123456789", 9).
+ */
+static struct crc_kat crc_kats[] = {
+	{ "crc32 table", ext4_crc32_sw, 0xCBF43926 },
+	{ "crc32 insn", ext4_crc32_hw, 0xCBF43926 },
+	{ "crc32", ext4_crc32, 0xCBF43926 },
+	{ "crc32c table", ext4_crc32c_sw, 0xE3069283 },
+	{ "crc32c insn", ext4_crc32c_hw, 0xE3069283 },
+	{ "crc32c", ext4_crc32c, 0xE3069283 },
+};
+
+static int crc_kat_check(void)
+{
+	const char *str = "123456789";
+	uint32_t crc;
+	int i, bad = 0;
+
+	for (i = 0; i < sizeof(crc_kats) / sizeof(crc_kats[0]); i++) {
+		crc = ~crc_kats[i].fn(~0u, str, strlen(str));
+		if (crc == crc_kats[i].check)
+			continue;
+
+		printf("%s: check value 0x%08x expect 0x%08x\n",
+				crc_kats[i].name, crc, crc_kats[i].check);
+		bad++;
+	}
+
+	return bad;
+}
+
+static int crc_compare(const char *name, crc_fn sw, crc_fn hw,
+		const uint8_t *buf)
+{
+	uint32_t off, len, seed, a, b;
+	int bad = 0;
+
+	for (off = 0; off < 16; off++) {
+		for (len = 0; len <= CRCTEST_MAX_LEN; len++) {
+			seed = (len & 1) ? ~0u : off * 0x9e3779b9 + len;
+			a = sw(seed, buf + off, len);
+			b = hw(seed, buf + off, len);
+			if (a == b)
+				continue;
+
+			if (bad++ < 8)
+				printf("%s: off %u len %u table 0x%08x insn 0x%08x\n",
+						name, off, len, a, b);
+		}
+	}
+
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *buf;
+	int i, bad;
+
+	buf = malloc(CRCTEST_BUF_SIZE);
+	if (!buf)
+		return 1;
+
+	srand(0x4d494e4f);
+	for (i = 0; i < CRCTEST_BUF_SIZE; i++)
+		buf[i] = (uint8_t)rand();
+
+	if (!ext4_crc32_hw_supported())
+		printf("crctest: no crc32 instructions, table only\n");
+
+	bad = crc_kat_check();
+	bad += crc_compare("crc32", ext4_crc32_sw, ext4_crc32_hw, buf);
+	bad += crc_compare("crc32c", ext4_crc32c_sw, ext4_crc32c_hw, buf);
+	free(buf);
+
+	printf("crctest: %s\n", bad ? "FAILED" : "passed");
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 Min Le (lemin9538@163.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <ext4_blkdev.h>
+
+/*
+ * dump the block cache statistics of the ext4 server which
+ * the file belongs to.
+ *
+ * usage: bcstat <file>
+ */
+int main(int argc, char **argv)
+{
+	struct ext4_bcache_stats stats;
+	uint64_t total;
+	int fd, ret;
+
+	if (argc < 2) {
+		printf("usage: bcstat <file>\n");
+		return -EINVAL;
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		printf("bcstat: open %s failed %d\n", argv[1], errno);
+		return -ENOENT;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	ret = ioctl(fd, EXT4_IOC_BCACHE_STATS, &stats);
+	close(fd);
+
+	if (ret) {
+		printf("bcstat: get block cache stats failed %d\n", ret);
+		return ret;
+	}
+
+	total = stats.hits + stats.misses;
+
+	printf("block cache: %u x %u bytes, %u in use, %u max\n",
+			stats.cnt, stats.itemsize, stats.blocks, stats.max_blocks);
+	printf("hits %" PRIu64 " misses %" PRIu64 " evictions %" PRIu64 " hit rate %" PRIu64 "%%\n",
+			stats.hits, stats.misses, stats.evictions,
+			total ? stats.hits * 100 / total : 0);
+
+	return 0;
+}
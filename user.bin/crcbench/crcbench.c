@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021 Min Le (lemin9538@163.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <ext4_crc32.h>
+
+/*
+ * compare the table and the instruction paths of the ext4 crc32
+ * and crc32c over random buffers, alignments and sizes, then
+ * report the throughput of both with the given block size.
+ *
+ * usage: crcbench [block size] [total MB] [rounds of check]
+ */
+#define CRCBENCH_DEFAULT_BS	4096
+#define CRCBENCH_MAX_BS		(1024 * 1024)
+#define CRCBENCH_DEFAULT_MB	64
+#define CRCBENCH_DEFAULT_ROUNDS	100000
+#define CRCBENCH_CHECK_SIZE	8192
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const void *buf, uint32_t size);
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill_random(uint8_t *buf, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		buf[i] = (uint8_t)rand();
+}
+
+/*
+ * the random offset covers all the alignments of the head, the
+ * random size covers the tails and the sizes of the metadata.
+ */
+static int crc_check(const char *name, crc_fn sw, crc_fn hw,
+		uint8_t *buf, int rounds)
+{
+	uint32_t off, len, crc, a, b;
+	int i, bad = 0;
+
+	for (i = 0; i < rounds; i++) {
+		off = rand() % 8;
+		len = rand() % (CRCBENCH_CHECK_SIZE - off + 1);
+		crc = (i & 1) ? ~0u : (uint32_t)rand();
+
+		a = sw(crc, buf + off, len);
+		b = hw(crc, buf + off, len);
+		if (a == b)
+			continue;
+
+		if (bad++ < 8)
+			printf("%s mismatch off %u len %u: table 0x%08x insn 0x%08x\n",
+					name, off, len, a, b);
+	}
+
+	printf("%s: %d rounds, %d mismatch\n", name, rounds, bad);
+
+	return bad;
+}
+
+/*
+ * the check value of "123456789", the lwext4 routines do not invert
+ * the input and the output.
+ */
+static int crc_kat(const char *name, crc_fn fn, uint32_t check)
+{
+	uint32_t crc = ~fn(~0u, "123456789", 9);
+
+	if (crc == check)
+		return 0;
+
+	printf("%s check value 0x%08x expect 0x%08x\n", name, crc, check);
+
+	return 1;
+}
+
+static uint64_t crc_bench(crc_fn fn, uint8_t *buf, size_t bs, uint64_t total)
+{
+	uint32_t crc = ~0u;
+	uint64_t done, start;
+
+	start = time_ns();
+	for (done = 0; done < total; done += bs)
+		crc = fn(crc, buf, bs);
+	__asm__ volatile("" : : "r"(crc));
+
+	return time_ns() - start;
+}
+
+static uint64_t mbps(uint64_t bytes, uint64_t ns)
+{
+	return bytes * 1000 / (ns ? ns : 1);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t total = (uint64_t)CRCBENCH_DEFAULT_MB << 20;
+	int rounds = CRCBENCH_DEFAULT_ROUNDS;
+	size_t bs = CRCBENCH_DEFAULT_BS;
+	uint64_t sw_ns, hw_ns;
+	int bad = 0, hw;
+	uint8_t *buf;
+
+	if (argc > 1)
+		bs = strtoul(argv[1], NULL, 0);
+	if ((bs == 0) || (bs > CRCBENCH_MAX_BS)) {
+		printf("crcbench: block size must in 1 - %d\n", CRCBENCH_MAX_BS);
+		return -EINVAL;
+	}
+
+	if (argc > 2)
+		total = strtoull(argv[2], NULL, 0) << 20;
+	if (total == 0) {
+		printf("crcbench: total size must not be 0\n");
+		return -EINVAL;
+	}
+
+	if (argc > 3)
+		rounds = atoi(argv[3]);
+
+	buf = malloc(bs > CRCBENCH_CHECK_SIZE ? bs : CRCBENCH_CHECK_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	srand((unsigned int)time_ns());
+	fill_random(buf, bs > CRCBENCH_CHECK_SIZE ? bs : CRCBENCH_CHECK_SIZE);
+
+	hw = ext4_crc32_hw_supported();
+	if (!hw)
+		printf("crcbench: no crc32 instructions, table only\n");
+
+	bad += crc_kat("crc32 table", ext4_crc32_sw, 0xCBF43926);
+	bad += crc_kat("crc32c table", ext4_crc32c_sw, 0xE3069283);
+	if (hw) {
+		bad += crc_kat("crc32 insn", ext4_crc32_hw, 0xCBF43926);
+		bad += crc_kat("crc32c insn", ext4_crc32c_hw, 0xE3069283);
+	}
+
+	if (hw && (rounds > 0)) {
+		bad += crc_check("crc32", ext4_crc32_sw, ext4_crc32_hw, buf, rounds);
+		bad += crc_check("crc32c", ext4_crc32c_sw, ext4_crc32c_hw, buf, rounds);
+	}
+
+	sw_ns = crc_bench(ext4_crc32c_sw, buf, bs, total);
+	printf("crc32c table: %" PRIu64 " bytes in %" PRIu64 " us, %" PRIu64 " MB/s (bs %zu)\n",
+			total, sw_ns / 1000, mbps(total, sw_ns), bs);
+
+	if (hw) {
+		hw_ns = crc_bench(ext4_crc32c_hw, buf, bs, total);
+		printf("crc32c insn:  %" PRIu64 " bytes in %" PRIu64 " us, %" PRIu64 " MB/s (bs %zu)\n",
+				total, hw_ns / 1000, mbps(total, hw_ns), bs);
+		printf("speedup: %" PRIu64 ".%02" PRIu64 "x\n",
+				sw_ns / (hw_ns ? hw_ns : 1),
+				sw_ns * 100 / (hw_ns ? hw_ns : 1) % 100);
+	}
+
+	free(buf);
+
+	return bad ? -EIO : 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2021 Min Le (lemin9538@163.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * sequential read benchmark, read the file from the start to
+ * the end with the given block size and report the throughput.
+ * with more than one client, each client opens the file and
+ * reads it in its own thread at the same time.
+ *
+ * usage: iobench <file> [block size] [clients]
+ */
+#define IOBENCH_DEFAULT_BS	4096
+#define IOBENCH_MAX_BS		(1024 * 1024)
+#define IOBENCH_MAX_CLIENTS	16
+
+struct iobench_client {
+	pthread_t thread;
+	const char *path;
+	size_t bs;
+	uint64_t total;
+	uint64_t us;
+	int err;
+};
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *iobench_client(void *data)
+{
+	struct iobench_client *c = data;
+	uint64_t start;
+	ssize_t ret;
+	char *buf;
+	int fd;
+
+	buf = malloc(c->bs);
+	if (!buf) {
+		c->err = -ENOMEM;
+		return NULL;
+	}
+
+	fd = open(c->path, O_RDONLY);
+	if (fd < 0) {
+		printf("iobench: open %s failed %d\n", c->path, errno);
+		free(buf);
+		c->err = -ENOENT;
+		return NULL;
+	}
+
+	start = time_ns();
+	for (;;) {
+		ret = read(fd, buf, c->bs);
+		if (ret <= 0)
+			break;
+		c->total += ret;
+	}
+	c->us = (time_ns() - start) / 1000;
+
+	close(fd);
+	free(buf);
+
+	if (ret < 0) {
+		printf("iobench: read %s failed %d\n", c->path, errno);
+		c->err = -EIO;
+	}
+
+	return NULL;
+}
+
+static uint64_t kbps(uint64_t bytes, uint64_t us)
+{
+	return bytes * 1000000 / (us ? us : 1) / 1024;
+}
+
+int main(int argc, char **argv)
+{
+	struct iobench_client clients[IOBENCH_MAX_CLIENTS];
+	size_t bs = IOBENCH_DEFAULT_BS;
+	uint64_t start, us, total = 0;
+	int nr = 1, i, err = 0;
+
+	if (argc < 2) {
+		printf("usage: iobench <file> [block size] [clients]\n");
+		return -EINVAL;
+	}
+
+	if (argc > 2)
+		bs = strtoul(argv[2], NULL, 0);
+	if ((bs == 0) || (bs > IOBENCH_MAX_BS)) {
+		printf("iobench: block size must in 1 - %d\n", IOBENCH_MAX_BS);
+		return -EINVAL;
+	}
+
+	if (argc > 3)
+		nr = atoi(argv[3]);
+	if ((nr <= 0) || (nr > IOBENCH_MAX_CLIENTS)) {
+		printf("iobench: clients must in 1 - %d\n", IOBENCH_MAX_CLIENTS);
+		return -EINVAL;
+	}
+
+	memset(clients, 0, sizeof(clients));
+
+	if (nr == 1) {
+		clients[0].path = argv[1];
+		clients[0].bs = bs;
+		iobench_client(&clients[0]);
+		if (clients[0].err)
+			return clients[0].err;
+
+		printf("read %" PRIu64 " bytes in %" PRIu64 " us, %" PRIu64 " KB/s (bs %zu)\n",
+				clients[0].total, clients[0].us,
+				kbps(clients[0].total, clients[0].us), bs);
+		return 0;
+	}
+
+	start = time_ns();
+	for (i = 0; i < nr; i++) {
+		clients[i].path = argv[1];
+		clients[i].bs = bs;
+		if (pthread_create(&clients[i].thread, NULL, iobench_client, &clients[i])) {
+			printf("iobench: create client %d failed\n", i);
+			nr = i;
+			err = -ENOMEM;
+			break;
+		}
+	}
+
+	for (i = 0; i < nr; i++)
+		pthread_join(clients[i].thread, NULL);
+	us = (time_ns() - start) / 1000;
+
+	for (i = 0; i < nr; i++) {
+		if (clients[i].err)
+			err = clients[i].err;
+		total += clients[i].total;
+		printf("client %d: read %" PRIu64 " bytes in %" PRIu64 " us, %" PRIu64 " KB/s\n",
+				i, clients[i].total, clients[i].us,
+				kbps(clients[i].total, clients[i].us));
+	}
+
+	printf("%d clients: read %" PRIu64 " bytes in %" PRIu64 " us, %" PRIu64 " KB/s (bs %zu)\n",
+			nr, total, us, kbps(total, us), bs);
+
+	return err;
+}
@@ -32,12 +32,14 @@ static void print_process_info(int argc, char **argv, int proccnt,
 	/*
 	 * TBD
 	 */
-	printf(" TID  PID CMD \n");
+	printf(" TID  PID      RSS     ZERO CMD \n");
 	for (i = 0; i < proccnt; i++) {
 		if (kts[i].tid == 0)
 			continue;
 
-		printf("%4d %4d %s\n", kts[i].tid, kts[i].pid, get_task_name(kts, i));
+		printf("%4d %4d %7luK %7luK %s\n", kts[i].tid, kts[i].pid,
+				kts[i].rss_pages << 2, kts[i].zero_pages << 2,
+				get_task_name(kts, i));
 	}
 }
 
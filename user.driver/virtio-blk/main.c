@@ -12,6 +12,7 @@
 #include <minos/debug.h>
 #include <minos/list.h>
 #include <minos/device.h>
+#include <misc.h>
 
 #include "virtio.h"
 
@@ -19,9 +20,55 @@ static int irq_handle, mmio_handle;
 
 int main(int argc, char **argv)
 {
-	int ret;
+	int ret, opt;
+	char *end;
 	void *mmio;
 
+	while ((opt = getopt(argc, argv, "q:n:c:p:b:lm:")) != -1) {
+		switch (opt) {
+		case 'q':
+			virtio_blk_qdepth = atoi(optarg);
+			break;
+		case 'n':
+			virtio_blk_nr_queues = atoi(optarg);
+			break;
+		case 'c':
+			/* -c usecs[,count] irq coalescing */
+			virtio_blk_irq_usecs = strtoul(optarg, &end, 0);
+			if (*end == ',')
+				virtio_blk_irq_count = strtoul(end + 1, NULL, 0);
+			break;
+		case 'p':
+			/* bitmap of the queues which use polling mode */
+			virtio_blk_poll_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			virtio_blk_poll_budget = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			virtio_blk_lat_stat = 1;
+			break;
+		case 'm':
+			/* -m size[K|M] block cache size of the ext4 server */
+			virtio_blk_bcache_size = strtoul(optarg, &end, 0);
+			if (*end == 'K' || *end == 'k')
+				virtio_blk_bcache_size <<= 10;
+			else if (*end == 'M' || *end == 'm')
+				virtio_blk_bcache_size <<= 20;
+			break;
+		default:
+			pr_warn("virtio-blk: unknown option %c\n", opt);
+			break;
+		}
+	}
+
+	/*
+	 * pangu passes the fmap endpoint to the rootfs driver, the
+	 * file backed mmap is not supported without it.
+	 */
+	if (get_handles(argc, argv, &virtio_blk_fmap_handle, 1) != 1)
+		virtio_blk_fmap_handle = -1;
+
 	mmio_handle = get_device_mmio_handle("virtio,mmio", 0);
 	irq_handle = get_device_irq_handle("virtio,mmio", 0);
 	if (irq_handle <= 0 || mmio_handle <= 0) {
@@ -8,6 +8,9 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/param.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <minos/debug.h>
 #include <minos/list.h>
@@ -17,6 +20,7 @@
 #include <minos/proto.h>
 #include <minos/service.h>
 #include <minos/device.h>
+#include <minos/dma.h>
 
 #include <lwext4/ext4_blkdev.h>
 
@@ -25,9 +29,9 @@
 #define VFS_MAX_EVENTS 16
 
 struct virtio_cap blk_caps[] = {
-	{ "VIRTIO_BLK_F_SIZE_MAX", 1, false,
+	{ "VIRTIO_BLK_F_SIZE_MAX", 1, true,
 	  "Maximum size of any single segment is in size_max." },
-	{ "VIRTIO_BLK_F_SEG_MAX", 2, false,
+	{ "VIRTIO_BLK_F_SEG_MAX", 2, true,
 	  "Maximum number of segments in a request is in seg_max." },
 	{ "VIRTIO_BLK_F_GEOMETRY", 4, false,
 	  "Disk-style geometry specified in geometry." },
@@ -40,49 +44,185 @@ struct virtio_cap blk_caps[] = {
 	{ "VIRTIO_BLK_F_CONFIG_WCE", 11, false,
 	  "Device can toggle its cache between writeback and "
 	  "writethrough modes." },
+	{ "VIRTIO_BLK_F_MQ", 12, true,
+	  "Device supports multiqueue." },
 	VIRTIO_INDP_CAPS
 };
 
+#define VIRTIO_BLK_F_SIZE_MAX	1
+#define VIRTIO_BLK_F_SEG_MAX	2
+#define VIRTIO_BLK_F_MQ		12
+
+#define VIRTIO_BLK_QUEUE_SIZE	128
+#define VIRTIO_BLK_MAX_SEGS	64
+#define VIRTIO_BLK_STAT_INTERVAL	65536
+
+#define VIRTIO_BLK_QDEPTH	16
+#define VIRTIO_BLK_MAX_MERGE	2048	/* max sectors of one merged io */
+#define VIRTIO_BLK_MAX_QUEUES	8
+
+#define VIRTIO_BLK_POLL_BUDGET	20000	/* spins before waiting the irq */
+#define VIRTIO_BLK_LAT_BUCKETS	24	/* log2 of the latency in usecs */
+#define VIRTIO_BLK_BCACHE_SIZE	(16UL << 20)	/* block cache of the ext4 server */
+
+#define cpu_relax()	asm volatile("yield" ::: "memory")
+
+enum {
+	VIRTIO_BLK_LAT_IRQ,
+	VIRTIO_BLK_LAT_POLL,
+	VIRTIO_BLK_LAT_MAX,
+};
+
 #define get_vblkreq(req) container_of(req, struct virtio_blk_req, blkreq)
 
 static struct virtio_blk vblk_dev;
 
+/*
+ * each submitting thread is bound to one queue, the pending
+ * ios and the inflight requests are per queue.
+ */
+struct virtio_blk_queue {
+	struct virtio_blk *vdev;
+	struct virtqueue *virtq;
+	int index;
+	int inflight;
+	int dispatching;
+	int polled;		/* busy poll the used ring, no irq */
+	pthread_mutex_t lock;
+	struct list_head pending;	/* blkios waiting to be dispatched */
+	uint64_t lat_hist[VIRTIO_BLK_LAT_MAX][VIRTIO_BLK_LAT_BUCKETS];
+};
+
 struct virtio_blk {
 	virtio_regs *regs;
 	struct virtio_blk_config config;
-	struct virtqueue *virtq;
 	uint32_t intid;
+	struct irq_status_page *irq_status;
 	uint64_t sector_cnt;
+	uint64_t features;
+	uint32_t size_max;	/* max bytes of one data segment */
+	uint32_t seg_max;	/* max data segments of one request */
+
+	struct dma_pool *req_pool;	/* request header and footer */
+
+	int qdepth;		/* max inflight requests of each queue */
+	int nr_queues;
+	int nr_polled;
+	int next_queue;
+	pthread_mutex_t irq_lock;
+	struct virtio_blk_queue queues[VIRTIO_BLK_MAX_QUEUES];
 };
+
+int virtio_blk_qdepth = VIRTIO_BLK_QDEPTH;
+int virtio_blk_nr_queues = VIRTIO_BLK_MAX_QUEUES;
+uint32_t virtio_blk_irq_usecs;
+uint32_t virtio_blk_irq_count;
+uint32_t virtio_blk_poll_mask;
+uint32_t virtio_blk_poll_budget = VIRTIO_BLK_POLL_BUDGET;
+int virtio_blk_lat_stat;
+size_t virtio_blk_bcache_size = VIRTIO_BLK_BCACHE_SIZE;
+int virtio_blk_fmap_handle;
+
+static __thread struct virtio_blk_queue *vblk_queue;
+
+static void virtio_blk_dispatch(struct virtio_blk_queue *vq);
+
+static uint64_t virtio_blk_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void virtio_blk_account_latency(struct virtio_blk_queue *vq,
+		struct blkreq *breq)
+{
+	uint64_t us;
+	int bucket = 0;
+
+	if (!breq->submit_ns)
+		return;
+
+	us = (virtio_blk_time_ns() - breq->submit_ns) / 1000;
+	while (us && (bucket < VIRTIO_BLK_LAT_BUCKETS - 1)) {
+		us >>= 1;
+		bucket++;
+	}
+
+	vq->lat_hist[vq->polled][bucket]++;
+}
+
+static void virtio_blk_show_latency(struct virtio_blk_queue *vq)
+{
+	static const char *mode[] = { "irq", "poll" };
+	uint64_t *hist = vq->lat_hist[vq->polled];
+	int i;
+
+	pr_info("vd0 q%d %s latency (us):\n", vq->index, mode[vq->polled]);
+	for (i = 0; i < VIRTIO_BLK_LAT_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		pr_info("  < %-8lu %" PRIu64 "\n", 1UL << i, hist[i]);
+	}
+}
 #define get_vblkdev(dev) container_of(dev, struct virtio_blk, blkdev)
 
 #define HI32(u64) ((uint32_t)((0xFFFFFFFF00000000ULL & (u64)) >> 32))
 #define LO32(u64) ((uint32_t)(0x00000000FFFFFFFFULL & (u64)))
 
-static void virtio_blk_handle_used(struct virtio_blk *dev, uint32_t usedidx)
+static void virtio_blk_end_request(struct virtio_blk_queue *vq,
+		struct blkreq *breq, struct list_head *done);
+
+static void virtio_blk_handle_used(struct virtio_blk_queue *vq,
+		uint32_t desc, struct list_head *done)
 {
-	struct virtqueue *virtq = dev->virtq;
-	uint32_t desc1, desc2, desc3;
+	struct virtqueue *virtq = vq->virtq;
 	struct virtio_blk_req *req;
+	uint32_t next, cnt = 0;
+	uint16_t flags;
 
-	desc1 = virtq->used->ring[usedidx].id;
-	if (!(virtq->desc[desc1].flags & VIRTQ_DESC_F_NEXT))
+	if (desc >= virtq->len)
 		goto bad_desc;
-	desc2 = virtq->desc[desc1].next;
-	if (!(virtq->desc[desc2].flags & VIRTQ_DESC_F_NEXT))
-		goto bad_desc;
-	desc3 = virtq->desc[desc2].next;
-	if (virtq->desc[desc1].len != VIRTIO_BLK_REQ_HEADER_SIZE ||
-	    virtq->desc[desc2].len != VIRTIO_BLK_SECTOR_SIZE ||
-	    virtq->desc[desc3].len != VIRTIO_BLK_REQ_FOOTER_SIZE)
+
+	req = virtq->desc_virt[desc];
+	flags = virtq->desc[desc].flags;
+
+	/*
+	 * indirect request only use one ring descriptor, the
+	 * header, data and footer are all in its indirect table.
+	 */
+	if (flags & VIRTQ_DESC_F_INDIRECT) {
+		virtq_free_desc(virtq, desc);
+		goto out;
+	}
+
+	if (!(flags & VIRTQ_DESC_F_NEXT) ||
+			virtq->desc[desc].len != VIRTIO_BLK_REQ_HEADER_SIZE)
 		goto bad_desc;
 
-	req = virtq->desc_virt[desc1];
+	/*
+	 * header, one or more data segments and the footer, release
+	 * all the descriptors of this chain.
+	 */
+	for (;;) {
+		flags = virtq->desc[desc].flags;
+		next = virtq->desc[desc].next;
+		if (!(flags & VIRTQ_DESC_F_NEXT) &&
+				virtq->desc[desc].len != VIRTIO_BLK_REQ_FOOTER_SIZE)
+			pr_err("virtio-blk bad footer descriptor\n");
+
+		virtq_free_desc(virtq, desc);
+		if (!(flags & VIRTQ_DESC_F_NEXT))
+			break;
 
-	virtq_free_desc(virtq, desc1);
-	virtq_free_desc(virtq, desc2);
-	virtq_free_desc(virtq, desc3);
+		if ((++cnt >= virtq->len) || (next >= virtq->len))
+			goto bad_desc;
+		desc = next;
+	}
 
+out:
 	switch (req->status) {
 	case VIRTIO_BLK_S_OK:
 		req->blkreq.status = BLKREQ_OK;
@@ -92,9 +232,12 @@ static void virtio_blk_handle_used(struct virtio_blk *dev, uint32_t usedidx)
 		break;
 	default:
 		puts("Unhandled status in virtio_blk irq\n");
+		req->blkreq.status = BLKREQ_ERR;
 		break;
 	}
 
+	virtio_blk_end_request(vq, &req->blkreq, done);
+
 	return;
 
 bad_desc:
@@ -102,47 +245,188 @@ bad_desc:
 	return;
 }
 
-static void virtio_blk_isr(void)
+/*
+ * drain the used ring of the queue, the finished ios are moved
+ * to the done list, return the number of handled requests.
+ */
+static int virtio_blk_reap_queue(struct virtio_blk_queue *vq,
+		struct list_head *done)
 {
-	int i, len;
-	struct virtio_blk *dev = &vblk_dev;
+	struct virtqueue *virtq = vq->virtq;
+	uint32_t id;
+	int cnt = 0;
 
-	len = dev->virtq->len;
-	WRITE32(dev->regs->InterruptACK, READ32(dev->regs->InterruptStatus));
-	mb();
+	pthread_mutex_lock(&vq->lock);
+	do {
+		while (virtq_get_used(virtq, &id, NULL) == 0) {
+			virtio_blk_handle_used(vq, id, done);
+			cnt++;
+		}
+	} while (!vq->polled && virtq_enable_cb(virtq));
+	pthread_mutex_unlock(&vq->lock);
+
+	return cnt;
+}
+
+/*
+ * spin on the used index of the polled queues, return 1 if
+ * some requests have been finished in the budget.
+ */
+static int virtio_blk_busy_poll(struct virtio_blk *vdev)
+{
+	uint32_t budget;
+	int i;
 
-	for (i = dev->virtq->seen_used; i != (dev->virtq->used->idx % len);
-	     i = wrap(i + 1, len)) {
-		virtio_blk_handle_used(dev, i);
+	for (budget = virtio_blk_poll_budget; budget > 0; budget--) {
+		for (i = 0; i < vdev->nr_queues; i++) {
+			if (vdev->queues[i].polled &&
+					virtq_has_used(vdev->queues[i].virtq))
+				return 1;
+		}
+		cpu_relax();
 	}
 
-	dev->virtq->seen_used = dev->virtq->used->idx % len;
-	mb();
+	return 0;
 }
 
-static int virtio_blk_poll(struct virtio_blk *blk, struct blkreq *req)
+/*
+ * the budget is used up, enable the irq of the polled queues
+ * before waiting the irq, return 1 if some requests finished
+ * meanwhile, then the driver does not need to wait.
+ */
+static int virtio_blk_poll_enable_cb(struct virtio_blk *vdev, int enable)
 {
-	int ret;
+	struct virtio_blk_queue *vq;
+	int i, ret = 0;
+
+	for (i = 0; i < vdev->nr_queues; i++) {
+		vq = &vdev->queues[i];
+		if (!vq->polled)
+			continue;
 
-	ret = kobject_read(blk->intid, NULL, 0, NULL, NULL, 0, NULL, 500);
+		pthread_mutex_lock(&vq->lock);
+		if (enable)
+			ret |= virtq_enable_cb(vq->virtq);
+		else
+			virtq_disable_cb(vq->virtq);
+		pthread_mutex_unlock(&vq->lock);
+	}
+
+	return ret;
+}
+
+static void blkio_complete(struct blkio *io);
+
+static int virtio_blk_reap(struct virtio_blk *vdev, int irq)
+{
+	struct virtio_blk_queue *vq;
+	struct blkio *io, *next;
+	LIST_HEAD(done);
+	int i, cnt = 0, ret;
+
+	for (i = 0; i < vdev->nr_queues; i++) {
+		vq = &vdev->queues[i];
+		ret = virtio_blk_reap_queue(vq, &done);
+		if (ret && irq)
+			vq->virtq->nr_irq++;
+		cnt += ret;
+	}
+
+	/*
+	 * call the completion callbacks without holding the
+	 * queue lock.
+	 */
+	list_for_each_entry_safe(io, next, &done, list) {
+		list_del(&io->list);
+		blkio_complete(io);
+	}
+
+	return cnt;
+}
+
+/*
+ * virtio-mmio only has one interrupt for all the queues, the
+ * irq handler scans all of them. The finished requests are
+ * reaped before waiting the irq, other thread may already
+ * handled the interrupt for this queue.
+ */
+static int virtio_blk_poll(struct virtio_blk *vdev)
+{
+	int i, ret;
+
+	pthread_mutex_lock(&vdev->irq_lock);
+
+	if (virtio_blk_reap(vdev, 0))
+		goto out;
+
+	if (vdev->nr_polled) {
+		if (virtio_blk_busy_poll(vdev)) {
+			virtio_blk_reap(vdev, 0);
+			goto out;
+		}
+
+		if (virtio_blk_poll_enable_cb(vdev, 1)) {
+			virtio_blk_poll_enable_cb(vdev, 0);
+			virtio_blk_reap(vdev, 0);
+			goto out;
+		}
+	}
+
+	/*
+	 * in counter mode the irq is unmasked and waited in
+	 * one syscall, the unmask of the irq is delayed to the
+	 * next wait, after the device has been acked.
+	 */
+	if (vdev->irq_status)
+		ret = irq_ack_wait(vdev->intid, vdev->irq_status, 500);
+	else
+		ret = kobject_read(vdev->intid, NULL, 0, NULL, NULL, 0, NULL, 500);
 	if (ret != 0)
 		pr_err("get wrong virtio irq state %d\n", ret);
 
-	virtio_blk_isr();
+	WRITE32(vdev->regs->InterruptACK,
+			READ32(vdev->regs->InterruptStatus));
+	mb();
+
+	if (vdev->nr_polled)
+		virtio_blk_poll_enable_cb(vdev, 0);
+
+	virtio_blk_reap(vdev, 1);
+	if (!vdev->irq_status)
+		kobject_write(vdev->intid, NULL, 0, NULL, 0, 0);
+
+out:
+	pthread_mutex_unlock(&vdev->irq_lock);
 
-	kobject_write(blk->intid, NULL, 0, NULL, 0, 0);
+	/*
+	 * some requests have been finished, fill the device
+	 * queue with the pending ios.
+	 */
+	for (i = 0; i < vdev->nr_queues; i++)
+		virtio_blk_dispatch(&vdev->queues[i]);
 
 	return 0;
 }
 
-static void virtio_blk_send(struct virtio_blk *blk, struct virtio_blk_req *hdr)
+static void virtio_blk_send(struct virtio_blk_queue *vq, struct virtio_blk_req *hdr)
 {
-	blk->virtq->avail->ring[blk->virtq->avail->idx % blk->virtq->len] =
-	        hdr->descriptor;
-	blk->virtq->avail->idx += 1;
-	mb();
-
-	WRITE32(blk->regs->QueueNotify, 0);
+	struct virtqueue *virtq = vq->virtq;
+
+	if (virtio_blk_lat_stat)
+		hdr->blkreq.submit_ns = virtio_blk_time_ns();
+
+	virtq_add_avail(virtq, hdr->descriptor);
+	virtq_kick(virtq);
+
+	if ((virtq->nr_add % VIRTIO_BLK_STAT_INTERVAL) == 0) {
+		pr_info("vd0 q%d %" PRIu64 " requests, %" PRIu64 "%% notified, %"
+				PRIu64 "%% interrupted\n", vq->index,
+				virtq->nr_add,
+				virtq->nr_notify * 100 / virtq->nr_add,
+				virtq->nr_irq * 100 / virtq->nr_add);
+		if (virtio_blk_lat_stat)
+			virtio_blk_show_latency(vq);
+	}
 }
 
 #if 0
@@ -155,37 +439,91 @@ static int virtio_blk_status(struct virtio_blk *blkdev)
 	       READ32(blkdev->regs->InterruptStatus));
 	pr_info("    MagicValue=0x%x\n", READ32(blkdev->regs->MagicValue));
 	pr_info("  Queue 0:\n");
-	pr_info("    avail.idx = %u\n", blkdev->virtq->avail->idx);
-	pr_info("    used.idx = %u\n", blkdev->virtq->used->idx);
+	pr_info("    avail.idx = %u\n", blkdev->queues[0].virtq->avail->idx);
+	pr_info("    used.idx = %u\n", blkdev->queues[0].virtq->used->idx);
 	WRITE32(blkdev->regs->QueueSel, 0);
 	mb();
 	pr_info("    ready = 0x%x\n", READ32(blkdev->regs->QueueReady));
-	virtq_show(blkdev->virtq);
+	virtq_show(blkdev->queues[0].virtq);
 	return 0;
 }
 #endif
 
+/*
+ * the header and the footer of the request are in the DMA pool,
+ * the physical address is known without translation.
+ */
 static struct blkreq *virtio_blk_alloc(struct virtio_blk *dev)
 {
 	struct virtio_blk_req *vblkreq;
-	
-	vblkreq = zalloc(sizeof(struct virtio_blk_req));
+	unsigned long phys;
+
+	vblkreq = dma_pool_alloc(dev->req_pool, &phys);
 	if (!vblkreq)
 		return NULL;
 
+	memset(vblkreq, 0, sizeof(struct virtio_blk_req));
+	vblkreq->phys = phys;
+
 	return &vblkreq->blkreq;
 }
 
 static void virtio_blk_free(struct virtio_blk *blk, struct blkreq *req)
 {
 	struct virtio_blk_req *vblkreq = get_vblkreq(req);
-	free(vblkreq);
+
+	dma_pool_free(blk->req_pool, vblkreq);
+}
+
+static int virtio_blk_submit_indirect(struct virtio_blk_queue *vq,
+		struct virtio_blk_req *hdr, struct virtio_blk_seg *segs,
+		int nr_segs, uint32_t datamode)
+{
+	struct virtqueue *virtq = vq->virtq;
+	struct virtqueue_desc *table;
+	int i, cnt = 0;
+
+	hdr->descriptor = virtq_alloc_indirect(virtq, hdr, &table);
+
+	table[cnt].addr = hdr->phys;
+	table[cnt].len = VIRTIO_BLK_REQ_HEADER_SIZE;
+	table[cnt].flags = VIRTQ_DESC_F_NEXT;
+	table[cnt].next = cnt + 1;
+	cnt++;
+
+	for (i = 0; i < nr_segs; i++, cnt++) {
+		table[cnt].addr = segs[i].phys;
+		table[cnt].len = segs[i].len;
+		table[cnt].flags = datamode | VIRTQ_DESC_F_NEXT;
+		table[cnt].next = cnt + 1;
+	}
+
+	table[cnt].addr = hdr->phys + VIRTIO_BLK_REQ_HEADER_SIZE;
+	table[cnt].len = VIRTIO_BLK_REQ_FOOTER_SIZE;
+	table[cnt].flags = VIRTQ_DESC_F_WRITE;
+	table[cnt].next = 0;
+	cnt++;
+
+	virtq->desc[hdr->descriptor].len = cnt * sizeof(struct virtqueue_desc);
+	virtio_blk_send(vq, hdr);
+
+	return 0;
 }
 
-static int virtio_blk_submit(struct virtio_blk *blk, struct blkreq *req)
+/*
+ * the queue lock is held, the qdepth of the queue makes sure
+ * there are enough free descriptors for this request.
+ */
+static int virtio_blk_submit(struct virtio_blk_queue *vq, struct blkreq *req,
+		struct virtio_blk_seg *segs, int nr_segs)
 {
 	struct virtio_blk_req *hdr = get_vblkreq(req);
-	uint32_t d1, d2, d3, datamode = 0;
+	struct virtqueue *virtq = vq->virtq;
+	uint32_t head, prev, desc, datamode = 0;
+	int i;
+
+	if (virtq->num_free < (virtq->indirect ? 1 : nr_segs + 2))
+		return -EBUSY;
 
 	if (req->type == BLKREQ_READ) {
 		hdr->type = VIRTIO_BLK_T_IN;
@@ -195,24 +533,30 @@ static int virtio_blk_submit(struct virtio_blk *blk, struct blkreq *req)
 	}
 	hdr->sector = req->blkidx;
 
-	d1 = virtq_alloc_desc(blk->virtq, hdr);
-	hdr->descriptor = d1;
-	blk->virtq->desc[d1].len = VIRTIO_BLK_REQ_HEADER_SIZE;
-	blk->virtq->desc[d1].flags = VIRTQ_DESC_F_NEXT;
-
-	d2 = virtq_alloc_desc(blk->virtq, req->buf);
-	blk->virtq->desc[d2].len = VIRTIO_BLK_SECTOR_SIZE;
-	blk->virtq->desc[d2].flags = datamode | VIRTQ_DESC_F_NEXT;
-
-	d3 = virtq_alloc_desc(blk->virtq,
-	                      (void *)hdr + VIRTIO_BLK_REQ_HEADER_SIZE);
-	blk->virtq->desc[d3].len = VIRTIO_BLK_REQ_FOOTER_SIZE;
-	blk->virtq->desc[d3].flags = VIRTQ_DESC_F_WRITE;
+	if (virtq->indirect)
+		return virtio_blk_submit_indirect(vq, hdr, segs, nr_segs, datamode);
+
+	head = __virtq_alloc_desc(virtq, hdr, hdr->phys);
+	hdr->descriptor = head;
+	virtq->desc[head].len = VIRTIO_BLK_REQ_HEADER_SIZE;
+	virtq->desc[head].flags = VIRTQ_DESC_F_NEXT;
+	prev = head;
+
+	for (i = 0; i < nr_segs; i++) {
+		desc = __virtq_alloc_desc(virtq, segs[i].addr, segs[i].phys);
+		virtq->desc[desc].len = segs[i].len;
+		virtq->desc[desc].flags = datamode | VIRTQ_DESC_F_NEXT;
+		virtq->desc[prev].next = desc;
+		prev = desc;
+	}
 
-	blk->virtq->desc[d1].next = d2;
-	blk->virtq->desc[d2].next = d3;
+	desc = __virtq_alloc_desc(virtq, (void *)hdr + VIRTIO_BLK_REQ_HEADER_SIZE,
+			hdr->phys + VIRTIO_BLK_REQ_HEADER_SIZE);
+	virtq->desc[desc].len = VIRTIO_BLK_REQ_FOOTER_SIZE;
+	virtq->desc[desc].flags = VIRTQ_DESC_F_WRITE;
+	virtq->desc[prev].next = desc;
 
-	virtio_blk_send(blk, hdr);
+	virtio_blk_send(vq, hdr);
 
 	return 0;
 }
@@ -228,104 +572,358 @@ static void get_config(void *base, unsigned offset, void *buf, unsigned len)
 		ptr[i] = __raw_read8(base + offset + i);
 }
 
-static int blkreq_wait_all(struct virtio_blk *bdev, struct list_head *breq_list)
+static void *blkio_buf(struct blkio *io, uint32_t offset, uint32_t *left)
 {
-	struct blkreq *breq;
-
-	list_for_each_entry(breq, breq_list, list) {
-		if (breq->status != BLKREQ_INIT)
-			continue;
+	uint32_t size = io->cnt * VIRTIO_BLK_SECTOR_SIZE;
+	struct blkio *m;
 
-		while (breq->status == BLKREQ_INIT)
-			virtio_blk_poll(bdev, breq);
+	if (offset < size) {
+		*left = size - offset;
+		return io->buf + offset;
 	}
+	offset -= size;
 
-	list_for_each_entry(breq, breq_list, list) {
-		if (breq->status == BLKREQ_ERR)
-			return BLKREQ_ERR;
+	list_for_each_entry(m, &io->merged, list) {
+		size = m->cnt * VIRTIO_BLK_SECTOR_SIZE;
+		if (offset < size) {
+			*left = size - offset;
+			return m->buf + offset;
+		}
+		offset -= size;
 	}
 
-	return BLKREQ_OK;
+	return NULL;
 }
 
-int submit_blkreq_one(struct virtio_blk *bdev, struct blkreq *breq)
+/*
+ * split the buffers of the io into physically contiguous segments
+ * which obey the size_max and seg_max of the device, return the
+ * bytes which one request can carry, always sector aligned.
+ */
+static uint32_t virtio_blk_build_segs(struct virtio_blk *vdev, struct blkio *io,
+		uint32_t offset, uint32_t size, struct virtio_blk_seg *segs,
+		int *nr_segs)
 {
-	int ret;
+	unsigned long va, pa;
+	uint32_t len = 0, chunk, rem, left;
+	struct virtio_blk_seg *seg;
+	int cnt = 0;
+
+	while (len < size) {
+		va = (unsigned long)blkio_buf(io, offset + len, &left);
+		chunk = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+		chunk = MIN(chunk, left);
+		chunk = MIN(chunk, size - len);
+		chunk = MIN(chunk, vdev->size_max);
+
+		/*
+		 * the buffers from the DMA pool are translated in user
+		 * space, others fall back to the kernel.
+		 */
+		pa = dma_virt_to_phys((void *)va);
+		if (pa == -1)
+			pa = sys_mtrans(va);
+		if (pa == -1) {
+			pr_err("translate VA to PA failed\n");
+			return 0;
+		}
 
-	ret = virtio_blk_submit(bdev, breq);
-	if (ret)
-		return ret;
+		seg = cnt ? &segs[cnt - 1] : NULL;
+		if (seg && (seg->phys + seg->len == pa) &&
+				(seg->len + chunk <= vdev->size_max)) {
+			seg->len += chunk;
+		} else {
+			if (cnt == vdev->seg_max)
+				break;
+			seg = &segs[cnt++];
+			seg->addr = (void *)va;
+			seg->phys = pa;
+			seg->len = chunk;
+		}
 
-	while (breq->status == 0)
-		yield();
+		len += chunk;
+	}
+
+	/*
+	 * the request is full, drop the tail which is not a full
+	 * sector, it will be carried by next request.
+	 */
+	rem = len % VIRTIO_BLK_SECTOR_SIZE;
+	len -= rem;
+	while (rem) {
+		seg = &segs[cnt - 1];
+		chunk = MIN(rem, seg->len);
+		seg->len -= chunk;
+		rem -= chunk;
+		if (seg->len == 0)
+			cnt--;
+	}
 
-	return (breq->status == BLKREQ_ERR);
+	*nr_segs = cnt;
+
+	return len;
 }
 
-int submit_blkreq_many(struct virtio_blk *vdev, struct list_head *breq_list)
+/*
+ * a synchronous io lives on the stack of its waiter, which returns
+ * as soon as it sees the status. publish the status last and never
+ * touch the io after it.
+ */
+static void blkio_finish(struct blkio *io, int status)
 {
-	struct blkreq *breq;
-	int ret, status;
+	void (*end_io)(struct blkio *io) = io->end_io;
 
-	if (is_list_empty(breq_list)) {
-		pr_err("block request list is empty\n");
-		return -EINVAL;
+	if (!end_io) {
+		__atomic_store_n(&io->status, status, __ATOMIC_RELEASE);
+		return;
 	}
 
-	list_for_each_entry(breq, breq_list, list) {
-		ret = virtio_blk_submit(vdev, breq);
-		if (ret) {
-			ret = -EIO;
-			break;
-		}
+	io->status = status;
+	end_io(io);
+}
+
+static void blkio_complete(struct blkio *io)
+{
+	int status = io->error ? BLKREQ_ERR : BLKREQ_OK;
+	struct blkio *m, *next;
+
+	list_for_each_entry_safe(m, next, &io->merged, list) {
+		list_del(&m->list);
+		blkio_finish(m, status);
 	}
 
-	status = blkreq_wait_all(vdev, breq_list);
-	if (status != BLKREQ_OK)
-		ret = -EIO;
+	blkio_finish(io, status);
+}
 
-	return ret;
+static void virtio_blk_end_request(struct virtio_blk_queue *vq,
+		struct blkreq *breq, struct list_head *done)
+{
+	struct blkio *io = breq->io;
+
+	if (breq->status == BLKREQ_ERR)
+		io->error = 1;
+
+	virtio_blk_account_latency(vq, breq);
+	virtio_blk_free(vq->vdev, breq);
+	vq->inflight--;
+
+	if ((--io->inflight == 0) && io->submitted)
+		list_add_tail(done, &io->list);
 }
 
-static int request_virtio_blkdev_sectors(struct virtio_blk *vdev, void *buf,
-		uint64_t start, uint32_t cnt, int op)
+/*
+ * dispatch one io, include the merged ios, to the device. each
+ * request has one header, N data segments and one footer. called
+ * with the queue lock held, the lock is released when waiting
+ * for the device.
+ */
+static int virtio_blk_dispatch_io(struct virtio_blk_queue *vq, struct blkio *io)
 {
-	LIST_HEAD(blkreq_list);
-	struct blkreq *breq, *next;
-	int i, ret = 0, status;
+	struct virtio_blk_seg segs[VIRTIO_BLK_MAX_SEGS];
+	uint32_t size = io->group_cnt * VIRTIO_BLK_SECTOR_SIZE;
+	struct virtio_blk *vdev = vq->vdev;
+	uint32_t offset = 0, len;
+	struct blkreq *breq;
+	int ret = 0, nr_segs;
+
+	io->inflight = 1;
+
+	while (offset < size) {
+		while (vq->inflight >= vdev->qdepth) {
+			pthread_mutex_unlock(&vq->lock);
+			virtio_blk_poll(vdev);
+			pthread_mutex_lock(&vq->lock);
+		}
+
+		len = virtio_blk_build_segs(vdev, io, offset,
+				size - offset, segs, &nr_segs);
+		if (len == 0) {
+			ret = -EFAULT;
+			break;
+		}
 
-	for (i = 0; i < cnt; i++) {
 		breq = virtio_blk_alloc(vdev);
 		if (!breq) {
 			ret = -ENOMEM;
-			goto out;
+			break;
 		}
 
 		breq->status = BLKREQ_INIT;
-		breq->blkidx = start + i;
-		breq->type = op;
-		breq->buf = buf + i * VIRTIO_BLK_SECTOR_SIZE;
-		breq->size = VIRTIO_BLK_SECTOR_SIZE;
-		ret = virtio_blk_submit(vdev, breq);
+		breq->blkidx = io->start + offset / VIRTIO_BLK_SECTOR_SIZE;
+		breq->type = io->op;
+		breq->size = len;
+		breq->io = io;
+		io->inflight++;
+		vq->inflight++;
+
+		ret = virtio_blk_submit(vq, breq, segs, nr_segs);
 		if (ret) {
+			io->inflight--;
+			vq->inflight--;
 			virtio_blk_free(vdev, breq);
 			ret = -EIO;
 			break;
 		}
-		list_add_tail(&blkreq_list, &breq->list);
+		offset += len;
 	}
 
-	status = blkreq_wait_all(vdev, &blkreq_list);
-	if (status != BLKREQ_OK)
-		ret = -EIO;
+	if (ret)
+		io->error = 1;
 
-out:
-	list_for_each_entry_safe(breq, next, &blkreq_list, list) {
-		list_del(&breq->list);
-		virtio_blk_free(vdev, breq);
+	/*
+	 * the extra reference avoid the io is completed before
+	 * all its requests have been submitted.
+	 */
+	io->submitted = 1;
+
+	return (--io->inflight == 0);
+}
+
+static void virtio_blk_dispatch(struct virtio_blk_queue *vq)
+{
+	struct blkio *io;
+	int finish;
+
+	pthread_mutex_lock(&vq->lock);
+	if (vq->dispatching) {
+		pthread_mutex_unlock(&vq->lock);
+		return;
 	}
 
-	return ret;
+	vq->dispatching = 1;
+	while (!is_list_empty(&vq->pending) &&
+			(vq->inflight < vq->vdev->qdepth)) {
+		io = list_first_entry(&vq->pending, struct blkio, list);
+		list_del(&io->list);
+		finish = virtio_blk_dispatch_io(vq, io);
+		if (finish) {
+			pthread_mutex_unlock(&vq->lock);
+			blkio_complete(io);
+			pthread_mutex_lock(&vq->lock);
+		}
+	}
+	vq->dispatching = 0;
+	pthread_mutex_unlock(&vq->lock);
+}
+
+/*
+ * queue the io to the pending list, the ios wait here when the
+ * device queue is full, if the io is adjacent to the last pending
+ * io, it will be merged and sent as one io.
+ */
+static void virtio_blk_queue_io(struct virtio_blk_queue *vq, struct blkio *io)
+{
+	struct blkio *tail;
+
+	io->status = BLKREQ_INIT;
+	io->error = 0;
+	io->inflight = 0;
+	io->submitted = 0;
+	io->group_cnt = io->cnt;
+	init_list(&io->merged);
+
+	pthread_mutex_lock(&vq->lock);
+	if (!is_list_empty(&vq->pending)) {
+		tail = list_entry(vq->pending.pre, struct blkio, list);
+		if ((tail->op == io->op) &&
+				(tail->start + tail->group_cnt == io->start) &&
+				(tail->group_cnt + io->cnt <= VIRTIO_BLK_MAX_MERGE)) {
+			list_add_tail(&tail->merged, &io->list);
+			tail->group_cnt += io->cnt;
+			pthread_mutex_unlock(&vq->lock);
+			return;
+		}
+	}
+
+	list_add_tail(&vq->pending, &io->list);
+	pthread_mutex_unlock(&vq->lock);
+}
+
+/*
+ * the queue of the calling thread, the threads are spread
+ * to the queues in a round robin way when first submit.
+ */
+static struct virtio_blk_queue *virtio_blk_get_queue(struct virtio_blk *vdev)
+{
+	int index;
+
+	if (!vblk_queue) {
+		index = __atomic_fetch_add(&vdev->next_queue, 1, __ATOMIC_RELAXED);
+		vblk_queue = &vdev->queues[index % vdev->nr_queues];
+	}
+
+	return vblk_queue;
+}
+
+static int virtio_blk_submit_io(struct virtio_blk *vdev, struct blkio *io)
+{
+	struct virtio_blk_queue *vq = virtio_blk_get_queue(vdev);
+
+	if ((io->cnt == 0) || (io->start + io->cnt > vdev->sector_cnt))
+		return -EINVAL;
+
+	virtio_blk_queue_io(vq, io);
+	virtio_blk_dispatch(vq);
+
+	return 0;
+}
+
+/*
+ * wait until the ios counted by pending have been finished, the
+ * ios of the other callers on the same queue are not waited. the
+ * completion callbacks decrease the count, they are called by
+ * the thread which reaps the used ring in virtio_blk_poll(), the
+ * caller itself or another submitter, there is no irq thread.
+ */
+static int virtio_blk_wait(struct virtio_blk *vdev, int *pending)
+{
+	struct virtio_blk_queue *vq = virtio_blk_get_queue(vdev);
+
+	while (__atomic_load_n(pending, __ATOMIC_ACQUIRE)) {
+		virtio_blk_dispatch(vq);
+		virtio_blk_poll(vdev);
+	}
+
+	return 0;
+}
+
+static int request_virtio_blkdev_sectors(struct virtio_blk *vdev, void *buf,
+		uint64_t start, uint32_t cnt, int op)
+{
+	struct virtio_blk_queue *vq = virtio_blk_get_queue(vdev);
+	struct blkio io;
+	int ret;
+
+	memset(&io, 0, sizeof(struct blkio));
+	io.op = op;
+	io.start = start;
+	io.cnt = cnt;
+	io.buf = buf;
+
+	ret = virtio_blk_submit_io(vdev, &io);
+	if (ret)
+		return ret;
+
+	while (__atomic_load_n(&io.status, __ATOMIC_ACQUIRE) == BLKREQ_INIT) {
+		virtio_blk_dispatch(vq);
+		virtio_blk_poll(vdev);
+	}
+
+	return (io.status == BLKREQ_OK) ? 0 : -EIO;
+}
+
+struct virtio_ext4_io {
+	struct blkio io;
+	void (*done)(void *arg, int status);
+	void *arg;
+};
+
+static void virtio_ext4_end_io(struct blkio *io)
+{
+	struct virtio_ext4_io *eio = container_of(io, struct virtio_ext4_io, io);
+
+	eio->done(eio->arg, (io->status == BLKREQ_OK) ? 0 : -EIO);
+	free(eio);
 }
 
 static int virtio_ext4_iface_bread(struct ext4_blockdev *bdev, void *buf,
@@ -343,7 +941,39 @@ static int virtio_ext4_iface_bwrite(struct ext4_blockdev *bdev, const void *buf,
 	struct virtio_blk *vdev = bdev->bdif->p_user;
 
 	return request_virtio_blkdev_sectors(vdev, (void *)buf,
-			blk_id, blk_cnt, BLKREQ_READ);
+			blk_id, blk_cnt, BLKREQ_WRITE);
+}
+
+static int virtio_ext4_iface_bread_async(struct ext4_blockdev *bdev, void *buf,
+		uint64_t blk_id, uint32_t blk_cnt,
+		void (*done)(void *arg, int status), void *arg)
+{
+	struct virtio_blk *vdev = bdev->bdif->p_user;
+	struct virtio_ext4_io *eio;
+	int ret;
+
+	eio = zalloc(sizeof(struct virtio_ext4_io));
+	if (!eio)
+		return -ENOMEM;
+
+	eio->io.op = BLKREQ_READ;
+	eio->io.start = blk_id;
+	eio->io.cnt = blk_cnt;
+	eio->io.buf = buf;
+	eio->io.end_io = virtio_ext4_end_io;
+	eio->done = done;
+	eio->arg = arg;
+
+	ret = virtio_blk_submit_io(vdev, &eio->io);
+	if (ret)
+		free(eio);
+
+	return ret;
+}
+
+static int virtio_ext4_iface_bwait(struct ext4_blockdev *bdev, int *pending)
+{
+	return virtio_blk_wait(bdev->bdif->p_user, pending);
 }
 
 static int virtio_ext4_iface_open(struct ext4_blockdev *bdev)
@@ -363,6 +993,8 @@ static struct ext4_blockdev_iface virtio_ext4_iface = {
 	.open	= virtio_ext4_iface_open,
 	.bread	= virtio_ext4_iface_bread,
 	.bwrite = virtio_ext4_iface_bwrite,
+	.bread_async = virtio_ext4_iface_bread_async,
+	.bwait	= virtio_ext4_iface_bwait,
 	.close	= virtio_ext4_iface_close,
 	.lock	= NULL,
 	.unlock = NULL,
@@ -381,7 +1013,45 @@ static int run_virtio_block_ext4_server(void)
 	bdev.part_offset = 0;
 	bdev.part_size = vdev->sector_cnt * VIRTIO_BLK_SECTOR_SIZE;
 
-	return run_ext4_file_server(&bdev);
+	return run_ext4_file_server(&bdev, virtio_blk_bcache_size,
+			virtio_blk_fmap_handle);
+}
+
+static int virtio_blk_init_queue(struct virtio_blk *vdev, int index)
+{
+	struct virtio_blk_queue *vq = &vdev->queues[index];
+	struct virtqueue *virtq;
+
+	virtq = virtq_create(vdev->regs, index,
+			VIRTIO_BLK_QUEUE_SIZE, vdev->features);
+	if (!virtq)
+		return -ENOMEM;
+
+	/*
+	 * with indirect descriptors each request only takes one
+	 * slot of the ring, fall back to the chained descriptors
+	 * if the indirect tables can not be allocated.
+	 */
+	virtq_create_indirect(virtq, VIRTIO_BLK_MAX_SEGS + 2);
+	virtq_add_to_device(vdev->regs, virtq, index);
+
+	vq->vdev = vdev;
+	vq->virtq = virtq;
+	vq->index = index;
+
+	/*
+	 * the polled queue does not need the irq, the irq is only
+	 * enabled when the poll budget is used up.
+	 */
+	if (virtio_blk_poll_mask & (1U << index)) {
+		vq->polled = 1;
+		vdev->nr_polled++;
+		virtq_disable_cb(virtq);
+	}
+	init_list(&vq->pending);
+	pthread_mutex_init(&vq->lock, NULL);
+
+	return 0;
 }
 
 int virtio_blk_init(virtio_regs *regs, uint32_t intid)
@@ -389,11 +1059,13 @@ int virtio_blk_init(virtio_regs *regs, uint32_t intid)
 	struct virtio_blk *vdev;
 	struct virtqueue *virtq;
 	uint32_t genbefore, genafter;
+	int i, indirect = 1, ret;
 
 	vdev = &vblk_dev;
 	memset(vdev, 0, sizeof(struct virtio_blk));
+	pthread_mutex_init(&vdev->irq_lock, NULL);
 
-	virtio_check_capabilities(regs, blk_caps,
+	vdev->features = virtio_check_capabilities(regs, blk_caps,
 			ARRAY_SIZE(blk_caps), "virtio-blk");
 
 	WRITE32(regs->Status, READ32(regs->Status) | VIRTIO_STATUS_FEATURES_OK);
@@ -404,13 +1076,20 @@ int virtio_blk_init(virtio_regs *regs, uint32_t intid)
 		return -1;
 	}
 
-	virtq = virtq_create(regs, 32);
-	virtq_add_to_device(regs, virtq, 0);
-
 	vdev->regs = regs;
-	vdev->virtq = virtq;
 	vdev->intid = intid;
 
+	/*
+	 * fall back to the read/write irq interface if the kernel
+	 * does not support the counter mode.
+	 */
+	if (request_irq_status_page(intid, &vdev->irq_status)) {
+		pr_warn("virtio-blk irq counter mode not supported\n");
+		vdev->irq_status = NULL;
+	} else if (virtio_blk_irq_usecs || virtio_blk_irq_count) {
+		irq_set_coalesce(intid, virtio_blk_irq_usecs, virtio_blk_irq_count);
+	}
+
 	/* capacity is 64 bit, configuration reg read is not atomic */
 	do {
 		genbefore = READ32(vdev->regs->ConfigGeneration);
@@ -420,6 +1099,67 @@ int virtio_blk_init(virtio_regs *regs, uint32_t intid)
 	} while (genbefore != genafter);
 
 	vdev->sector_cnt = vdev->config.capacity;
+
+	vdev->req_pool = dma_pool_create(sizeof(struct virtio_blk_req),
+			VIRTIO_BLK_QUEUE_SIZE * VIRTIO_BLK_MAX_QUEUES);
+	if (!vdev->req_pool) {
+		pr_err("virtio-blk create request pool failed\n");
+		return -ENOMEM;
+	}
+
+	vdev->nr_queues = 1;
+	if (virtio_has_feature(vdev->features, VIRTIO_BLK_F_MQ) &&
+			(vdev->config.num_queues > 1))
+		vdev->nr_queues = vdev->config.num_queues;
+	vdev->nr_queues = MIN(vdev->nr_queues, virtio_blk_nr_queues);
+	vdev->nr_queues = MIN(vdev->nr_queues, VIRTIO_BLK_MAX_QUEUES);
+	vdev->nr_queues = MAX(vdev->nr_queues, 1);
+
+	for (i = 0; i < vdev->nr_queues; i++) {
+		ret = virtio_blk_init_queue(vdev, i);
+		if (ret) {
+			if (i == 0)
+				return ret;
+			vdev->nr_queues = i;
+			break;
+		}
+
+		if (!vdev->queues[i].virtq->indirect)
+			indirect = 0;
+	}
+
+	/*
+	 * one request needs a header and a footer descriptor, a
+	 * segment never cross the page if the size_max is not
+	 * provided by the device. without indirect descriptors
+	 * one request takes seg_max + 2 slots of the ring, so
+	 * split the ring by the queue depth first and give each
+	 * request its share, otherwise a request with the max
+	 * segments would take the whole ring.
+	 */
+	virtq = vdev->queues[0].virtq;
+	vdev->qdepth = MAX(virtio_blk_qdepth, 1);
+	vdev->qdepth = MIN(vdev->qdepth, virtq->len);
+	if (indirect) {
+		vdev->seg_max = VIRTIO_BLK_MAX_SEGS;
+	} else {
+		vdev->qdepth = MIN(vdev->qdepth, virtq->len / 3);
+		vdev->qdepth = MAX(vdev->qdepth, 1);
+		vdev->seg_max = virtq->len / vdev->qdepth - 2;
+		vdev->seg_max = MIN(VIRTIO_BLK_MAX_SEGS, vdev->seg_max);
+	}
+	if ((vdev->features & (1UL << VIRTIO_BLK_F_SEG_MAX)) &&
+			(vdev->config.seg_max >= 2))
+		vdev->seg_max = MIN(vdev->seg_max, vdev->config.seg_max);
+
+	vdev->size_max = UINT32_MAX;
+	if ((vdev->features & (1UL << VIRTIO_BLK_F_SIZE_MAX)) &&
+			(vdev->config.size_max >= VIRTIO_BLK_SECTOR_SIZE))
+		vdev->size_max = vdev->config.size_max;
+
+	pr_info("vd0 %d queues (%d polled), seg_max %d size_max 0x%x qdepth %d%s\n",
+			vdev->nr_queues, vdev->nr_polled, vdev->seg_max,
+			vdev->size_max, vdev->qdepth, indirect ? " indirect" : "");
 	pr_info("vd0 capacity : %ldMB\n", vdev->config.capacity * VIRTIO_BLK_SECTOR_SIZE / 1024 / 1024);
 
 	WRITE32(regs->Status, READ32(regs->Status) | VIRTIO_STATUS_DRIVER_OK);
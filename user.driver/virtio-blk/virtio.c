@@ -14,6 +14,7 @@
 #include <minos/debug.h>
 #include <minos/kobject.h>
 #include <minos/types.h>
+#include <minos/dma.h>
 
 #include "virtio.h"
 
@@ -25,7 +26,8 @@ static inline unsigned int virtq_size(unsigned int qsz)
 		VIRTQ_ALIGN(sizeof(uint16_t) * 3 + sizeof(struct virtqueue_used_elem) * qsz);
 }
 
-struct virtqueue *virtq_create(virtio_regs *regs, uint32_t len)
+struct virtqueue *virtq_create(virtio_regs *regs, uint32_t queue_sel,
+		uint32_t len, uint64_t features)
 {
 	int i, pma_handle;
 	void *page_virt = 0;
@@ -33,6 +35,11 @@ struct virtqueue *virtq_create(virtio_regs *regs, uint32_t len)
 	uint32_t max_queue_size;
 	uint32_t memsize;
 
+	/*
+	 * QueueNumMax is reported for the queue selected by
+	 * QueueSel, select the queue before reading it.
+	 */
+	WRITE32(regs->QueueSel, queue_sel);
 	max_queue_size = READ32(regs->QueueNumMax);
 	if (len > max_queue_size) {
 		pr_warn("virtio queue size not ready or too big %d %d\n",
@@ -76,13 +83,18 @@ struct virtqueue *virtq_create(virtio_regs *regs, uint32_t len)
 
 	virtq->desc = (struct virtqueue_desc *)page_virt;
 	virtq->avail = page_virt + len * sizeof(struct virtqueue_desc);
-	virtq->used = (void *)&virtq->avail->ring[len];
-	virtq->used = (void *)VIRTQ_ALIGN((unsigned long)virtq->used);
+	virtq->used_event = (void *)virtq->avail +
+		sizeof(struct virtqueue_avail) + sizeof(uint16_t) * len;
+	virtq->used = (void *)VIRTQ_ALIGN((unsigned long)(virtq->used_event + 1));
+	virtq->avail_event = (uint16_t *)&virtq->used->ring[len];
 
 	virtq->avail->idx = 0;
 	virtq->used->idx = 0;
 	virtq->seen_used = virtq->used->idx;
 	virtq->free_desc = 0;
+	virtq->num_free = len;
+	virtq->regs = regs;
+	virtq->features = features;
 
 	for (i = 0; i < len; i++) {
 		virtq->desc[i].next = i + 1;
@@ -91,21 +103,95 @@ struct virtqueue *virtq_create(virtio_regs *regs, uint32_t len)
 	return virtq;
 }
 
-uint32_t virtq_alloc_desc(struct virtqueue *virtq, void *addr)
+uint32_t __virtq_alloc_desc(struct virtqueue *virtq, void *addr,
+		unsigned long phys)
 {
 	uint32_t desc = virtq->free_desc;
-	uint32_t next = virtq->desc[desc].next;
-	if (desc == virtq->len)
+
+	if (desc == virtq->len) {
 		pr_err("ran out of virtqueue descriptors\n");
-	virtq->free_desc = next;
+		exit(-ENOSPC);
+	}
+
+	virtq->free_desc = virtq->desc[desc].next;
+	virtq->num_free--;
+
+	virtq->desc[desc].addr = phys;
+	virtq->desc_virt[desc] = addr;
+
+	return desc;
+}
+
+uint32_t virtq_alloc_desc(struct virtqueue *virtq, void *addr)
+{
+	unsigned long phys;
 
-	virtq->desc[desc].addr = sys_mtrans((unsigned long)addr);
-	if (virtq->desc[desc].addr == -1) {
+	phys = dma_virt_to_phys(addr);
+	if (phys == -1)
+		phys = sys_mtrans((unsigned long)addr);
+	if (phys == -1) {
 		pr_err("translate VA to PA failed\n");
 		exit(-EFAULT);
 	}
 
-	virtq->desc_virt[desc] = addr;
+	return __virtq_alloc_desc(virtq, addr, phys);
+}
+
+/*
+ * allocate the indirect tables for this virtqueue, each ring
+ * descriptor owns one table, so the table can be found by the
+ * head descriptor id without other bookkeeping.
+ */
+int virtq_create_indirect(struct virtqueue *virtq, uint32_t max)
+{
+	void *virt = NULL;
+	uint32_t memsize;
+	int handle;
+
+	if (!virtio_has_feature(virtq->features, VIRTIO_F_RING_INDIRECT_DESC))
+		return -ENOTSUP;
+
+	memsize = VIRTQ_ALIGN(sizeof(struct virtqueue_desc) * max * virtq->len);
+	handle = request_consequent_pma(memsize, KR_RW);
+	if (handle <= 0)
+		return -ENOMEM;
+
+	if (kobject_mmap(handle, &virt, NULL)) {
+		kobject_close(handle);
+		return -ENOMEM;
+	}
+
+	memset(virt, 0, memsize);
+	virtq->indirect_phys = sys_mtrans((unsigned long)virt);
+	if (virtq->indirect_phys == -1) {
+		kobject_close(handle);
+		return -EFAULT;
+	}
+
+	virtq->indirect = virt;
+	virtq->indirect_max = max;
+
+	return 0;
+}
+
+/*
+ * allocate one ring descriptor which points to its indirect table,
+ * the caller fills the table and then set the length of the ring
+ * descriptor to the size of the used table entries.
+ */
+uint32_t virtq_alloc_indirect(struct virtqueue *virtq, void *addr,
+		struct virtqueue_desc **table)
+{
+	unsigned long offset;
+	uint32_t desc;
+
+	desc = __virtq_alloc_desc(virtq, addr, 0);
+	offset = sizeof(struct virtqueue_desc) * virtq->indirect_max * desc;
+
+	virtq->desc[desc].addr = virtq->indirect_phys + offset;
+	virtq->desc[desc].flags = VIRTQ_DESC_F_INDIRECT;
+	*table = (void *)virtq->indirect + offset;
+
 	return desc;
 }
 
@@ -114,6 +200,105 @@ void virtq_free_desc(struct virtqueue *virtq, uint32_t desc)
 	virtq->desc[desc].next = virtq->free_desc;
 	virtq->free_desc = desc;
 	virtq->desc_virt[desc] = NULL;
+	virtq->num_free++;
+}
+
+/*
+ * whether the device need to be notified (or the driver need to
+ * be interrupted) when the index move from old to new_idx.
+ */
+static inline int vring_need_event(uint16_t event_idx,
+		uint16_t new_idx, uint16_t old)
+{
+	return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old);
+}
+
+void virtq_add_avail(struct virtqueue *virtq, uint32_t head)
+{
+	virtq->avail->ring[virtq->avail->idx % virtq->len] = head;
+	wmb();
+	virtq->avail->idx += 1;
+	virtq->nr_add++;
+}
+
+/*
+ * notify the device that new buffers are available, with EVENT_IDX
+ * the device tells which avail index it want to be notified, the
+ * notify is skipped when the device is still processing the queue.
+ */
+void virtq_kick(struct virtqueue *virtq)
+{
+	uint16_t old, new;
+	int need;
+
+	mb();
+	old = virtq->kick_avail;
+	new = virtq->avail->idx;
+	virtq->kick_avail = new;
+
+	if (virtio_has_feature(virtq->features, VIRTIO_F_RING_EVENT_IDX))
+		need = vring_need_event(*virtq->avail_event, new, old);
+	else
+		need = !(virtq->used->flags & VIRTQ_USED_F_NO_NOTIFY);
+
+	if (need) {
+		WRITE32(virtq->regs->QueueNotify, virtq->queue_sel);
+		virtq->nr_notify++;
+	}
+}
+
+/*
+ * get the next used buffer, return -EAGAIN if there is no
+ * more used buffer in the used ring.
+ */
+int virtq_get_used(struct virtqueue *virtq, uint32_t *id, uint32_t *len)
+{
+	uint16_t last = virtq->seen_used;
+	volatile struct virtqueue_used_elem *elem;
+
+	if (last == virtq->used->idx)
+		return -EAGAIN;
+	rmb();
+
+	elem = &virtq->used->ring[last % virtq->len];
+	*id = elem->id;
+	if (len)
+		*len = elem->len;
+	virtq->seen_used = (uint16_t)(last + 1);
+
+	return 0;
+}
+
+/*
+ * re-enable the used buffer interrupt after all the used buffer
+ * have been handled, with EVENT_IDX the device will not send the
+ * interrupt before the used_event is updated. Return 1 if more
+ * buffers were used by the device in the meantime.
+ */
+int virtq_enable_cb(struct virtqueue *virtq)
+{
+	if (virtio_has_feature(virtq->features, VIRTIO_F_RING_EVENT_IDX))
+		*virtq->used_event = virtq->seen_used;
+	else
+		virtq->avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+	mb();
+
+	return (uint16_t)virtq->seen_used != virtq->used->idx;
+}
+
+/*
+ * the driver polls the used ring, tell the device that it does
+ * not need to interrupt for this queue. with event index the
+ * used_event is set behind the used index, the device will not
+ * reach it before the driver enables the callback again.
+ */
+void virtq_disable_cb(struct virtqueue *virtq)
+{
+	if (virtio_has_feature(virtq->features, VIRTIO_F_RING_EVENT_IDX))
+		*virtq->used_event = (uint16_t)(virtq->seen_used - 1);
+	else
+		virtq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+	mb();
 }
 
 #define U64_HIGH(addr)	(uint32_t)((uint64_t)(addr) >> 32)
@@ -163,6 +348,8 @@ static void virtq_add_to_device_common(volatile virtio_regs *regs,
 void virtq_add_to_device(volatile virtio_regs *regs,
 		struct virtqueue *virtq, uint32_t queue_sel)
 {
+	virtq->queue_sel = queue_sel;
+
 	if (READ32(regs->Version) == 1)
 		virtq_add_to_device_legacy(regs, virtq, queue_sel);
 	else
@@ -183,9 +370,10 @@ void virtq_show(struct virtqueue *virtq)
 	}
 }
 
-void virtio_check_capabilities(virtio_regs *regs, struct virtio_cap *caps,
-                               uint32_t n, char *whom)
+uint64_t virtio_check_capabilities(virtio_regs *regs,
+		struct virtio_cap *caps, uint32_t n, char *whom)
 {
+	uint64_t features = 0;
 	uint32_t i;
 	uint32_t bank = 0;
 	uint32_t driver = 0;
@@ -201,25 +389,27 @@ void virtio_check_capabilities(virtio_regs *regs, struct virtio_cap *caps,
 			WRITE32(regs->DriverFeaturesSel, bank);
 			mb();
 			WRITE32(regs->DriverFeatures, driver);
+			features |= (uint64_t)driver << (bank * 32);
 			if (device) {
 				pr_info("%s: device supports unknown bits"
 				       " 0x%x in bank %u\n", whom, device,bank);
 			}
 			/* Now we set these variables for next time. */
 			bank = caps[i].bit / 32;
+			driver = 0;
 			WRITE32(regs->DeviceFeaturesSel, bank);
 			mb();
 			device = READ32(regs->DeviceFeatures);
 		}
-		if (device & (1 << caps[i].bit)) {
+		if (device & (1U << (caps[i].bit % 32))) {
 			if (caps[i].support) {
-				driver |= (1 << caps[i].bit);
+				driver |= (1U << (caps[i].bit % 32));
 			} else {
 				pr_info("virtio supports unsupported option %s (%s)\n",
 				       caps[i].name, caps[i].help);
 			}
 			/* clear this from device now */
-			device &= ~(1 << caps[i].bit);
+			device &= ~(1U << (caps[i].bit % 32));
 		}
 	}
 
@@ -227,10 +417,13 @@ void virtio_check_capabilities(virtio_regs *regs, struct virtio_cap *caps,
 	WRITE32(regs->DriverFeaturesSel, bank);
 	mb();
 	WRITE32(regs->DriverFeatures, driver);
+	features |= (uint64_t)driver << (bank * 32);
 	if (device) {
 		pr_info("%s: device supports unknown bits"
 		       " 0x%x in bank %u\n", whom, device, bank);
 	}
+
+	return features;
 }
 
 int virtio_dev_init(unsigned long virt, uint32_t intid)
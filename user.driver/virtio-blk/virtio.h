@@ -14,6 +14,16 @@
 #define VIRTIO_DEV_BLK 0x2
 #define wrap(x, len)   ((x) & ~(len))
 
+/*
+ * device independent feature bits
+ */
+#define VIRTIO_F_RING_INDIRECT_DESC	28
+#define VIRTIO_F_RING_EVENT_IDX		29
+#define VIRTIO_F_VERSION_1		32
+
+#define virtio_has_feature(features, bit) \
+	(!!((features) & (1ULL << (bit))))
+
 /*
  * See Section 4.2.2 of VIRTIO 1.0 Spec:
  * http://docs.oasis-open.org/virtio/virtio/v1.0/cs04/virtio-v1.0-cs04.html
@@ -116,6 +126,25 @@ struct virtqueue {
 	size_t len;
 	size_t seen_used;
 	size_t free_desc;
+	size_t num_free;
+
+	volatile virtio_regs *regs;
+	uint32_t queue_sel;
+	uint64_t features;
+	uint16_t kick_avail;	/* avail idx when last notify the device */
+
+	/*
+	 * indirect descriptor tables, one table for each ring
+	 * descriptor, indirect_max entries per table.
+	 */
+	struct virtqueue_desc *indirect;
+	unsigned long indirect_phys;
+	uint32_t indirect_max;
+
+	/* statistics, notify and irq count against the added buffers */
+	uint64_t nr_add;
+	uint64_t nr_notify;
+	uint64_t nr_irq;
 
 	volatile struct virtqueue_desc *desc;
 	volatile struct virtqueue_avail *avail;
@@ -143,6 +172,8 @@ struct virtio_blk_config {
 		uint32_t opt_io_size;
 	} topology;
 	uint8_t writeback;
+	uint8_t unused0;
+	uint16_t num_queues;
 } __attribute__((packed));
 
 struct virtio_net_config {
@@ -160,6 +191,8 @@ struct virtio_net_config {
 #define BLKREQ_OK 0x1
 #define BLKREQ_ERR 0x2
 
+struct blkio;
+
 struct blkreq {
 	int type;
 	uint64_t blkidx;		// which block need to read. default block size 4096
@@ -167,7 +200,30 @@ struct blkreq {
 	uint8_t *buf;			// blkreq buf address.
 	int status;			// blkreq status.
 	void *pdata;			// the private data for the realy device req if has.
+	struct blkio *io;		// the io which this request belongs to.
+	uint64_t submit_ns;		// submit time, for the latency statistics.
+	struct list_head list;
+};
+
+/*
+ * one asynchronous I/O of the caller, it may be carried by
+ * several blkreqs, and the adjacent blkios which wait in the
+ * pending queue are merged into the first one.
+ */
+struct blkio {
+	int op;
+	int status;
+	int error;			// one of the blkreqs failed.
+	uint64_t start;			// first sector.
+	uint32_t cnt;			// sector count of this io.
+	uint32_t group_cnt;		// sector count include the merged ios.
+	void *buf;
+	int inflight;			// blkreqs which are not finished.
+	int submitted;			// all blkreqs have been submitted.
+	void (*end_io)(struct blkio *io);
+	void *pdata;
 	struct list_head list;
+	struct list_head merged;
 };
 
 #define VIRTIO_BLK_REQ_HEADER_SIZE 16
@@ -184,11 +240,22 @@ struct virtio_blk_req {
 	/* end standard fields, begin helpers */
 	uint8_t _pad[3];
 	uint32_t descriptor;
+	uint64_t phys;
 	struct blkreq blkreq;
 } __attribute__((packed));
 
 #define VIRTIO_BLK_SECTOR_SIZE 512
 
+/*
+ * one data segment of a virtio-blk request, the memory
+ * of one segment is physically contiguous.
+ */
+struct virtio_blk_seg {
+	void *addr;
+	unsigned long phys;
+	uint32_t len;
+};
+
 #define VIRTIO_BLK_S_OK     0
 #define VIRTIO_BLK_S_IOERR  1
 #define VIRTIO_BLK_S_UNSUPP 2
@@ -196,25 +263,42 @@ struct virtio_blk_req {
 /*
  * virtqueue routines
  */
-struct virtqueue *virtq_create(virtio_regs *regs, uint32_t len);
+struct virtqueue *virtq_create(virtio_regs *regs, uint32_t queue_sel,
+		uint32_t len, uint64_t features);
+int virtq_create_indirect(struct virtqueue *virtq, uint32_t max);
+uint32_t virtq_alloc_indirect(struct virtqueue *virtq, void *addr,
+		struct virtqueue_desc **table);
 uint32_t virtq_alloc_desc(struct virtqueue *virtq, void *addr);
+uint32_t __virtq_alloc_desc(struct virtqueue *virtq, void *addr,
+		unsigned long phys);
 void virtq_free_desc(struct virtqueue *virtq, uint32_t desc);
 void virtq_add_to_device(volatile virtio_regs *regs, struct virtqueue *virtq,
                          uint32_t queue_sel);
 void virtq_show(struct virtqueue *virtq);
+void virtq_add_avail(struct virtqueue *virtq, uint32_t head);
+void virtq_kick(struct virtqueue *virtq);
+int virtq_get_used(struct virtqueue *virtq, uint32_t *id, uint32_t *len);
+int virtq_enable_cb(struct virtqueue *virtq);
+void virtq_disable_cb(struct virtqueue *virtq);
+
+static inline int virtq_has_used(struct virtqueue *virtq)
+{
+	return (uint16_t)virtq->seen_used !=
+		*(volatile uint16_t *)&virtq->used->idx;
+}
 
 /*
  * General purpose routines for virtio drivers
  */
-void virtio_check_capabilities(virtio_regs *device, struct virtio_cap *caps,
-                               uint32_t n, char *whom);
+uint64_t virtio_check_capabilities(virtio_regs *device,
+		struct virtio_cap *caps, uint32_t n, char *whom);
 
 #define VIRTIO_INDP_CAPS                                                       \
-	{ "VIRTIO_F_RING_INDIRECT_DESC", 28, false,                            \
+	{ "VIRTIO_F_RING_INDIRECT_DESC", 28, true,                             \
 	  "Negotiating this feature indicates that the driver can use"         \
 	  " descriptors with the VIRTQ_DESC_F_INDIRECT flag set, as"           \
 	  " described in 2.4.5.3 Indirect Descriptors." },                     \
-	{ "VIRTIO_F_RING_EVENT_IDX", 29, false,                        	       \
+	{ "VIRTIO_F_RING_EVENT_IDX", 29, true,                         	       \
 	  "This feature enables the used_event and the avail_event "           \
 	  "fields as described in 2.4.7 and 2.4.8." },                         \
 	{ "VIRTIO_F_VERSION_1", 32, false,                                     \
@@ -224,3 +308,13 @@ void virtio_check_capabilities(virtio_regs *device, struct virtio_cap *caps,
 int virtio_dev_init(unsigned long virt, uint32_t intid);
 
 int virtio_blk_init(virtio_regs *regs, uint32_t intid);
+
+extern int virtio_blk_qdepth;
+extern int virtio_blk_nr_queues;
+extern uint32_t virtio_blk_irq_usecs;
+extern uint32_t virtio_blk_irq_count;
+extern uint32_t virtio_blk_poll_mask;
+extern uint32_t virtio_blk_poll_budget;
+extern int virtio_blk_lat_stat;
+extern size_t virtio_blk_bcache_size;
+extern int virtio_blk_fmap_handle;
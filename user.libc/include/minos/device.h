@@ -22,7 +22,12 @@ extern "C" {
 #define READ32(_reg) (*(volatile uint32_t *)&(_reg))
 #define READ64(_reg) (*(volatile uint64_t *)&(_reg))
 
+struct irq_status_page;
+
 int request_irq_by_handle(int handle);
+int request_irq_status_page(int handle, struct irq_status_page **status);
+int irq_set_coalesce(int handle, uint32_t usecs, uint32_t count);
+int irq_ack_wait(int handle, struct irq_status_page *status, uint32_t timeout);
 int request_consequent_pma(size_t memsize, int right);
 void *request_mmio_by_handle(int handle);
 int get_device_mmio_handle(const char *comp, int index);
@@ -0,0 +1,57 @@
+#ifndef __LIBMINOS_DMA_H__
+#define __LIBMINOS_DMA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <minos/types.h>
+
+/*
+ * a DMA pool is a physically contiguous PMA which mapped to
+ * the process, split into fixed size objects. the physical
+ * address of an object is got without any syscall.
+ */
+struct dma_pool {
+	int handle;
+	void *virt;
+	unsigned long phys;
+	size_t size;
+	size_t obj_size;
+	size_t nr_objs;
+	size_t nr_free;
+	void *free;
+	volatile int lock[1];
+};
+
+struct dma_pool *dma_pool_create(size_t obj_size, size_t nr_objs);
+
+void dma_pool_destroy(struct dma_pool *pool);
+
+void *dma_pool_alloc(struct dma_pool *pool, unsigned long *phys);
+
+void dma_pool_free(struct dma_pool *pool, void *addr);
+
+static inline int dma_pool_contains(struct dma_pool *pool, void *addr)
+{
+	return ((unsigned long)addr >= (unsigned long)pool->virt) &&
+		((unsigned long)addr < (unsigned long)pool->virt + pool->size);
+}
+
+static inline unsigned long dma_pool_virt_to_phys(struct dma_pool *pool,
+		void *addr)
+{
+	return pool->phys + ((unsigned long)addr - (unsigned long)pool->virt);
+}
+
+/*
+ * translate the VA of any DMA pool of this process, return
+ * -1 if the address is not in a DMA pool.
+ */
+unsigned long dma_virt_to_phys(void *addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
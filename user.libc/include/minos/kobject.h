@@ -64,6 +64,8 @@ int grant(int proc, int handle, int right);
 
 int kobject_create_endpoint(size_t shmem_size);
 
+int kobject_reset_endpoint(int handle);
+
 int kobject_create_port(void);
 
 int kobject_create_notify(void);
@@ -45,6 +45,11 @@ enum {
 	PROTO_ACCESS,
 	PROTO_GETDENTS,
 	PROTO_REGISTER_SERVICE,
+	PROTO_FSYNC,
+	PROTO_UNLINK,
+	PROTO_FMAP,
+	PROTO_FPAGE,
+	PROTO_FPUT,
 	PROTO_VFS_END,
 };
 
@@ -100,6 +105,14 @@ struct proto_open {
 	int mode;
 };
 
+/*
+ * open a directory with O_DIRECTORY | PROTO_OPEN_PREFETCH, the
+ * server fills the first entries of the directory into the shared
+ * window of the new handle, after a long which is their length.
+ * the bit is never a real open flag.
+ */
+#define PROTO_OPEN_PREFETCH	0x40000000
+
 struct proto_openat {
 	int flags;
 	char mode[4];
@@ -115,11 +128,57 @@ struct proto_write {
 	off_t offset;
 };
 
+struct proto_ioctl {
+	unsigned long cmd;
+	unsigned long arg;
+};
+
+/*
+ * file backed mmap. PROTO_FMAP on a file checks the mapping and
+ * replies the fmap_info of the file in the shared buffer, the
+ * client passes it to pangu with PROTO_MMAP.
+ *
+ * pangu asks for the pages on the fmap endpoint, which only pangu
+ * can write and the file server of the rootfs reads. PROTO_FMAP on
+ * it attaches the mapping map to the key, and replies a read only
+ * handle of the page cache PMA. on a fault pangu asks for the page
+ * at index with PROTO_FPAGE, the server pins the page for the
+ * mapping and replies the offset of the page in the PMA, PROTO_FPUT
+ * unpins it after pangu unmapped it, or all the pages and detaches
+ * the mapping with FMAP_DETACH.
+ */
+struct proto_fmap {
+	uint64_t key;
+	uint64_t map;		/* mapping id of pangu */
+	uint32_t index;		/* page index in the file */
+	int prot;
+	int flags;
+};
+
+#define FMAP_DETACH		((uint32_t)-1)
+
+struct fmap_info {
+	uint64_t key;
+	uint32_t ino;
+	uint32_t padding;
+	uint64_t size;
+};
+
 struct proto_lseek {
 	off_t off;
 	int whence;
 };
 
+/*
+ * the d_off of a dirent is the cookie of the next entry, the client
+ * passes the d_off of the last entry it has consumed to resume, and
+ * 0 to start from the first entry. the reply is the size of the
+ * entries in the shared window, 0 at the end.
+ */
+struct proto_getdents {
+	off_t off;
+};
+
 struct proto_register_service {
 	int type;
 	int flags;
@@ -161,6 +220,9 @@ struct proto {
 		struct proto_read read;
 		struct proto_write write;
 		struct proto_lseek lseek;
+		struct proto_getdents getdents;
+		struct proto_ioctl ioctl;
+		struct proto_fmap fmap;
 		struct proto_elf_info elf_info;
 		struct proto_brk brk;
 		struct proto_access access;
@@ -141,6 +141,8 @@ int shm_open (const char *, int, mode_t);
 int shm_unlink (const char *);
 
 int sys_map(int proc, int pma, unsigned long base, size_t size, int right);
+int sys_map_offset(int proc, int pma, unsigned long base, size_t size,
+		int right, unsigned long offset);
 int sys_unmap(int proc, int pma, unsigned long base, size_t size);
 unsigned long sys_mtrans(unsigned long virt);
 
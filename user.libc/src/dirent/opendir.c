@@ -7,20 +7,29 @@
 #include "stdio_impl.h"
 
 #include <minos/kobject.h>
+#include <minos/proto.h>
 
+/*
+ * the server has filled the first entries of the directory into
+ * the window when it opens the directory, after their length.
+ */
 static DIR *__dirfd_open(int fd)
 {
+	size_t msize;
 	DIR *dir;
 
 	dir = calloc(1, sizeof *dir);
 	if (!dir)
 		goto out;
 
-	dir->buf_size = BUFSIZ;
 	dir->fd = fd;
-	if (kobject_mmap(fd, &dir->buf, NULL))
+	if (kobject_mmap(fd, &dir->buf, &msize))
 		goto out_free;
 
+	dir->buf_size = msize;
+	dir->buf_pos = sizeof(long);
+	dir->buf_end = sizeof(long) + *(long *)dir->buf;
+
 	return dir;
 
 out_free:
@@ -34,7 +43,8 @@ DIR *opendir(const char *name)
 {
 	int fd;
 
-	if ((fd = __sys_open(name, O_RDONLY|O_DIRECTORY|O_CLOEXEC, 0)) < 0)
+	if ((fd = __sys_open(name, O_RDONLY|O_DIRECTORY|O_CLOEXEC|
+			PROTO_OPEN_PREFETCH, 0)) < 0)
 		return 0;
 
 	return __dirfd_open(fd);
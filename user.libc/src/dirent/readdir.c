@@ -10,11 +10,15 @@
 typedef char dirstream_buf_alignment_check[1-2*(int)(
 	offsetof(struct __dirstream, buf) % sizeof(off_t))];
 
+/*
+ * resume from the d_off of the last entry which has been consumed.
+ */
 static int __readdir(DIR *dir)
 {
 	struct proto proto;
 
 	proto.proto_id = PROTO_GETDENTS;
+	proto.getdents.off = dir->tell;
 
 	return kobject_write(dir->fd, &proto,
 			sizeof(struct proto), NULL, 0, 5000);
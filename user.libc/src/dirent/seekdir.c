@@ -3,10 +3,14 @@
 #include "__dirent.h"
 #include "lock.h"
 
+/*
+ * the position is the cookie of the server, the next getdents
+ * request resumes from it.
+ */
 void seekdir(DIR *dir, long off)
 {
 	LOCK(dir->lock);
-	dir->tell = lseek(dir->fd, off, SEEK_SET);
+	dir->tell = off;
 	dir->buf_pos = dir->buf_end = 0;
 	UNLOCK(dir->lock);
 }
@@ -35,6 +35,52 @@ int request_irq_by_handle(int handle)
 	return kobject_open(handle);
 }
 
+/*
+ * switch the irq to counter mode and map its status page, the
+ * driver then use irq_ack_wait() to unmask and wait the irq in
+ * one syscall.
+ */
+int request_irq_status_page(int handle, struct irq_status_page **status)
+{
+	void *addr;
+	int ret;
+
+	ret = kobject_ctl(handle, KOBJ_IRQ_SET_COUNTER_MODE, 0);
+	if (ret)
+		return ret;
+
+	ret = kobject_mmap(handle, &addr, NULL);
+	if (ret)
+		return ret;
+
+	*status = addr;
+
+	return 0;
+}
+
+int irq_set_coalesce(int handle, uint32_t usecs, uint32_t count)
+{
+	return kobject_ctl(handle, KOBJ_IRQ_SET_COALESCE,
+			KOBJ_IRQ_COALESCE(usecs, count));
+}
+
+/*
+ * mark all the irqs as seen before the driver handles the
+ * device, the irq comes after this will wake up the driver.
+ * no syscall is needed if there are unseen irqs.
+ */
+int irq_ack_wait(int handle, struct irq_status_page *status, uint32_t timeout)
+{
+	int ret = 0;
+
+	if (status->count == status->seen)
+		ret = kobject_read(handle, NULL, 0, NULL, NULL, 0, NULL, timeout);
+
+	status->seen = status->count;
+
+	return ret;
+}
+
 int request_consequent_pma(size_t memsize, int right)
 {
 	return kobject_create_consequent_pma(memsize, right);
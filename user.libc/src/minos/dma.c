@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2021 Min Le (lemin9538@gmail.com)
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "stdio_impl.h"
+#include "lock.h"
+#include <minos/kobject.h>
+#include <minos/device.h>
+#include <minos/types.h>
+#include <minos/dma.h>
+
+#define DMA_POOL_MAX	16
+
+static struct dma_pool *dma_pools[DMA_POOL_MAX];
+static volatile int dma_pools_lock[1];
+
+static int dma_pool_register(struct dma_pool *pool)
+{
+	int i, ret = -ENOSPC;
+
+	LOCK(dma_pools_lock);
+	for (i = 0; i < DMA_POOL_MAX; i++) {
+		if (dma_pools[i] == NULL) {
+			dma_pools[i] = pool;
+			ret = 0;
+			break;
+		}
+	}
+	UNLOCK(dma_pools_lock);
+
+	return ret;
+}
+
+static void dma_pool_unregister(struct dma_pool *pool)
+{
+	int i;
+
+	LOCK(dma_pools_lock);
+	for (i = 0; i < DMA_POOL_MAX; i++) {
+		if (dma_pools[i] == pool) {
+			dma_pools[i] = NULL;
+			break;
+		}
+	}
+	UNLOCK(dma_pools_lock);
+}
+
+/*
+ * the pools are created when the driver init and live until
+ * the process exit, so the lookup does not take the lock.
+ */
+unsigned long dma_virt_to_phys(void *addr)
+{
+	struct dma_pool *pool;
+	int i;
+
+	for (i = 0; i < DMA_POOL_MAX; i++) {
+		pool = dma_pools[i];
+		if (pool && dma_pool_contains(pool, addr))
+			return dma_pool_virt_to_phys(pool, addr);
+	}
+
+	return -1;
+}
+
+struct dma_pool *dma_pool_create(size_t obj_size, size_t nr_objs)
+{
+	struct dma_pool *pool;
+	void *virt = NULL;
+	size_t i;
+
+	if ((obj_size == 0) || (nr_objs == 0))
+		return NULL;
+
+	/*
+	 * the object is aligned to the cache line, and the object
+	 * which is not bigger than one page never cross the page.
+	 */
+	obj_size = BALIGN(obj_size, sizeof(unsigned long) * 8);
+	if (obj_size > PAGE_SIZE / 2)
+		obj_size = PAGE_BALIGN(obj_size);
+	else
+		while (PAGE_SIZE % obj_size)
+			obj_size += sizeof(unsigned long) * 8;
+
+	pool = malloc(sizeof(struct dma_pool));
+	if (!pool)
+		return NULL;
+
+	memset(pool, 0, sizeof(struct dma_pool));
+	pool->obj_size = obj_size;
+	pool->nr_objs = nr_objs;
+	pool->size = PAGE_BALIGN(obj_size * nr_objs);
+
+	pool->handle = request_consequent_pma(pool->size, KR_RW);
+	if (pool->handle <= 0)
+		goto err_free_pool;
+
+	if (kobject_mmap(pool->handle, &virt, NULL))
+		goto err_close_pma;
+
+	/*
+	 * the PMA is physically contiguous, only the base address
+	 * need to be translated.
+	 */
+	pool->virt = virt;
+	pool->phys = sys_mtrans((unsigned long)virt);
+	if (pool->phys == -1)
+		goto err_unmap_pma;
+
+	for (i = 0; i < nr_objs; i++)
+		dma_pool_free(pool, virt + obj_size * (nr_objs - i - 1));
+
+	if (dma_pool_register(pool))
+		goto err_unmap_pma;
+
+	return pool;
+
+err_unmap_pma:
+	kobject_munmap(pool->handle);
+err_close_pma:
+	kobject_close(pool->handle);
+err_free_pool:
+	free(pool);
+
+	return NULL;
+}
+
+void dma_pool_destroy(struct dma_pool *pool)
+{
+	dma_pool_unregister(pool);
+	kobject_munmap(pool->handle);
+	kobject_close(pool->handle);
+	free(pool);
+}
+
+void *dma_pool_alloc(struct dma_pool *pool, unsigned long *phys)
+{
+	void *obj;
+
+	LOCK(pool->lock);
+	obj = pool->free;
+	if (obj) {
+		pool->free = *(void **)obj;
+		pool->nr_free--;
+	}
+	UNLOCK(pool->lock);
+
+	if (obj && phys)
+		*phys = dma_pool_virt_to_phys(pool, obj);
+
+	return obj;
+}
+
+void dma_pool_free(struct dma_pool *pool, void *addr)
+{
+	LOCK(pool->lock);
+	*(void **)addr = pool->free;
+	pool->free = addr;
+	pool->nr_free++;
+	UNLOCK(pool->lock);
+}
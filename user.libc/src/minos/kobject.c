@@ -15,6 +15,15 @@ int kobject_create_endpoint(size_t shmem_size)
 	return kobject_create(KOBJ_TYPE_ENDPOINT, shmem_size);
 }
 
+/*
+ * get the write right of the endpoint back after the client
+ * closed it, fails if someone else still holds the endpoint.
+ */
+int kobject_reset_endpoint(int handle)
+{
+	return kobject_ctl(handle, KOBJ_ENDPOINT_RESET, handle);
+}
+
 int kobject_create_socket(size_t shmem_size)
 {
 	return kobject_create(KOBJ_TYPE_SOCKET, shmem_size);
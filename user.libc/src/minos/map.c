@@ -5,7 +5,13 @@
 
 int sys_map(int proc, int pma, unsigned long base, size_t size, int right)
 {
-	return syscall(SYS_map, proc, pma, base, size, right);
+	return syscall(SYS_map, proc, pma, base, size, right, 0);
+}
+
+int sys_map_offset(int proc, int pma, unsigned long base, size_t size,
+		int right, unsigned long offset)
+{
+	return syscall(SYS_map, proc, pma, base, size, right, offset);
 }
 
 int sys_unmap(int proc, int pma, unsigned long base, size_t size)
@@ -0,0 +1,54 @@
+#include <sys/ioctl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "stdio_impl.h"
+
+#include <minos/proto.h>
+#include <minos/kobject.h>
+
+#define IOC_DIR(req)	(((unsigned int)(req) >> 30) & 0x3)
+#define IOC_SIZE(req)	(((unsigned int)(req) >> 16) & 0x3fff)
+
+/*
+ * the argument of the request is passed through the shared
+ * buffer of the file, the server copies the result back to
+ * the same buffer before reply.
+ */
+int ioctl(int fd, int req, ...)
+{
+	struct proto proto;
+	unsigned long size;
+	FILE *file;
+	void *arg;
+	va_list ap;
+	int ret;
+
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	file = __ofl_get_file(fd);
+	if (!file)
+		return -EBADF;
+
+	size = IOC_SIZE(req);
+	if (size > file->buf_size)
+		return -EINVAL;
+
+	if (size && (IOC_DIR(req) & _IOC_WRITE))
+		memcpy(file->buf, arg, size);
+
+	proto.proto_id = PROTO_IOCTL;
+	proto.ioctl.cmd = (unsigned int)req;
+	proto.ioctl.arg = (unsigned long)arg;
+
+	ret = kobject_write(fd, &proto, sizeof(struct proto), NULL, 0, -1);
+	if (ret < 0)
+		return ret;
+
+	if (size && (IOC_DIR(req) & _IOC_READ))
+		memcpy(arg, file->buf, size);
+
+	return ret;
+}
@@ -3,8 +3,10 @@
 #include <errno.h>
 #include <stdint.h>
 #include <limits.h>
+#include <stdio.h>
 #include "syscall.h"
 #include "pthread_impl.h"
+#include "stdio_impl.h"
 
 #include <minos/proto.h>
 #include <minos/kobject.h>
@@ -15,11 +17,44 @@ weak_alias(dummy, __vm_wait);
 #define UNIT SYSCALL_MMAP2_UNIT
 #define OFF_MASK ((-0x2000ULL << (8*sizeof(syscall_arg_t)-1)) | (UNIT-1))
 
+/*
+ * the file server only maps the file read only, a writable or
+ * executable private mapping gets a copy of the file instead.
+ */
+static void *mmap_copy(void *start, size_t len, int prot, int flags,
+		FILE *f, off_t off)
+{
+	void *addr;
+	off_t pos;
+
+	addr = __mmap(start, len, prot, flags | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		return addr;
+
+	pos = ftello(f);
+	if ((pos < 0) || fseeko(f, off, SEEK_SET)) {
+		__munmap(addr, len);
+		errno = EIO;
+		return MAP_FAILED;
+	}
+
+	fread(addr, 1, len, f);
+	fseeko(f, pos, SEEK_SET);
+
+	return addr;
+}
+
 void *__mmap(void *start, size_t len, int prot, int flags, int fd, off_t off)
 {
 	struct proto proto;
+	void *extra = NULL;
+	size_t extra_size = 0;
+	FILE *f;
 	long ret;
 
+	if (flags & MAP_ANONYMOUS)
+		fd = -1;
+
 	proto.proto_id = PROTO_MMAP;
 	proto.mmap.addr = start;
 	proto.mmap.len = len;
@@ -40,7 +75,47 @@ void *__mmap(void *start, size_t len, int prot, int flags, int fd, off_t off)
 		__vm_wait();
 	}
 
-	ret = kobject_write(self_handle(), &proto, sizeof(struct proto), NULL, 0, -1);
+	/*
+	 * file backed mapping, get the mapping info of the file from
+	 * the file server first, then pangu maps the pages of the page
+	 * cache of the server on demand.
+	 */
+	if (fd != -1) {
+		f = __ofl_get_file(fd);
+		if (!f) {
+			errno = EBADF;
+			return MAP_FAILED;
+		}
+
+		if ((flags & MAP_PRIVATE) && (prot & (PROT_WRITE | PROT_EXEC)))
+			return mmap_copy(start, len, prot, flags, f, off);
+
+		/* the buffered data is not in the page cache yet */
+		if ((f->wpos != f->wbase) && fflush(f)) {
+			errno = EIO;
+			return MAP_FAILED;
+		}
+
+		proto.proto_id = PROTO_FMAP;
+		proto.fmap.prot = prot;
+		proto.fmap.flags = flags;
+		ret = kobject_write(fd, &proto, sizeof(struct proto), NULL, 0, -1);
+		if (ret)
+			return (void *)__syscall_ret(ret);
+
+		proto.proto_id = PROTO_MMAP;
+		proto.mmap.addr = start;
+		proto.mmap.len = len;
+		proto.mmap.prot = prot;
+		proto.mmap.flags = flags;
+		proto.mmap.fd = fd;
+		proto.mmap.offset = off;
+		extra = f->buf;
+		extra_size = sizeof(struct fmap_info);
+	}
+
+	ret = kobject_write(self_handle(), &proto, sizeof(struct proto),
+			extra, extra_size, -1);
 
 	/* Fixup incorrect EPERM from kernel. */
 	if (ret == -EPERM && !start && (flags&MAP_ANON) && !(flags&MAP_FIXED))
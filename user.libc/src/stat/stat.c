@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stdio_impl.h"
+#include <minos/kobject.h>
+#include <minos/proto.h>
+
+int fstatat(int dirfd, const char *pathname, struct stat *statbuf, int flags)
+{
+	/*
+	 * currently only support Absolute path, TBD
+	 */
+	if ((dirfd != AT_FDCWD) || (pathname[0] != '/'))
+		return -EOPNOTSUPP;
+
+	return stat(pathname, statbuf);
+}
+
+/*
+ * the server fills the attribute of the file into the shared
+ * window of the file, from its inode attribute cache.
+ */
+int fstat(int fd, struct stat *statbuf)
+{
+	struct proto proto;
+	FILE *file;
+	int ret;
+
+	file = __ofl_get_file(fd);
+	if (!file)
+		return -EBADF;
+
+	/* the buffered data changes the size of the file */
+	if ((file->wpos != file->wbase) && fflush(file))
+		return -EIO;
+
+	proto.proto_id = PROTO_STAT;
+	ret = kobject_write(fd, &proto, sizeof(struct proto), NULL, 0, -1);
+	if (ret)
+		return ret;
+
+	memcpy(statbuf, file->buf, sizeof(struct stat));
+
+	return 0;
+}
+
+/*
+ * the reply of a path request can not carry data, open the path
+ * with O_PATH and get the attribute from the opened file.
+ */
+int stat(const char *pathname, struct stat *statbuf)
+{
+	int fd, ret;
+
+	fd = open(pathname, O_RDONLY | O_PATH);
+	if (fd <= 0)
+		return fd ? fd : -ENOENT;
+
+	ret = fstat(fd, statbuf);
+	close(fd);
+
+	return ret;
+}
+
+int lstat(const char *pathname, struct stat *statbuf)
+{
+	return stat(pathname, statbuf);
+}
@@ -13,6 +13,7 @@ FILE *__fdopen(int fd, int flags)
 {
 	FILE *f;
 	struct winsize wsz;
+	size_t size = 0;
 
 	/* Allocate FILE+buffer or fail */
 	if (!(f=malloc(sizeof *f + UNGET))) return 0;
@@ -25,14 +26,18 @@ FILE *__fdopen(int fd, int flags)
 	if (strchr(mode, 'e')) __syscall(SYS_fcntl, fd, F_SETFD, FD_CLOEXEC);
 #endif
 
-	if (kobject_mmap(fd, &f->buf, NULL)) {
+	if (kobject_mmap(fd, &f->buf, &size)) {
 		free(f);
 		return 0;
 	}
 
 	f->flags = flags;
 	f->fd = fd;
-	f->buf_size = BUFSIZ;
+	/*
+	 * the buffer is the shared window of the file, the server
+	 * decides its size.
+	 */
+	f->buf_size = size ? size : BUFSIZ;
 
 	/* Activate line buffered mode for terminals */
 	f->lbf = EOF;
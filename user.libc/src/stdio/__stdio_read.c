@@ -1,9 +1,11 @@
 #include "stdio_impl.h"
 #include <sys/uio.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include <minos/proto.h>
 #include <minos/kobject.h>
+#include <minos/types.h>
 
 size_t __stdio_read(FILE *f, unsigned char *buf, size_t len)
 {
@@ -16,9 +18,11 @@ size_t __stdio_read(FILE *f, unsigned char *buf, size_t len)
 
 	memset(&proto, 0, sizeof(struct proto));
 	proto.proto_id = PROTO_READ;
-	proto.read.len = f->buf_size;
 
 	do {
+		/* ask for as much as the shared window holds */
+		proto.read.len = MIN(PAGE_BALIGN(len), f->buf_size);
+
 		cnt = kobject_write(f->fd, &proto,
 				sizeof(struct proto), NULL, 0, -1);
 		if (cnt <= 0) {
@@ -40,7 +44,7 @@ size_t __stdio_read(FILE *f, unsigned char *buf, size_t len)
 	} while (len > 0);
 
 	if (rem != 0) {
-		f->rpos = f->buf + rem;
+		f->rpos = f->buf + copy;
 		f->rend = f->buf + cnt;
 	}
 
@@ -8,10 +8,12 @@ size_t __stdio_write(FILE *f, const unsigned char *buf, size_t len)
 {
 	size_t rem = len + (f->wpos - f->wbase);
 	size_t buf_rem = f->wend - f->wpos;
-	size_t cnt, copy, write_size;
+	size_t copy, write_size;
 	unsigned char *wbuf = f->wpos;
+	unsigned char *wdata = f->wbase;
 	struct proto proto;
 	size_t total = rem;
+	long cnt;
 
 	proto.proto_id = PROTO_WRITE;
 	copy = buf_rem > len ? len : buf_rem;
@@ -21,8 +23,12 @@ size_t __stdio_write(FILE *f, const unsigned char *buf, size_t len)
 		if (copy != 0)
 			memcpy(wbuf, buf, copy);
 
+		/*
+		 * the data is in the shared buffer from wdata, the buffered
+		 * data first then the copied one.
+		 */
 		proto.write.len = write_size;
-		proto.write.offset = wbuf - f->buf;
+		proto.write.offset = wdata - f->buf;
 		cnt = kobject_write(f->fd, &proto, sizeof(struct proto),
 				NULL, 0, -1);
 		if (cnt < 0) {
@@ -32,7 +38,7 @@ size_t __stdio_write(FILE *f, const unsigned char *buf, size_t len)
 		}
 
 		total -= write_size;
-		wbuf = f->buf;
+		wbuf = wdata = f->buf;
 		buf += copy;
 
 		copy = total > f->buf_size ? f->buf_size : total;
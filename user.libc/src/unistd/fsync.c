@@ -0,0 +1,28 @@
+#include <unistd.h>
+#include <errno.h>
+#include "syscall.h"
+#include "stdio_impl.h"
+
+#include <minos/proto.h>
+#include <minos/kobject.h>
+
+int fsync(int fd)
+{
+	struct proto proto;
+	FILE *file;
+
+	file = __ofl_get_file(fd);
+	if (!file)
+		return -EBADF;
+
+	/*
+	 * push the buffered data to the server first, then ask the
+	 * server to write the file back to the disk.
+	 */
+	if (fflush(file))
+		return -EIO;
+
+	proto.proto_id = PROTO_FSYNC;
+
+	return kobject_write(fd, &proto, sizeof(struct proto), NULL, 0, -1);
+}
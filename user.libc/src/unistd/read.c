@@ -14,5 +14,5 @@ ssize_t read(int fd, void *buf, size_t count)
 	if (!file)
 		return -ENOENT;
 
-	return fread(buf, count, 1, file);
+	return fread(buf, 1, count, file);
 }
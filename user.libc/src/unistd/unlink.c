@@ -0,0 +1,25 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "syscall.h"
+#include <string.h>
+
+#include <minos/proto.h>
+#include <minos/kobject.h>
+#include "libc.h"
+
+int unlink(const char *path)
+{
+	struct proto proto;
+
+	/*
+	 * currently only support Absolute path, TBD
+	 */
+	if ((path[0] != '/') || (path[strlen(path) - 1] == '/'))
+		return -EINVAL;
+
+	proto.proto_id = PROTO_UNLINK;
+
+	return sys_send_proto_with_data(libc.rootfs_handle,
+			&proto, (void *)path, strlen(path), -1);
+}
@@ -11,5 +11,5 @@ ssize_t write(int fd, const void *buf, size_t count)
 	if (!file)
 		return -ENOENT;
 
-	return fwrite(buf, count, 1, file);
+	return fwrite(buf, 1, count, file);
 }
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2021 Min Le (lemin9538@163.com)
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <minos/debug.h>
+
+#include <ext4_types.h>
+#include <ext4_super.h>
+#include <ext4_inode.h>
+
+#include "ext4_dcache.h"
+
+static inline uint32_t dcache_hash(struct ext4_dcache *dc, uint32_t parent,
+		const char *name, uint32_t len)
+{
+	uint32_t hash = parent * 0x9E3779B1U;
+
+	while (len--)
+		hash = (hash ^ (uint8_t)*name++) * 16777619U;
+
+	return hash & dc->dhash_mask;
+}
+
+static inline uint32_t attr_hash(struct ext4_dcache *dc, uint32_t ino)
+{
+	return (ino * 0x9E3779B1U) & dc->ahash_mask;
+}
+
+static struct dcache_entry *dcache_find(struct ext4_dcache *dc,
+		uint32_t parent, const char *name, uint32_t len)
+{
+	struct dcache_entry *de = dc->dhash[dcache_hash(dc, parent, name, len)];
+
+	for (; de; de = de->next) {
+		if ((de->parent == parent) && (de->len == len) &&
+				!memcmp(de->name, name, len))
+			return de;
+	}
+
+	return NULL;
+}
+
+static void dcache_drop(struct ext4_dcache *dc, struct dcache_entry *de)
+{
+	struct dcache_entry **pp;
+
+	if (!de->valid)
+		return;
+
+	pp = &dc->dhash[dcache_hash(dc, de->parent, de->name, de->len)];
+	for (; *pp; pp = &(*pp)->next) {
+		if (*pp == de) {
+			*pp = de->next;
+			break;
+		}
+	}
+
+	de->next = NULL;
+	de->valid = 0;
+}
+
+static void dcache_add(struct ext4_dcache *dc, uint32_t parent,
+		const char *name, uint32_t len, uint32_t ino, uint8_t type)
+{
+	struct dcache_entry *de;
+	uint32_t hash;
+
+	if (len >= DCACHE_NAME_LEN)
+		return;
+
+	/* another worker may have added it during the disk lookup */
+	de = dcache_find(dc, parent, name, len);
+	if (de)
+		goto out;
+
+	/* CLOCK replacement, give the accessed entry a second chance */
+	for (;;) {
+		de = &dc->dentry[dc->dhand];
+		dc->dhand = (dc->dhand + 1) % dc->nr_dentry;
+		if (!de->valid || !de->accessed)
+			break;
+		de->accessed = 0;
+	}
+
+	dcache_drop(dc, de);
+
+	hash = dcache_hash(dc, parent, name, len);
+	de->parent = parent;
+	de->len = len;
+	memcpy(de->name, name, len);
+	de->valid = 1;
+	de->next = dc->dhash[hash];
+	dc->dhash[hash] = de;
+out:
+	de->ino = ino;
+	de->type = type;
+	de->accessed = 1;
+}
+
+static struct attr_entry *attr_find(struct ext4_dcache *dc, uint32_t ino)
+{
+	struct attr_entry *ae = dc->ahash[attr_hash(dc, ino)];
+
+	for (; ae; ae = ae->next) {
+		if (ae->ino == ino)
+			return ae;
+	}
+
+	return NULL;
+}
+
+static void attr_drop(struct ext4_dcache *dc, struct attr_entry *ae)
+{
+	struct attr_entry **pp;
+
+	if (!ae->valid)
+		return;
+
+	pp = &dc->ahash[attr_hash(dc, ae->ino)];
+	for (; *pp; pp = &(*pp)->next) {
+		if (*pp == ae) {
+			*pp = ae->next;
+			break;
+		}
+	}
+
+	ae->next = NULL;
+	ae->valid = 0;
+}
+
+static void attr_add(struct ext4_dcache *dc, uint32_t ino, struct stat *st)
+{
+	struct attr_entry *ae;
+	uint32_t hash;
+
+	ae = attr_find(dc, ino);
+	if (ae)
+		goto out;
+
+	for (;;) {
+		ae = &dc->attr[dc->ahand];
+		dc->ahand = (dc->ahand + 1) % dc->nr_attr;
+		if (!ae->valid || !ae->accessed)
+			break;
+		ae->accessed = 0;
+	}
+
+	attr_drop(dc, ae);
+
+	hash = attr_hash(dc, ino);
+	ae->ino = ino;
+	ae->valid = 1;
+	ae->next = dc->ahash[hash];
+	dc->ahash[hash] = ae;
+out:
+	memcpy(&ae->st, st, sizeof(struct stat));
+	ae->accessed = 1;
+}
+
+/*
+ * walk the path from the root of the mount point to end, the
+ * cache is checked for each component first. the lookup result
+ * of the disk is only cached if no one invalidated anything
+ * meanwhile, otherwise a stale entry may come back.
+ */
+static int dcache_walk(struct ext4_dcache *dc, const char *name,
+		const char *end, uint32_t *ino, uint8_t *type)
+{
+	uint32_t cur = EXT4_INODE_ROOT_INDEX, next, len, gen;
+	uint8_t ctype = EXT4_DE_DIR, ntype;
+	struct dcache_entry *de;
+	const char *p;
+	int ret;
+
+	for (;;) {
+		while ((name < end) && (*name == '/'))
+			name++;
+		if (name >= end)
+			break;
+
+		if (ctype != EXT4_DE_DIR)
+			return -ENOTDIR;
+
+		for (p = name; (p < end) && (*p != '/'); p++)
+			;
+		len = p - name;
+		if (len > EXT4_DIRECTORY_FILENAME_LEN)
+			return -ENAMETOOLONG;
+
+		pthread_mutex_lock(&dc->lock);
+		de = dcache_find(dc, cur, name, len);
+		if (de) {
+			de->accessed = 1;
+			next = de->ino;
+			ntype = de->type;
+			if (next)
+				dc->hits++;
+			else
+				dc->neg_hits++;
+			pthread_mutex_unlock(&dc->lock);
+
+			if (!next)
+				return -ENOENT;
+		} else {
+			dc->misses++;
+			gen = dc->gen;
+			pthread_mutex_unlock(&dc->lock);
+
+			ret = ext4_dir_lookup(dc->mount_point, cur,
+					name, len, &next, &ntype);
+			if (ret && (ret != ENOENT))
+				return -ret;
+			if (ret)
+				next = ntype = 0;
+
+			pthread_mutex_lock(&dc->lock);
+			if (gen == dc->gen)
+				dcache_add(dc, cur, name, len, next, ntype);
+			pthread_mutex_unlock(&dc->lock);
+
+			if (!next)
+				return -ENOENT;
+		}
+
+		cur = next;
+		ctype = ntype;
+		name = p;
+	}
+
+	*ino = cur;
+	*type = ctype;
+
+	return 0;
+}
+
+static inline const char *dcache_path(struct ext4_dcache *dc, const char *path)
+{
+	size_t len = strlen(dc->mount_point);
+
+	if (!strncmp(path, dc->mount_point, len))
+		path += len;
+
+	return path;
+}
+
+int ext4_dcache_lookup(struct ext4_dcache *dc, const char *path,
+		uint32_t *ino, uint8_t *type)
+{
+	path = dcache_path(dc, path);
+
+	return dcache_walk(dc, path, path + strlen(path), ino, type);
+}
+
+/*
+ * drop the last component of the path and the attribute of its
+ * inode, called after the path is created, removed or truncated.
+ */
+void ext4_dcache_invalidate(struct ext4_dcache *dc, const char *path)
+{
+	const char *name, *end;
+	struct dcache_entry *de;
+	uint32_t parent;
+	uint8_t type;
+
+	path = dcache_path(dc, path);
+	end = path + strlen(path);
+	while ((end > path) && (end[-1] == '/'))
+		end--;
+	for (name = end; (name > path) && (name[-1] != '/'); name--)
+		;
+
+	pthread_mutex_lock(&dc->lock);
+	dc->gen++;
+	pthread_mutex_unlock(&dc->lock);
+
+	if ((name == end) || dcache_walk(dc, path, name, &parent, &type))
+		return;
+
+	pthread_mutex_lock(&dc->lock);
+	de = dcache_find(dc, parent, name, end - name);
+	if (de) {
+		if (de->ino) {
+			struct attr_entry *ae = attr_find(dc, de->ino);
+			if (ae)
+				attr_drop(dc, ae);
+		}
+		dcache_drop(dc, de);
+	}
+	pthread_mutex_unlock(&dc->lock);
+}
+
+int ext4_dcache_getattr(struct ext4_dcache *dc, uint32_t ino, struct stat *st)
+{
+	struct ext4_sblock *sb = dc->sb;
+	struct ext4_inode inode;
+	struct attr_entry *ae;
+	uint32_t gen;
+	int ret;
+
+	pthread_mutex_lock(&dc->lock);
+	ae = attr_find(dc, ino);
+	if (ae) {
+		ae->accessed = 1;
+		memcpy(st, &ae->st, sizeof(struct stat));
+		dc->hits++;
+		pthread_mutex_unlock(&dc->lock);
+		return 0;
+	}
+	dc->misses++;
+	gen = dc->gen;
+	pthread_mutex_unlock(&dc->lock);
+
+	ret = ext4_inode_get(dc->mount_point, ino, &inode);
+	if (ret)
+		return -ret;
+
+	memset(st, 0, sizeof(struct stat));
+	st->st_ino = ino;
+	st->st_mode = ext4_inode_get_mode(sb, &inode);
+	st->st_nlink = ext4_inode_get_links_cnt(&inode);
+	st->st_uid = ext4_inode_get_uid(&inode);
+	st->st_gid = ext4_inode_get_gid(&inode);
+	st->st_size = ext4_inode_get_size(sb, &inode);
+	st->st_blksize = ext4_sb_get_block_size(sb);
+	st->st_blocks = ext4_inode_get_blocks_count(sb, &inode);
+	st->st_atim.tv_sec = ext4_inode_get_access_time(&inode);
+	st->st_mtim.tv_sec = ext4_inode_get_modif_time(&inode);
+	st->st_ctim.tv_sec = ext4_inode_get_change_inode_time(&inode);
+
+	pthread_mutex_lock(&dc->lock);
+	if (gen == dc->gen)
+		attr_add(dc, ino, st);
+	pthread_mutex_unlock(&dc->lock);
+
+	return 0;
+}
+
+void ext4_dcache_attr_invalidate(struct ext4_dcache *dc, uint32_t ino)
+{
+	struct attr_entry *ae;
+
+	pthread_mutex_lock(&dc->lock);
+	dc->gen++;
+	ae = attr_find(dc, ino);
+	if (ae)
+		attr_drop(dc, ae);
+	pthread_mutex_unlock(&dc->lock);
+}
+
+struct ext4_dcache *ext4_dcache_create(const char *mount_point,
+		uint32_t nr_dentry, uint32_t nr_attr)
+{
+	struct ext4_dcache *dc;
+	uint32_t buckets;
+
+	dc = zalloc(sizeof(struct ext4_dcache));
+	if (!dc)
+		return NULL;
+
+	if (ext4_get_sblock(mount_point, &dc->sb)) {
+		pr_err("dcache: no super block of %s\n", mount_point);
+		goto err_free_dc;
+	}
+
+	dc->mount_point = mount_point;
+	dc->nr_dentry = nr_dentry;
+	dc->nr_attr = nr_attr;
+
+	for (buckets = 16; buckets < nr_dentry; buckets <<= 1)
+		;
+	dc->dhash_mask = buckets - 1;
+	dc->dhash = zalloc(buckets * sizeof(struct dcache_entry *));
+	dc->dentry = zalloc(nr_dentry * sizeof(struct dcache_entry));
+
+	for (buckets = 16; buckets < nr_attr; buckets <<= 1)
+		;
+	dc->ahash_mask = buckets - 1;
+	dc->ahash = zalloc(buckets * sizeof(struct attr_entry *));
+	dc->attr = zalloc(nr_attr * sizeof(struct attr_entry));
+
+	if (!dc->dhash || !dc->dentry || !dc->ahash || !dc->attr)
+		goto err_free_mem;
+
+	pthread_mutex_init(&dc->lock, NULL);
+
+	return dc;
+
+err_free_mem:
+	free(dc->dhash);
+	free(dc->dentry);
+	free(dc->ahash);
+	free(dc->attr);
+err_free_dc:
+	free(dc);
+	return NULL;
+}
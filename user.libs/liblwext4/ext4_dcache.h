@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2021 Min Le (lemin9538@163.com)
+ */
+
+#ifndef __EXT4_DCACHE_H__
+#define __EXT4_DCACHE_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <ext4.h>
+
+#define DCACHE_NAME_LEN		48	/* longer names are not cached */
+
+/*
+ * one path component, keyed by (parent inode, name). the entry
+ * with ino 0 is a negative entry, the name does not exist.
+ */
+struct dcache_entry {
+	uint32_t parent;
+	uint32_t ino;
+	uint8_t type;		/* EXT4_DE_XXX */
+	uint8_t len;
+	uint8_t valid;
+	uint8_t accessed;
+	char name[DCACHE_NAME_LEN];
+	struct dcache_entry *next;	/* hash chain */
+};
+
+struct attr_entry {
+	uint32_t ino;
+	uint8_t valid;
+	uint8_t accessed;
+	struct stat st;
+	struct attr_entry *next;	/* hash chain */
+};
+
+/*
+ * the dentry and inode attribute cache of the ext4 server, both
+ * are fixed size tables replaced by CLOCK. the lock is not held
+ * during the disk IO.
+ */
+struct ext4_dcache {
+	pthread_mutex_t lock;
+	const char *mount_point;
+	struct ext4_sblock *sb;
+	uint32_t gen;		/* bumped by each invalidate */
+
+	uint32_t nr_dentry;
+	uint32_t dhand;
+	uint32_t dhash_mask;
+	struct dcache_entry **dhash;
+	struct dcache_entry *dentry;
+
+	uint32_t nr_attr;
+	uint32_t ahand;
+	uint32_t ahash_mask;
+	struct attr_entry **ahash;
+	struct attr_entry *attr;
+
+	uint64_t hits;
+	uint64_t neg_hits;
+	uint64_t misses;
+};
+
+struct ext4_dcache *ext4_dcache_create(const char *mount_point,
+		uint32_t nr_dentry, uint32_t nr_attr);
+
+int ext4_dcache_lookup(struct ext4_dcache *dc, const char *path,
+		uint32_t *ino, uint8_t *type);
+
+void ext4_dcache_invalidate(struct ext4_dcache *dc, const char *path);
+
+int ext4_dcache_getattr(struct ext4_dcache *dc, uint32_t ino, struct stat *st);
+
+void ext4_dcache_attr_invalidate(struct ext4_dcache *dc, uint32_t ino);
+
+#endif
@@ -11,6 +11,28 @@
 
 #include <minos/debug.h>
 #include <minos/types.h>
+#include <minos/dma.h>
+
+/*
+ * the block cache buffers are the I/O buffers of the block
+ * device, allocate them from the DMA pool, so the driver can
+ * get the physical address without syscall.
+ */
+#define EXT4_BCACHE_DMA_BUFS	64
+
+static struct dma_pool *bcache_pool;
+static int bcache_pool_failed;
+static size_t bcache_pool_bufs = EXT4_BCACHE_DMA_BUFS;
+
+/*
+ * must be called before the first block cache buffer is
+ * allocated, which means before ext4_mount().
+ */
+void ext4_user_set_bcache_bufs(size_t nr)
+{
+	if (nr)
+		bcache_pool_bufs = nr;
+}
 
 void *ext4_user_malloc(size_t size)
 {
@@ -42,11 +64,30 @@ void *ext4_realloc(void *ptr, size_t size)
 
 void *ext4_user_alloc_bcache(size_t size)
 {
-	void *mem;
+	void *mem = NULL;
+
+	if (!bcache_pool && !bcache_pool_failed) {
+		bcache_pool = dma_pool_create(PAGE_BALIGN(size), bcache_pool_bufs);
+		if (!bcache_pool) {
+			pr_warn("ext4 bcache DMA pool create failed\n");
+			bcache_pool_failed = 1;
+		}
+	}
 
-	mem = memalign(PAGE_SIZE, PAGE_BALIGN(size));
+	if (bcache_pool && (size <= bcache_pool->obj_size))
+		mem = dma_pool_alloc(bcache_pool, NULL);
+	if (!mem)
+		mem = memalign(PAGE_SIZE, PAGE_BALIGN(size));
 	if (mem)
 		memset(mem, 0, sizeof(unsigned long));
 
 	return mem;
 }
+
+void ext4_user_free_bcache(void *mem)
+{
+	if (bcache_pool && dma_pool_contains(bcache_pool, mem))
+		dma_pool_free(bcache_pool, mem);
+	else
+		free(mem);
+}
@@ -0,0 +1,640 @@
+/*
+ * Copyright (c) 2021 Min Le (lemin9538@163.com)
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <pthread.h>
+
+#include <minos/kobject.h>
+#include <minos/debug.h>
+#include <minos/types.h>
+
+#include "ext4_pcache.h"
+
+#define PCACHE_MIN_SIZE		(1UL << 20)
+
+static inline uint32_t pcache_hash(struct ext4_pcache *pc,
+		uint32_t ino, uint32_t index)
+{
+	uint64_t key = ((uint64_t)ino << 32) | index;
+
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & pc->hash_mask;
+}
+
+static struct pcache_page *pcache_lookup(struct ext4_pcache *pc,
+		uint32_t ino, uint32_t index)
+{
+	struct pcache_page *page = pc->hash[pcache_hash(pc, ino, index)];
+
+	for (; page; page = page->next) {
+		if ((page->ino == ino) && (page->index == index))
+			return page;
+	}
+
+	return NULL;
+}
+
+static void pcache_drop(struct ext4_pcache *pc, struct pcache_page *page)
+{
+	struct pcache_page **pp;
+
+	if (!page->valid)
+		return;
+
+	pp = &pc->hash[pcache_hash(pc, page->ino, page->index)];
+	for (; *pp; pp = &(*pp)->next) {
+		if (*pp == page) {
+			*pp = page->next;
+			break;
+		}
+	}
+
+	if (page->dirty) {
+		page->dirty = 0;
+		pc->nr_dirty--;
+	}
+
+	page->next = NULL;
+	page->valid = 0;
+}
+
+/*
+ * CLOCK replacement, give the accessed page a second chance,
+ * the pinned page is still used or mapped and the dirty page
+ * is waiting for the write back, skip them.
+ */
+static struct pcache_page *pcache_victim(struct ext4_pcache *pc)
+{
+	struct pcache_page *page;
+	uint32_t i;
+
+	for (i = 0; i < 2 * pc->nr_pages; i++) {
+		page = &pc->pages[pc->hand];
+		pc->hand = (pc->hand + 1) % pc->nr_pages;
+
+		if (page->pinned || page->dirty)
+			continue;
+
+		if (page->valid && page->accessed) {
+			page->accessed = 0;
+			continue;
+		}
+
+		pcache_drop(pc, page);
+		return page;
+	}
+
+	return NULL;
+}
+
+static void pcache_insert(struct ext4_pcache *pc, struct pcache_page *page,
+		uint32_t ino, uint32_t index, uint32_t len)
+{
+	uint32_t hash = pcache_hash(pc, ino, index);
+
+	page->ino = ino;
+	page->index = index;
+	page->len = len;
+	page->valid = 1;
+	page->next = pc->hash[hash];
+	pc->hash[hash] = page;
+}
+
+/*
+ * get the page of the file at index and pin it, read it from the
+ * disk if fill is set. called with the lock held, the lock is
+ * released during the disk read, the victim page is pinned so no
+ * one else can take it meanwhile.
+ */
+static int pcache_get(struct ext4_pcache *pc, ext4_file *file,
+		uint32_t index, int fill, struct pcache_page **ppage)
+{
+	uint64_t pos = file->fpos, fsize = file->fsize;
+	struct pcache_page *page, *cached;
+	size_t rcnt = 0;
+	char *data;
+	int ret = 0;
+
+	page = pcache_lookup(pc, file->inode, index);
+	if (page) {
+		pc->hits++;
+		goto out;
+	}
+
+	pc->misses++;
+	page = pcache_victim(pc);
+	if (!page)
+		return -EAGAIN;
+
+	data = pc->base + pcache_page_offset(pc, page);
+
+	/*
+	 * the read syncs the file size with the inode, keep the
+	 * logical size of the file which has dirty pages.
+	 */
+	if (fill) {
+		page->pinned++;
+		pthread_mutex_unlock(&pc->lock);
+
+		ret = ext4_fseek(file, (int64_t)index << PAGE_SHIFT, SEEK_SET);
+		if (ret == 0)
+			ret = ext4_fread(file, data, PAGE_SIZE, &rcnt);
+		file->fpos = pos;
+		file->fsize = MAX(file->fsize, fsize);
+
+		pthread_mutex_lock(&pc->lock);
+		page->pinned--;
+		if (ret)
+			return -EIO;
+
+		/* another file of the inode has read it meanwhile */
+		cached = pcache_lookup(pc, file->inode, index);
+		if (cached) {
+			page = cached;
+			goto out;
+		}
+	}
+
+	memset(data + rcnt, 0, PAGE_SIZE - rcnt);
+	pcache_insert(pc, page, file->inode, index, rcnt);
+out:
+	page->accessed = 1;
+	page->pinned++;
+	*ppage = page;
+
+	return 0;
+}
+
+/*
+ * read at most len bytes from the current position of the file
+ * without crossing a page, the data is in the returned page which
+ * is pinned until ext4_pcache_unpin() is called. return 0 at the
+ * end of the file, and -EAGAIN if all the pages are pinned.
+ */
+long ext4_pcache_read(struct ext4_pcache *pc, ext4_file *file,
+		size_t len, struct pcache_page **ppage)
+{
+	uint64_t pos = file->fpos;
+	uint32_t index = pos >> PAGE_SHIFT;
+	uint32_t off = pos & (PAGE_SIZE - 1);
+	struct pcache_page *page;
+	long ret;
+
+	if (pos >= file->fsize)
+		return 0;
+
+	pthread_mutex_lock(&pc->lock);
+
+	ret = pcache_get(pc, file, index, 1, &page);
+	if (ret)
+		goto out;
+
+	if (off >= page->len) {
+		page->pinned--;
+		goto out;
+	}
+
+	ret = MIN(len, page->len - off);
+	file->fpos = pos + ret;
+	*ppage = page;
+out:
+	pthread_mutex_unlock(&pc->lock);
+
+	return ret;
+}
+
+/*
+ * copy the cached data from the current position of the file,
+ * stop at the first page which is not in the cache.
+ */
+size_t ext4_pcache_copy(struct ext4_pcache *pc, ext4_file *file,
+		char *buf, size_t len)
+{
+	struct pcache_page *page;
+	size_t total = 0, copy;
+	uint32_t off;
+
+	pthread_mutex_lock(&pc->lock);
+
+	while ((total < len) && (file->fpos < file->fsize)) {
+		page = pcache_lookup(pc, file->inode, file->fpos >> PAGE_SHIFT);
+		if (!page)
+			break;
+
+		off = file->fpos & (PAGE_SIZE - 1);
+		if (off >= page->len)
+			break;
+
+		copy = MIN(len - total, page->len - off);
+		memcpy(buf + total, pc->base + pcache_page_offset(pc, page) + off, copy);
+		page->accessed = 1;
+		pc->hits++;
+
+		file->fpos += copy;
+		total += copy;
+	}
+
+	pthread_mutex_unlock(&pc->lock);
+
+	return total;
+}
+
+/*
+ * write at most len bytes to the current position of the file
+ * without crossing a page, the data stays in the cache until
+ * ext4_pcache_flush() is called. the size of the file is updated
+ * to the logical size, which may be larger than the inode size.
+ * return -EAGAIN if there is no clean page to use.
+ */
+long ext4_pcache_write(struct ext4_pcache *pc, ext4_file *file,
+		const char *buf, size_t len)
+{
+	uint64_t pos = file->fpos;
+	uint32_t index = pos >> PAGE_SHIFT;
+	uint32_t off = pos & (PAGE_SIZE - 1);
+	struct pcache_page *page;
+	int fill, ret;
+
+	len = MIN(len, PAGE_SIZE - off);
+
+	/*
+	 * partial write to a page which has data on the disk, read
+	 * it first.
+	 */
+	fill = ((off != 0) || (len < PAGE_SIZE)) &&
+		(((uint64_t)index << PAGE_SHIFT) < file->fsize);
+
+	pthread_mutex_lock(&pc->lock);
+
+	ret = pcache_get(pc, file, index, fill, &page);
+	if (ret) {
+		pthread_mutex_unlock(&pc->lock);
+		return ret;
+	}
+
+	memcpy(pc->base + pcache_page_offset(pc, page) + off, buf, len);
+	pc->seq[file->inode % PCACHE_SEQ_SLOTS]++;
+	page->len = MAX(page->len, off + len);
+	page->pinned--;
+	if (!page->dirty) {
+		page->dirty = 1;
+		pc->nr_dirty++;
+	}
+
+	pthread_mutex_unlock(&pc->lock);
+
+	file->fpos = pos + len;
+	if (file->fpos > file->fsize)
+		file->fsize = file->fpos;
+
+	return len;
+}
+
+static int pcache_index_cmp(const void *a, const void *b)
+{
+	const struct pcache_page *pa = *(struct pcache_page * const *)a;
+	const struct pcache_page *pb = *(struct pcache_page * const *)b;
+
+	return (pa->index > pb->index) - (pa->index < pb->index);
+}
+
+static inline int pcache_page_dirty(struct pcache_page *page, uint32_t ino)
+{
+	return page->valid && page->dirty && (page->ino == ino);
+}
+
+/*
+ * check whether the inode has dirty pages, they may be written
+ * through any of the opened files of the inode.
+ */
+int ext4_pcache_dirty(struct ext4_pcache *pc, uint32_t ino)
+{
+	uint32_t i, nr = 0;
+	int dirty = 0;
+
+	pthread_mutex_lock(&pc->lock);
+
+	for (i = 0; (i < pc->nr_pages) && (nr < pc->nr_dirty); i++) {
+		if (!pc->pages[i].dirty)
+			continue;
+
+		nr++;
+		if (pcache_page_dirty(&pc->pages[i], ino)) {
+			dirty = 1;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pc->lock);
+
+	return dirty;
+}
+
+/*
+ * write the dirty pages of the inode back in index order, also
+ * the ones written through the other files of the inode, so the
+ * file grows without holes, the contiguous pages are merged into
+ * one write through buf of PCACHE_BUF_SIZE. the pages are clean
+ * and pinned during the write, a page written again meanwhile is
+ * dirty again. the position of the file is not changed.
+ */
+int ext4_pcache_flush(struct ext4_pcache *pc, ext4_file *file, char *buf)
+{
+	uint64_t pos = file->fpos, fsize = file->fsize;
+	struct pcache_page **dirty, *page;
+	uint32_t i, j, cnt, nr = 0;
+	size_t len, wcnt;
+	int ret = 0;
+
+	pthread_mutex_lock(&pc->lock);
+
+	if (pc->nr_dirty == 0)
+		goto out;
+
+	dirty = malloc(pc->nr_dirty * sizeof(struct pcache_page *));
+	if (!dirty) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; (i < pc->nr_pages) && (nr < pc->nr_dirty); i++) {
+		page = &pc->pages[i];
+		if (pcache_page_dirty(page, file->inode))
+			dirty[nr++] = page;
+	}
+
+	qsort(dirty, nr, sizeof(struct pcache_page *), pcache_index_cmp);
+
+	for (i = 0; i < nr; i += cnt) {
+		len = 0;
+		for (cnt = 0; (i + cnt < nr) && (cnt < PCACHE_RA_MAX); cnt++) {
+			page = dirty[i + cnt];
+			if ((page->index != dirty[i]->index + cnt) ||
+					!pcache_page_dirty(page, file->inode))
+				break;
+
+			memcpy(buf + len, pc->base + pcache_page_offset(pc, page), page->len);
+			len += page->len;
+			page->dirty = 0;
+			page->pinned++;
+			pc->nr_dirty--;
+			if (page->len < PAGE_SIZE) {
+				cnt++;
+				break;
+			}
+		}
+
+		/* the page has been dropped or written back by others */
+		if (cnt == 0) {
+			cnt = 1;
+			continue;
+		}
+
+		pthread_mutex_unlock(&pc->lock);
+		ret = ext4_fseek(file, (int64_t)dirty[i]->index << PAGE_SHIFT, SEEK_SET);
+		if (ret == 0)
+			ret = ext4_fwrite(file, buf, len, &wcnt);
+		pthread_mutex_lock(&pc->lock);
+
+		for (j = 0; j < cnt; j++) {
+			page = dirty[i + j];
+			page->pinned--;
+			if (ret && page->valid && !page->dirty) {
+				page->dirty = 1;
+				pc->nr_dirty++;
+			}
+		}
+
+		if (ret) {
+			ret = -EIO;
+			break;
+		}
+	}
+
+	free(dirty);
+out:
+	pthread_mutex_unlock(&pc->lock);
+
+	file->fsize = MAX(file->fsize, fsize);
+	file->fpos = pos;
+
+	return ret;
+}
+
+void ext4_pcache_unpin(struct ext4_pcache *pc, struct pcache_page *page)
+{
+	if (!page)
+		return;
+
+	pthread_mutex_lock(&pc->lock);
+	if (page->pinned)
+		page->pinned--;
+	pthread_mutex_unlock(&pc->lock);
+}
+
+/*
+ * drop all the cached pages of the inode, a pinned page is
+ * dropped from the hash table too, but its data keeps valid
+ * until it is unpinned.
+ */
+void ext4_pcache_invalidate(struct ext4_pcache *pc, uint32_t ino)
+{
+	struct pcache_page *page;
+	uint32_t i;
+
+	pthread_mutex_lock(&pc->lock);
+
+	pc->seq[ino % PCACHE_SEQ_SLOTS]++;
+	for (i = 0; i < pc->nr_pages; i++) {
+		page = &pc->pages[i];
+		if (page->valid && (page->ino == ino))
+			pcache_drop(pc, page);
+	}
+
+	pthread_mutex_unlock(&pc->lock);
+}
+
+/*
+ * called for each read of the file with the first and the last
+ * page it touched, return 1 if a new readahead window is set up
+ * and need to be read.
+ */
+int ext4_pcache_ra_update(struct pcache_ra *ra, uint32_t first, uint32_t last)
+{
+	int seq = (first == ra->last) || (first == ra->last + 1);
+
+	ra->last = last;
+
+	/*
+	 * random read, stop the readahead, the reading from the
+	 * start of the file is treated as a sequential read.
+	 */
+	if (!seq && (first != 0)) {
+		ra->size = 0;
+		ra->pending = 0;
+		return 0;
+	}
+
+	if ((ra->size == 0) || (last >= ra->start + ra->size)) {
+		/* no window yet or the reader passed it */
+		ra->start = last + 1;
+		ra->size = ra->size ? MIN(ra->size * 2, PCACHE_RA_MAX) : PCACHE_RA_INIT;
+	} else if (last >= ra->start) {
+		ra->start += ra->size;
+		ra->size = MIN(ra->size * 2, PCACHE_RA_MAX);
+	} else {
+		return 0;
+	}
+
+	ra->pending = ra->size;
+
+	return 1;
+}
+
+static uint32_t pcache_skip_cached(struct ext4_pcache *pc, uint32_t ino,
+		uint32_t start, uint32_t *nr, uint32_t *seq)
+{
+	pthread_mutex_lock(&pc->lock);
+	*seq = pc->seq[ino % PCACHE_SEQ_SLOTS];
+	while (*nr && pcache_lookup(pc, ino, start)) {
+		start++;
+		(*nr)--;
+	}
+	pthread_mutex_unlock(&pc->lock);
+
+	return start;
+}
+
+/*
+ * read the pending window of the file into the page cache with
+ * one large read through buf of PCACHE_BUF_SIZE, the position of
+ * the file is not changed. the file may be a copy which is read
+ * while the file itself handles other requests, the data is
+ * dropped if the inode has been written or invalidated during
+ * the read, it may be older than the page cache.
+ */
+int ext4_pcache_readahead(struct ext4_pcache *pc, ext4_file *file,
+		struct pcache_ra *ra, char *buf)
+{
+	uint32_t end = (file->fsize + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	uint32_t start = ra->start + ra->size - ra->pending;
+	uint32_t nr = ra->pending;
+	struct pcache_page *page;
+	uint64_t pos = file->fpos;
+	uint32_t i, len, seq;
+	size_t rcnt;
+	int ret;
+
+	ra->pending = 0;
+
+	if (start >= end)
+		return 0;
+
+	nr = MIN(nr, end - start);
+	start = pcache_skip_cached(pc, file->inode, start, &nr, &seq);
+	if (nr == 0)
+		return 0;
+
+	ret = ext4_fseek(file, (int64_t)start << PAGE_SHIFT, SEEK_SET);
+	if (ret == 0)
+		ret = ext4_fread(file, buf, nr << PAGE_SHIFT, &rcnt);
+	ext4_fseek(file, pos, SEEK_SET);
+	if (ret)
+		return -EIO;
+
+	pthread_mutex_lock(&pc->lock);
+
+	if (seq != pc->seq[file->inode % PCACHE_SEQ_SLOTS])
+		rcnt = 0;
+
+	for (i = 0; (i < nr) && (rcnt > 0); i++, start++) {
+		len = MIN(rcnt, PAGE_SIZE);
+		rcnt -= len;
+
+		if (pcache_lookup(pc, file->inode, start))
+			continue;
+
+		page = pcache_victim(pc);
+		if (!page)
+			break;
+
+		memcpy(pc->base + pcache_page_offset(pc, page),
+				buf + ((size_t)i << PAGE_SHIFT), len);
+		pcache_insert(pc, page, file->inode, start, len);
+		page->accessed = 0;
+		pc->ra_pages++;
+	}
+
+	pthread_mutex_unlock(&pc->lock);
+
+	return 0;
+}
+
+struct ext4_pcache *ext4_pcache_create(size_t size)
+{
+	struct ext4_pcache *pc;
+	uint32_t buckets = 16;
+	void *addr;
+
+	pc = zalloc(sizeof(struct ext4_pcache));
+	if (!pc)
+		return NULL;
+
+	/*
+	 * the page cache needs physically consequent memory, try a
+	 * smaller one if the memory is fragmented.
+	 */
+	size = PAGE_BALIGN(size);
+	for (; size >= PCACHE_MIN_SIZE; size >>= 1) {
+		pc->handle = kobject_create_consequent_pma(size, KR_RW);
+		if (pc->handle > 0)
+			break;
+	}
+
+	if (pc->handle <= 0) {
+		pr_err("create page cache PMA failed\n");
+		goto err_free_pc;
+	}
+
+	if (kobject_mmap(pc->handle, &addr, NULL)) {
+		pr_err("map page cache PMA failed\n");
+		goto err_close_pma;
+	}
+
+	pc->base = addr;
+	pc->size = size;
+	pc->nr_pages = size >> PAGE_SHIFT;
+
+	while (buckets < pc->nr_pages)
+		buckets <<= 1;
+	pc->hash_mask = buckets - 1;
+
+	pc->hash = zalloc(buckets * sizeof(struct pcache_page *));
+	pc->pages = zalloc(pc->nr_pages * sizeof(struct pcache_page));
+	if (!pc->hash || !pc->pages)
+		goto err_free_mem;
+
+	pthread_mutex_init(&pc->lock, NULL);
+
+	pr_info("ext4 page cache %zuKB at 0x%lx\n", size >> 10,
+			(unsigned long)pc->base);
+
+	return pc;
+
+err_free_mem:
+	free(pc->hash);
+	free(pc->pages);
+	kobject_munmap(pc->handle);
+err_close_pma:
+	kobject_close(pc->handle);
+err_free_pc:
+	free(pc);
+
+	return NULL;
+}
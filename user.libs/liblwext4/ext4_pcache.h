@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2021 Min Le (lemin9538@163.com)
+ */
+
+#ifndef __EXT4_PCACHE_H__
+#define __EXT4_PCACHE_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <minos/types.h>
+
+#include <ext4.h>
+
+struct pcache_page {
+	uint32_t ino;
+	uint32_t index;		/* page index in the file */
+	uint32_t len;		/* valid bytes of this page */
+	uint8_t valid;
+	uint8_t accessed;
+	uint8_t dirty;		/* written, not on the disk yet */
+	uint32_t pinned;	/* used by the clients and the mappings */
+	struct pcache_page *next;	/* hash chain */
+};
+
+#define PCACHE_RA_INIT		4	/* pages of the first window */
+#define PCACHE_RA_MAX		32	/* max pages of one window */
+
+/* the bounce buffer size of the readahead and the write back */
+#define PCACHE_BUF_SIZE		(PCACHE_RA_MAX << PAGE_SHIFT)
+
+/* slots of the write sequences, indexed by inode number */
+#define PCACHE_SEQ_SLOTS	64
+
+/*
+ * per file readahead state, the window ramps up from RA_INIT to
+ * RA_MAX while the file is read sequentially, the next window is
+ * read when the reader reaches the first page of the current one.
+ */
+struct pcache_ra {
+	uint32_t last;		/* page index of the last read */
+	uint32_t start;		/* current window */
+	uint32_t size;
+	uint32_t pending;	/* pages of the window not read yet */
+};
+
+/*
+ * the file page cache of the ext4 server, keyed by (inode, page
+ * index). the pages live in one physically consequent PMA, so
+ * pangu can map single pages of it to the processes which mmap
+ * the file. the lock is not held during the disk IO, the caller
+ * serializes the IO of the same file, the readahead reads through
+ * a copy of the file.
+ */
+struct ext4_pcache {
+	pthread_mutex_t lock;
+	int handle;
+	char *base;
+	size_t size;
+	uint32_t nr_pages;
+	uint32_t hand;
+	uint32_t hash_mask;
+	uint32_t nr_dirty;
+	uint32_t seq[PCACHE_SEQ_SLOTS];	/* bumped by the writes and the invalidation */
+	struct pcache_page **hash;
+	struct pcache_page *pages;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t ra_pages;
+};
+
+static inline unsigned long pcache_page_offset(struct ext4_pcache *pc,
+		struct pcache_page *page)
+{
+	return (unsigned long)(page - pc->pages) << PAGE_SHIFT;
+}
+
+struct ext4_pcache *ext4_pcache_create(size_t size);
+
+long ext4_pcache_read(struct ext4_pcache *pc, ext4_file *file,
+		size_t len, struct pcache_page **page);
+
+size_t ext4_pcache_copy(struct ext4_pcache *pc, ext4_file *file,
+		char *buf, size_t len);
+
+long ext4_pcache_write(struct ext4_pcache *pc, ext4_file *file,
+		const char *buf, size_t len);
+
+int ext4_pcache_dirty(struct ext4_pcache *pc, uint32_t ino);
+
+int ext4_pcache_flush(struct ext4_pcache *pc, ext4_file *file, char *buf);
+
+void ext4_pcache_unpin(struct ext4_pcache *pc, struct pcache_page *page);
+
+void ext4_pcache_invalidate(struct ext4_pcache *pc, uint32_t ino);
+
+int ext4_pcache_ra_update(struct pcache_ra *ra, uint32_t first, uint32_t last);
+
+int ext4_pcache_readahead(struct ext4_pcache *pc, ext4_file *file,
+		struct pcache_ra *ra, char *buf);
+
+#endif
@@ -8,9 +8,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <dirent.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/epoll.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 
 #include <minos/kobject.h>
 #include <minos/debug.h>
@@ -21,28 +26,241 @@
 #include <ext4.h>
 #include <ext4_mbr.h>
 
+#include "ext4_pcache.h"
+#include "ext4_dcache.h"
+
 #define EXT4_MAX_PARTITION 4
 #define VFS_MAX_EVENTS 16
 
+/*
+ * the DMA pool for the block cache needs physically consequent
+ * memory, cap it, the rest of the cache falls back to memalign.
+ */
+#define EXT4_BCACHE_DMA_MAX	(8UL << 20)
+
+#define EXT4_PCACHE_SIZE	(8UL << 20)
+
+/*
+ * entries of the dentry cache and the inode attribute cache.
+ */
+#define EXT4_DCACHE_DENTRIES	1024
+#define EXT4_DCACHE_ATTRS	512
+
+/*
+ * the shared window of a regular file, one read request moves at
+ * most this size of data, the client gets the size by mmap.
+ */
+#define EXT4_FILE_WINDOW	(128UL << 10)
+
+/*
+ * the shared window of a directory, getdents fills as many entries
+ * as it can hold in one request.
+ */
+#define EXT4_DIR_WINDOW		(16UL << 10)
+
+/*
+ * the cookie of the end of a directory, the end offset of lwext4 is
+ * -1 which is not a valid d_off.
+ */
+#define EXT4_DIR_END		INT64_MAX
+
+/*
+ * the flusher writes the dirty pages back and commits the batched
+ * journal transaction in this interval (ms).
+ */
+#define EXT4_FLUSH_INTERVAL	1000
+
+#define EXT4_OPEN_FLAGS		(O_ACCMODE | O_CREAT | O_TRUNC | O_APPEND)
+
+/*
+ * the name of the service in fuxi, the largest partition is at
+ * "/c", the others follow it at "/d", "/e" and "/f".
+ */
+#define EXT4_SERVICE		'c'
+#define EXT4_NAME_MAX		8
+
+/*
+ * the worker threads which handle the requests, the requests of
+ * one file are handled by one worker at a time.
+ */
+#define EXT4_NR_WORKERS		4
+
+/*
+ * the endpoints of the closed files are reset and kept for the
+ * next open, the pool is filled with some of them at start.
+ */
+#define EXT4_EP_POOL_MAX	64
+#define EXT4_EP_POOL_INIT	8
+
+/*
+ * the readahead windows waiting for the reader thread, a window
+ * is dropped when the queue is full, it is only a hint.
+ */
+#define EXT4_RA_QUEUE		16
+
+/*
+ * buckets of the fmap keys and mappings, and the initial pins of
+ * one mapping.
+ */
+#define EXT4_FMAP_HASH		64
+#define EXT4_FMAP_PINS		16
+
 struct lwext4_file {
 	int handle;
 	uint8_t root;
 	uint8_t dir;
+	uint8_t dirty;		/* has pages in the page cache to write back */
+	int flags;
 	char *sbuf;
 	size_t sbuf_size;
+	struct pcache_ra ra;
+	struct fmap_key *fkey;		/* key of the file mapping */
+	struct lwext4_file *dirty_next;
+	uint32_t flush_seq;
+	pthread_mutex_t lock;		/* held when handling the requests */
+	struct lwext4_file *run_next;
+	int queued;			/* in the run queue or being handled */
+	int nr_in;			/* pending requests */
+	int wclose;			/* the client has closed the file */
+	struct lwext4_file *pool_next;
 	char *buf[0];
 };
 
 /*
- * only support one partition now.
+ * a readahead window with a copy of the file, the reader thread
+ * reads it while the file handles the next requests.
+ */
+struct vfs_ra {
+	ext4_file file;
+	struct pcache_ra ra;
+};
+
+struct ext4_server;
+
+struct vfs_worker {
+	struct ext4_server *vs;
+	pthread_t thread;
+	char *buf;			/* readahead and write back buffer */
+	char path[PAGE_SIZE];
+};
+
+/*
+ * one server for each partition, with its own block device,
+ * caches and workers. the lock protects the run queue, the dirty
+ * list, the readahead queue and the sync state, it is never held
+ * during the disk IO.
  */
 struct ext4_server {
+	int id;
+	char name[EXT4_NAME_MAX];	/* service name in fuxi */
+	char device[EXT4_NAME_MAX];	/* block device name of lwext4 */
+	char mount[EXT4_NAME_MAX];	/* mount point of lwext4, "/<name>/" */
+	int mlen;			/* mount point without the last '/' */
 	int epfd;
 	struct lwext4_file root_file;
-	char buf[PAGE_SIZE];
 	struct ext4_blockdev bdev;
+	struct ext4_blockdev_iface bdif;
+	struct ext4_pcache *pcache;
+	struct ext4_dcache *dcache;
+	pthread_mutex_t lock;
+	pthread_cond_t run_cond;
+	struct lwext4_file *run_head;	/* files which have requests */
+	struct lwext4_file *run_tail;
+	struct lwext4_file *dirty_head;	/* files waiting for write back */
+	uint32_t flush_seq;
+	int sync_pending;		/* journal commit and cache flush */
+	uint32_t fmap_pinned;		/* pages pinned by the mappings */
+	pthread_cond_t ra_cond;
+	struct vfs_ra ra_queue[EXT4_RA_QUEUE];
+	uint32_t ra_head;
+	uint32_t ra_tail;
+	int ra_reader;			/* the reader thread is running */
+	struct lwext4_file *ep_pool[2];	/* free endpoints of file and dir */
+	int nr_pool[2];
+	pthread_t dispatcher;
+	struct vfs_worker flusher;
+	struct vfs_worker reader;
+	struct vfs_worker workers[EXT4_NR_WORKERS];
+};
+
+/*
+ * each mount point has its own lock, so the partitions are served
+ * in parallel. the lock callbacks of lwext4 have no argument, one
+ * pair of them for each partition.
+ */
+static pthread_mutex_t ext4_mp_mutex[EXT4_MAX_PARTITION] = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+};
+
+#define EXT4_MP_LOCK_OPS(n)					\
+static void ext4_mp_lock##n(void)				\
+{								\
+	pthread_mutex_lock(&ext4_mp_mutex[n]);			\
+}								\
+								\
+static void ext4_mp_unlock##n(void)				\
+{								\
+	pthread_mutex_unlock(&ext4_mp_mutex[n]);		\
+}
+
+EXT4_MP_LOCK_OPS(0)
+EXT4_MP_LOCK_OPS(1)
+EXT4_MP_LOCK_OPS(2)
+EXT4_MP_LOCK_OPS(3)
+
+static const struct ext4_lock ext4_mp_locks[EXT4_MAX_PARTITION] = {
+	{ .lock = ext4_mp_lock0, .unlock = ext4_mp_unlock0 },
+	{ .lock = ext4_mp_lock1, .unlock = ext4_mp_unlock1 },
+	{ .lock = ext4_mp_lock2, .unlock = ext4_mp_unlock2 },
+	{ .lock = ext4_mp_lock3, .unlock = ext4_mp_unlock3 },
+};
+
+/*
+ * the key of the file mapping, PROTO_FMAP on a file gives it to the
+ * client, which passes it to pangu. the key is only valid while it
+ * is in the table, the file holds its key until it is closed, and
+ * each mapping of pangu holds the key it is attached to.
+ */
+struct fmap_key {
+	uint64_t key;
+	struct ext4_server *vs;
+	uint32_t ino;
+	int refs;
+	struct fmap_key *next;
+};
+
+struct fmap_pin {
+	uint32_t index;
+	struct pcache_page *page;
+};
+
+/*
+ * a mapping of pangu, it pins at most one page of the page cache
+ * for each page of the file.
+ */
+struct fmap_map {
+	uint64_t id;
+	struct fmap_key *fkey;
+	uint32_t nr_pins;
+	uint32_t max_pins;
+	struct fmap_pin *pins;
+	struct fmap_map *next;
 };
 
+/*
+ * the keys are shared by all the partitions. the mappings are only
+ * used by the requests on the fmap endpoint, which are handled in
+ * order by the fmap thread.
+ */
+static pthread_mutex_t fmap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fmap_key *fmap_keys[EXT4_FMAP_HASH];
+static struct fmap_map *fmap_maps[EXT4_FMAP_HASH];
+static uint64_t fmap_secret[2];
+static uint32_t fmap_seq;
+static int fmap_endpoint = -1;
+static pthread_t fmap_thread;
+
 #define LWEXT4_FILE(lwf) (struct ext4_file *)((lwf)->buf)
 #define LWEXT4_DIR(lwf) (struct ext4_dir *)((lwf)->buf)
 
@@ -76,15 +294,18 @@ static int ext4_server_unlisten(struct ext4_server *vs, struct lwext4_file *file
 static struct lwext4_file *create_new_lwext4_file(int dir)
 {
 	struct lwext4_file *file;
+	size_t msize;
 	int handle;
 	void *addr;
 	int size;
 
-	handle = kobject_create_endpoint(PAGE_SIZE);
+	handle = kobject_create_endpoint(dir ? EXT4_DIR_WINDOW : EXT4_FILE_WINDOW);
+	if (handle <= 0)
+		handle = kobject_create_endpoint(PAGE_SIZE);
 	if (handle <= 0)
 		return NULL;
 
-	if (kobject_mmap(handle, &addr, NULL)) {
+	if (kobject_mmap(handle, &addr, &msize)) {
 		kobject_close(handle);
 		return NULL;
 	}
@@ -101,8 +322,9 @@ static struct lwext4_file *create_new_lwext4_file(int dir)
 
 	file->handle = handle;
 	file->sbuf = addr;
-	file->sbuf_size = PAGE_SIZE;
+	file->sbuf_size = msize;
 	file->dir = !!dir;
+	pthread_mutex_init(&file->lock, NULL);
 
 	return file;
 }
@@ -114,108 +336,103 @@ static void release_file(struct lwext4_file *file)
 
 	kobject_munmap(file->handle);
 	kobject_close(file->handle);
+	pthread_mutex_destroy(&file->lock);
 	free(file);
 }
 
-static int __handle_vfs_open_request(struct ext4_server *vs, struct lwext4_file *file,
-		struct proto *proto, struct lwext4_file **new)
+/*
+ * take an endpoint from the pool, the pooled one is still in the
+ * epoll set of the server. the endpoint is reset here but not when
+ * it is closed, the old client drops its reference just after the
+ * close event is sent. the kernel refuses to reset the endpoint if
+ * the old client or anyone it granted the endpoint to still holds
+ * it, release the endpoint in that case.
+ */
+static struct lwext4_file *get_lwext4_file(struct ext4_server *vs, int dir)
 {
-	int dir = !!(proto->open.flags & O_DIRECTORY);
-	struct lwext4_file *new_file;
-	int ret;
+	struct lwext4_file *file;
 
-	if (!file->dir)
-		return -ENOTDIR;
+	for (;;) {
+		pthread_mutex_lock(&vs->lock);
+		file = vs->ep_pool[dir];
+		if (file) {
+			vs->ep_pool[dir] = file->pool_next;
+			vs->nr_pool[dir]--;
+			file->pool_next = NULL;
+		}
+		pthread_mutex_unlock(&vs->lock);
 
-	new_file = create_new_lwext4_file(dir);
-	if (!new_file)
-		return -ENOMEM;
+		if (!file)
+			break;
 
-	/*
-	 * open the root directory
-	 */
-	if (vs->buf[0] == 0)
-		strcpy(vs->buf, "/");
+		if (kobject_reset_endpoint(file->handle) == 0)
+			return file;
 
-	if (dir)
-		ret = ext4_dir_open(LWEXT4_DIR(new_file), vs->buf);
-	else
-		ret = ext4_fopen(LWEXT4_FILE(new_file), vs->buf, "r");
-	if (ret) {
-		pr_err("open %s failed\n", vs->buf);
-		release_file(new_file);
-		return -ENOENT;
+		ext4_server_unlisten(vs, file);
+		release_file(file);
 	}
 
-	ret = ext4_server_listen(vs, new_file);
-	if (ret) {
-		pr_err("add new file failed %s\n", __func__);
-		release_file(new_file);
-		return ret;
-	}
+	file = create_new_lwext4_file(dir);
+	if (!file)
+		return NULL;
 
-	*new = new_file;
+	if (ext4_server_listen(vs, file)) {
+		release_file(file);
+		return NULL;
+	}
 
-	return 0;
+	return file;
 }
 
-static int handle_vfs_open_request(struct ext4_server *vs,
-			struct lwext4_file *parent, struct proto *proto)
+static void put_lwext4_file(struct ext4_server *vs, struct lwext4_file *file)
 {
-	struct lwext4_file *file;
-	int ret;
-
-	ret = __handle_vfs_open_request(vs, parent, proto, &file);
-	if (ret) {
-		kobject_reply_errcode(parent->handle, proto->token, ret);
-		return ret;
-	}
+	int dir = file->dir;
 
-	kobject_reply_handle(parent->handle, proto->token,
-			file->handle, KR_WM | KR_C);
+	file->flags = 0;
+	memset(&file->ra, 0, sizeof(struct pcache_ra));
 
-	return 0;
-}
+	pthread_mutex_lock(&vs->lock);
+	if (vs->nr_pool[dir] >= EXT4_EP_POOL_MAX) {
+		pthread_mutex_unlock(&vs->lock);
+		ext4_server_unlisten(vs, file);
+		release_file(file);
+		return;
+	}
 
-static int handle_vfs_write_request(struct ext4_server *vs,
-		struct lwext4_file *file, struct proto *proto)
-{
-	return 0;
+	file->queued = 0;
+	file->nr_in = 0;
+	file->wclose = 0;
+	file->run_next = NULL;
+	file->pool_next = vs->ep_pool[dir];
+	vs->ep_pool[dir] = file;
+	vs->nr_pool[dir]++;
+	pthread_mutex_unlock(&vs->lock);
 }
 
-static int handle_vfs_read_request(struct ext4_server *vs,
-		struct lwext4_file *file, struct proto *proto)
+static void fill_ep_pool(struct ext4_server *vs)
 {
-	size_t ret_size;
-	int ret;
-
-	if (proto->read.len > PAGE_SIZE) {
-		ret_size = -E2BIG;
-		goto out;
+	struct lwext4_file *file;
+	int i, dir;
+
+	for (dir = 0; dir < 2; dir++) {
+		for (i = 0; i < EXT4_EP_POOL_INIT; i++) {
+			file = create_new_lwext4_file(dir);
+			if (!file)
+				return;
+
+			ext4_server_listen(vs, file);
+			file->pool_next = vs->ep_pool[dir];
+			vs->ep_pool[dir] = file;
+			vs->nr_pool[dir]++;
+		}
 	}
-
-	ret = ext4_fread(LWEXT4_FILE(file), file->sbuf,
-			proto->read.len, &ret_size);
-	if (ret)
-		pr_err("read file failed\n");
-out:
-	kobject_reply_errcode(file->handle, proto->token, ret_size);
-	return 0;
 }
 
-static int handle_vfs_lseek_request(struct ext4_server *vs,
-		struct lwext4_file *file, struct proto *proto)
+static void vfs_set_sync(struct ext4_server *vs)
 {
-	int ret;
-
-	if (file->dir)
-		ret = ext4_dir_seek(LWEXT4_DIR(file), proto->lseek.off, proto->lseek.whence);
-	else
-		ret = ext4_fseek(LWEXT4_FILE(file), proto->lseek.off, proto->lseek.whence);
-
-	kobject_reply_errcode(file->handle, proto->token, ret);
-
-	return 0;
+	pthread_mutex_lock(&vs->lock);
+	vs->sync_pending = 1;
+	pthread_mutex_unlock(&vs->lock);
 }
 
 static char dt_types[EXT4_DE_MAX] = {
@@ -237,148 +454,1404 @@ static inline unsigned char ext4_file_type(int dtype)
 		return dt_types[dtype];
 }
 
-static int handle_vfs_getdent_request(struct ext4_server *vs,
-		struct lwext4_file *file, struct proto *proto)
+static inline off_t vfs_dir_cookie(uint64_t off)
+{
+	return (off == (uint64_t)-1) ? EXT4_DIR_END : (off_t)off;
+}
+
+/*
+ * fill the entries from the current position of the directory,
+ * the one which does not fit is left for the next request.
+ */
+static int vfs_fill_dirents(struct lwext4_file *file, char *buf, int size)
 {
+	struct ext4_dir *dir = LWEXT4_DIR(file);
 	const ext4_direntry *d;
 	struct dirent *de;
-	char *tmp = file->sbuf;
-	int idx = 0, len;
-	int size_left = PAGE_SIZE;
+	int len, used = 0;
+	uint64_t pos;
 
-	if (!file->dir) {
-		pr_err("file is not a directory\n");
-		kobject_reply_errcode(file->handle, proto->token, -ENOTDIR);
-		return -ENOTDIR;
-	}
+	for (;;) {
+		pos = dir->next_off;
+		d = ext4_dir_entry_next(dir);
+		if (!d)
+			break;
 
-	while ((d = ext4_dir_entry_next(LWEXT4_DIR(file))) != NULL) {
-		idx++;
-		len = DIRENT_SIZE(d->name_length + 1);
-		if (size_left < len)
+		len = BALIGN(DIRENT_SIZE(d->name_length + 1), sizeof(long));
+		if (used + len > size) {
+			dir->next_off = pos;
 			break;
+		}
 
-		de = (struct dirent *)tmp;
+		de = (struct dirent *)(buf + used);
 		de->d_ino = d->inode;
-		de->d_off = d->inode;
+		de->d_off = vfs_dir_cookie(dir->next_off);
 		de->d_reclen = len;
 		de->d_type = ext4_file_type(d->inode_type);
 		memcpy(de->d_name, d->name, d->name_length);
 		de->d_name[d->name_length] = 0;
 
-		tmp += len;
-		size_left -= len;
+		used += len;
 	}
 
-	kobject_reply_errcode(file->handle, proto->token, PAGE_SIZE - size_left);
-
-	return 0;
+	return used;
 }
 
-static int handle_vfs_close_request(struct ext4_server *vs, struct lwext4_file *file)
+static int __handle_vfs_open_request(struct ext4_server *vs, struct lwext4_file *file,
+		struct proto *proto, char *path, struct lwext4_file **new)
 {
-	ext4_server_unlisten(vs, file);
-	if (file->dir)
-		ext4_dir_close(LWEXT4_DIR(file));
+	int dir = !!(proto->open.flags & O_DIRECTORY);
+	int flags = proto->open.flags & EXT4_OPEN_FLAGS;
+	struct lwext4_file *new_file;
+	uint32_t ino = 0;
+	uint8_t type;
+	int ret;
+
+	if (!file->dir)
+		return -ENOTDIR;
+
+	/*
+	 * open the root directory
+	 */
+	if (path[vs->mlen] == 0)
+		strcpy(path, vs->mount);
+
+	/*
+	 * resolve the path with the dentry cache and open the inode
+	 * directly, only the file which may be created or truncated
+	 * goes through the path walk of lwext4.
+	 */
+	if (vs->dcache && !(flags & (O_CREAT | O_TRUNC))) {
+		ret = ext4_dcache_lookup(vs->dcache, path, &ino, &type);
+		if (ret)
+			return ret;
+
+		if (type == EXT4_DE_DIR) {
+			if (!dir && !(proto->open.flags & O_PATH))
+				return -EISDIR;
+			dir = 1;
+		} else if (dir) {
+			return -ENOTDIR;
+		}
+	} else if ((flags & O_CREAT) && (proto->open.flags & O_EXCL) &&
+			(ext4_inode_exist(path, EXT4_DE_UNKNOWN) == EOK)) {
+		return -EEXIST;
+	}
+
+	new_file = get_lwext4_file(vs, dir);
+	if (!new_file)
+		return -ENOMEM;
+
+	if (ino && dir)
+		ret = ext4_dir_open_ino(LWEXT4_DIR(new_file), vs->mount, ino);
+	else if (ino)
+		ret = ext4_fopen_ino(LWEXT4_FILE(new_file), vs->mount, ino, flags);
+	else if (dir)
+		ret = ext4_dir_open(LWEXT4_DIR(new_file), path);
 	else
-		ext4_fclose(LWEXT4_FILE(file));
+		ret = ext4_fopen2(LWEXT4_FILE(new_file), path, flags);
+	if (ret) {
+		pr_err("open %s failed %d\n", path, ret);
+		put_lwext4_file(vs, new_file);
+		return -ret;
+	}
 
-	release_file(file);
+	new_file->flags = flags;
+	if (!dir && (flags & (O_CREAT | O_TRUNC))) {
+		vfs_set_sync(vs);
+		if (vs->pcache && (flags & O_TRUNC))
+			ext4_pcache_invalidate(vs->pcache, (LWEXT4_FILE(new_file))->inode);
+		if (vs->dcache)
+			ext4_dcache_invalidate(vs->dcache, path);
+	}
 
-	return 0;
-}
+	*new = new_file;
 
-static int handle_vfs_access_request(struct ext4_server *vs,
-		struct lwext4_file *file, struct proto *proto)
-{
 	return 0;
 }
 
-static int handle_vfs_in_request(struct ext4_server *vs, struct lwext4_file *file)
+static int handle_vfs_open_request(struct ext4_server *vs,
+			struct lwext4_file *parent, struct proto *proto, char *path)
 {
-	struct proto proto;
+	struct lwext4_file *file;
 	int ret;
 
-	ret = sys_read_proto_with_string(file->handle, &proto, vs->buf, PAGE_SIZE, 0);
-	if (ret)
+	ret = __handle_vfs_open_request(vs, parent, proto, path, &file);
+	if (ret) {
+		kobject_reply_errcode(parent->handle, proto->token, ret);
 		return ret;
-
-	switch (proto.proto_id) {
-	case PROTO_OPEN:
-		ret = handle_vfs_open_request(vs, file, &proto);
-		break;
-	case PROTO_READ:
-		ret = handle_vfs_read_request(vs, file, &proto);
-		break;
-	case PROTO_WRITE:
-		ret = handle_vfs_write_request(vs, file, &proto);
-		break;
-	case PROTO_GETDENTS:
-		ret = handle_vfs_getdent_request(vs, file, &proto);
-		break;
-	case PROTO_LSEEK:
-		ret = handle_vfs_lseek_request(vs, file, &proto);
-		break;
-	case PROTO_ACCESS:
-		ret = handle_vfs_access_request(vs, file, &proto);
-		kobject_reply_errcode(file->handle, proto.token, ret);
-		break;
-	default:
-		ret = -ENOSYS;
-		pr_err("unsupport vfs proto %d\n", proto.proto_id);
-		kobject_reply_errcode(file->handle, proto.token, ret);
-		break;
 	}
 
-#if 0
-	if (ret)
-		dump_proto(&proto);
-#endif
+	/*
+	 * the client gets the first entries of the directory with
+	 * the open request.
+	 */
+	if (file->dir && (proto->open.flags & PROTO_OPEN_PREFETCH))
+		*(long *)file->sbuf = vfs_fill_dirents(file,
+				file->sbuf + sizeof(long),
+				file->sbuf_size - sizeof(long));
 
-	return ret;
+	kobject_reply_handle(parent->handle, proto->token,
+			file->handle, KR_WM | KR_C);
+
+	return 0;
 }
 
-static int handle_vfs_server_event(struct ext4_server *vs, struct epoll_event *event)
+/*
+ * the dirty state of the file is changed with the file lock
+ * held, the list is protected by the server lock.
+ */
+static void vfs_mark_dirty(struct ext4_server *vs, struct lwext4_file *file)
 {
-	struct lwext4_file *file = event->data.ptr;
-
-	if (!file)
-		return -ENOENT;
-
-	if ((event->events != EPOLLIN) && (event->events != EPOLLWCLOSE))
-		return -EPROTO;
+	if (file->dirty)
+		return;
 
-	if (event->events == EPOLLWCLOSE)
-		return handle_vfs_close_request(vs, file);
-	else
-		return handle_vfs_in_request(vs, file);
+	pthread_mutex_lock(&vs->lock);
+	file->dirty = 1;
+	file->dirty_next = vs->dirty_head;
+	vs->dirty_head = file;
+	pthread_mutex_unlock(&vs->lock);
 }
 
-static int run_ext4_server(struct ext4_server *vs)
+static void vfs_clear_dirty(struct ext4_server *vs, struct lwext4_file *file)
 {
-	struct epoll_event events[VFS_MAX_EVENTS];
-	struct lwext4_file *efile = &vs->root_file;
-	int epfd, rfd;
-	int cnt, i;
+	struct lwext4_file **pf;
 
-	/*
-	 * only support one partition now.
-	 */
-	rfd = register_service("/", "c", SRV_PORT, 0);
-	if (rfd <= 0) {
-		pr_err("create service for virtio-block ext4 server failed\n");
-		return -ENOMEM;
+	if (!file->dirty)
+		return;
+
+	pthread_mutex_lock(&vs->lock);
+	for (pf = &vs->dirty_head; *pf; pf = &(*pf)->dirty_next) {
+		if (*pf == file) {
+			*pf = file->dirty_next;
+			break;
+		}
 	}
 
-	epfd = epoll_create(0);
-	if (epfd <= 0) {
+	file->dirty = 0;
+	file->dirty_next = NULL;
+	pthread_mutex_unlock(&vs->lock);
+}
+
+/*
+ * called with the file lock held.
+ */
+static int vfs_flush_file(struct vfs_worker *w, struct lwext4_file *file)
+{
+	struct ext4_server *vs = w->vs;
+	int ret;
+
+	if (!file->dirty)
+		return 0;
+
+	ret = ext4_pcache_flush(vs->pcache, LWEXT4_FILE(file), w->buf);
+	if (ret) {
+		pr_err("write back file failed %d\n", ret);
+		return ret;
+	}
+
+	vfs_clear_dirty(vs, file);
+	vfs_set_sync(vs);
+	if (vs->dcache)
+		ext4_dcache_attr_invalidate(vs->dcache, (LWEXT4_FILE(file))->inode);
+
+	return 0;
+}
+
+/*
+ * the read path syncs the file size with the inode and reads the
+ * disk, write back the dirty pages of the inode first, including
+ * the ones written through the other opened files of the inode.
+ * the other files stay in the dirty list, the next flush of them
+ * finds nothing to write. called with the file lock held.
+ */
+static int vfs_flush_inode(struct vfs_worker *w, struct lwext4_file *file)
+{
+	struct ext4_server *vs = w->vs;
+	ext4_file *efile = LWEXT4_FILE(file);
+	int ret;
+
+	if (!vs->pcache || !ext4_pcache_dirty(vs->pcache, efile->inode))
+		return 0;
+
+	ret = ext4_pcache_flush(vs->pcache, efile, w->buf);
+	if (ret) {
+		pr_err("write back inode %d failed %d\n", efile->inode, ret);
+		return ret;
+	}
+
+	if (file->dirty)
+		vfs_clear_dirty(vs, file);
+	vfs_set_sync(vs);
+	if (vs->dcache)
+		ext4_dcache_attr_invalidate(vs->dcache, efile->inode);
+
+	return 0;
+}
+
+/*
+ * write back the dirty files which are not being handled by other
+ * workers, the busy ones are written back by the next round. the
+ * file can not be released while its lock is held.
+ */
+static void vfs_flush_files(struct vfs_worker *w)
+{
+	struct ext4_server *vs = w->vs;
+	struct lwext4_file *file;
+	uint32_t seq;
+
+	pthread_mutex_lock(&vs->lock);
+	seq = ++vs->flush_seq;
+	pthread_mutex_unlock(&vs->lock);
+
+	for (;;) {
+		pthread_mutex_lock(&vs->lock);
+		for (file = vs->dirty_head; file; file = file->dirty_next) {
+			if (file->flush_seq == seq)
+				continue;
+
+			file->flush_seq = seq;
+			if (pthread_mutex_trylock(&file->lock) == 0)
+				break;
+		}
+		pthread_mutex_unlock(&vs->lock);
+
+		if (!file)
+			break;
+
+		vfs_flush_file(w, file);
+		pthread_mutex_unlock(&file->lock);
+	}
+}
+
+/*
+ * write the dirty pages back, then commit the batched journal
+ * transaction and flush the block cache to the disk.
+ */
+static int vfs_writeback(struct vfs_worker *w)
+{
+	struct ext4_server *vs = w->vs;
+	int ret, sync;
+
+	vfs_flush_files(w);
+
+	pthread_mutex_lock(&vs->lock);
+	sync = vs->sync_pending;
+	vs->sync_pending = 0;
+	pthread_mutex_unlock(&vs->lock);
+
+	if (!sync)
+		return 0;
+
+	ret = ext4_journal_commit(vs->mount);
+	if (ret == EOK)
+		ret = ext4_cache_flush(vs->mount);
+	if (ret) {
+		vfs_set_sync(vs);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void *ext4_flusher(void *data)
+{
+	struct vfs_worker *w = data;
+	struct timespec ts = {
+		.tv_sec = EXT4_FLUSH_INTERVAL / 1000,
+		.tv_nsec = (EXT4_FLUSH_INTERVAL % 1000) * 1000000,
+	};
+
+	for (;;) {
+		nanosleep(&ts, NULL);
+		vfs_writeback(w);
+	}
+
+	return NULL;
+}
+
+/*
+ * the write is absorbed by the page cache, if there is no clean
+ * page, write all the dirty files back and try again, at last
+ * write to the file directly.
+ */
+static long vfs_write_pcache(struct vfs_worker *w, struct lwext4_file *file,
+		char *buf, size_t len)
+{
+	struct ext4_server *vs = w->vs;
+	ext4_file *efile = LWEXT4_FILE(file);
+	size_t total = 0, wcnt;
+	int flushed = 0;
+	long ret = 0;
+
+	while (total < len) {
+		ret = ext4_pcache_write(vs->pcache, efile, buf + total, len - total);
+		if (ret > 0) {
+			total += ret;
+			vfs_mark_dirty(vs, file);
+			continue;
+		}
+
+		if ((ret != -EAGAIN) || flushed)
+			break;
+
+		vfs_flush_file(w, file);
+		vfs_flush_files(w);
+		flushed = 1;
+	}
+
+	if ((total < len) && (ret == -EAGAIN) && (vfs_flush_file(w, file) == 0)) {
+		ret = ext4_fwrite(efile, buf + total, len - total, &wcnt);
+		ext4_pcache_invalidate(vs->pcache, efile->inode);
+		if (vs->dcache)
+			ext4_dcache_attr_invalidate(vs->dcache, efile->inode);
+		if (ret == EOK)
+			total += wcnt;
+	}
+
+	if (vs->pcache->nr_dirty > (vs->pcache->nr_pages >> 1)) {
+		vfs_flush_file(w, file);
+		vfs_flush_files(w);
+	}
+
+	return total ? total : -EIO;
+}
+
+static int handle_vfs_write_request(struct vfs_worker *w,
+		struct lwext4_file *file, struct proto *proto)
+{
+	ext4_file *efile = LWEXT4_FILE(file);
+	size_t len = proto->write.len;
+	size_t wcnt;
+	long ret;
+
+	if (file->dir) {
+		ret = -EISDIR;
+		goto out;
+	}
+
+	if ((file->flags & O_ACCMODE) == O_RDONLY) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if ((proto->write.offset < 0) ||
+			(proto->write.offset + len > file->sbuf_size)) {
+		ret = -E2BIG;
+		goto out;
+	}
+
+	if (len == 0) {
+		ret = 0;
+		goto out;
+	}
+
+	/*
+	 * the size of the file is the logical size which includes
+	 * the dirty pages.
+	 */
+	if (file->flags & O_APPEND)
+		efile->fpos = efile->fsize;
+
+	if (w->vs->pcache) {
+		ret = vfs_write_pcache(w, file, file->sbuf + proto->write.offset, len);
+	} else {
+		ret = ext4_fwrite(efile, file->sbuf + proto->write.offset, len, &wcnt);
+		ret = ret ? -EIO : wcnt;
+		if (w->vs->dcache)
+			ext4_dcache_attr_invalidate(w->vs->dcache, efile->inode);
+	}
+
+	vfs_set_sync(w->vs);
+out:
+	kobject_reply_errcode(file->handle, proto->token, ret);
+	return 0;
+}
+
+static int handle_vfs_fsync_request(struct vfs_worker *w,
+		struct lwext4_file *file, struct proto *proto)
+{
+	int ret = 0;
+
+	if (!file->dir)
+		ret = vfs_flush_file(w, file);
+	if (ret == 0)
+		ret = vfs_writeback(w);
+
+	kobject_reply_errcode(file->handle, proto->token, ret);
+
+	return 0;
+}
+
+static int handle_vfs_unlink_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto, char *path)
+{
+	struct ext4_inode inode;
+	uint32_t ino;
+	uint8_t type;
+	int ret;
+
+	if (!file->dir)
+		return -ENOTDIR;
+
+	if (vs->dcache) {
+		ret = ext4_dcache_lookup(vs->dcache, path, &ino, &type);
+		if (ret)
+			return ret;
+		if (type == EXT4_DE_DIR)
+			return -EISDIR;
+	} else {
+		if (ext4_raw_inode_fill(path, &ino, &inode))
+			return -ENOENT;
+		if (ext4_inode_exist(path, EXT4_DE_DIR) == EOK)
+			return -EISDIR;
+	}
+
+	/*
+	 * the opened files of this inode still see the cached pages,
+	 * but there is nothing to write back after the remove.
+	 */
+	if (vs->pcache)
+		ext4_pcache_invalidate(vs->pcache, ino);
+
+	ret = ext4_fremove(path);
+	if (vs->dcache)
+		ext4_dcache_invalidate(vs->dcache, path);
+	if (ret)
+		return -ret;
+
+	vfs_set_sync(vs);
+
+	return 0;
+}
+
+static long vfs_read_pcache(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	ext4_file *efile = LWEXT4_FILE(file);
+	uint32_t index = efile->fpos >> PAGE_SHIFT;
+	struct pcache_page *page;
+	unsigned long offset;
+	long ret;
+
+	/*
+	 * the size of the file may be behind the writes of the other
+	 * files of the inode, let ext4_fread() sync it at the end.
+	 */
+	ret = ext4_pcache_read(vs->pcache, efile, proto->read.len, &page);
+	if (ret == 0)
+		return -EAGAIN;
+	if (ret < 0)
+		return ret;
+
+	ext4_pcache_ra_update(&file->ra, index, index);
+
+	offset = pcache_page_offset(vs->pcache, page) +
+		((efile->fpos - ret) & (PAGE_SIZE - 1));
+	memcpy(file->sbuf, vs->pcache->base + offset, ret);
+	ext4_pcache_unpin(vs->pcache, page);
+
+	return ret;
+}
+
+/*
+ * large read, copy the cached pages to the shared window, then
+ * read the rest of the extent from the disk with one request.
+ * the dirty pages of the inode have been written back, the disk
+ * is up to date for the pages which are not cached, and the
+ * ext4_fread() syncs the size of the file with the inode.
+ */
+static long vfs_read_extent(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	ext4_file *efile = LWEXT4_FILE(file);
+	uint32_t first = efile->fpos >> PAGE_SHIFT;
+	size_t len = proto->read.len;
+	size_t total, rcnt = 0;
+	int ret;
+
+	total = ext4_pcache_copy(vs->pcache, efile, file->sbuf, len);
+	if (total < len) {
+		ret = ext4_fread(efile, file->sbuf + total, len - total, &rcnt);
+		if (ret && (total == 0))
+			return -EIO;
+		total += ret ? 0 : rcnt;
+	}
+
+	if (total)
+		ext4_pcache_ra_update(&file->ra, first, (efile->fpos - 1) >> PAGE_SHIFT);
+
+	return total;
+}
+
+static int handle_vfs_read_request(struct vfs_worker *w,
+		struct lwext4_file *file, struct proto *proto)
+{
+	struct ext4_server *vs = w->vs;
+	size_t ret_size;
+	long cnt;
+	int ret;
+
+	if (proto->read.len > file->sbuf_size) {
+		ret_size = -E2BIG;
+		goto out;
+	}
+
+	if (!file->dir && vfs_flush_inode(w, file)) {
+		ret_size = -EIO;
+		goto out;
+	}
+
+	if (vs->pcache && !file->dir) {
+		if (proto->read.len <= PAGE_SIZE)
+			cnt = vfs_read_pcache(vs, file, proto);
+		else
+			cnt = vfs_read_extent(vs, file, proto);
+		if (cnt != -EAGAIN) {
+			ret_size = cnt;
+			goto out;
+		}
+	}
+
+	ret = ext4_fread(LWEXT4_FILE(file), file->sbuf,
+			proto->read.len, &ret_size);
+	if (ret)
+		pr_err("read file failed\n");
+out:
+	kobject_reply_errcode(file->handle, proto->token, ret_size);
+	return 0;
+}
+
+static int handle_vfs_lseek_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	long ret;
+
+	if (file->dir) {
+		ret = ext4_dir_seek(LWEXT4_DIR(file), proto->lseek.off, proto->lseek.whence);
+	} else {
+		ret = ext4_fseek(LWEXT4_FILE(file), proto->lseek.off, proto->lseek.whence);
+		ret = ret ? -ret : (long)ext4_ftell(LWEXT4_FILE(file));
+	}
+
+	kobject_reply_errcode(file->handle, proto->token, ret);
+
+	return 0;
+}
+
+static int handle_vfs_getdent_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	struct ext4_dir *dir = LWEXT4_DIR(file);
+	int ret;
+
+	if (!file->dir) {
+		pr_err("file is not a directory\n");
+		kobject_reply_errcode(file->handle, proto->token, -ENOTDIR);
+		return -ENOTDIR;
+	}
+
+	/*
+	 * resume from the cookie, the client may have sought or not
+	 * consumed all the entries of the last request.
+	 */
+	if (proto->getdents.off != vfs_dir_cookie(dir->next_off)) {
+		ret = ext4_dir_seek(dir, proto->getdents.off, SEEK_SET);
+		if (ret) {
+			kobject_reply_errcode(file->handle, proto->token, -ret);
+			return -ret;
+		}
+	}
+
+	ret = vfs_fill_dirents(file, file->sbuf, file->sbuf_size);
+	kobject_reply_errcode(file->handle, proto->token, ret);
+
+	return 0;
+}
+
+#define ROTL64(x, b)	(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3)				\
+	do {							\
+		v0 += v1; v1 = ROTL64(v1, 13);			\
+		v1 ^= v0; v0 = ROTL64(v0, 32);			\
+		v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;	\
+		v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;	\
+		v2 += v1; v1 = ROTL64(v1, 17);			\
+		v1 ^= v2; v2 = ROTL64(v2, 32);			\
+	} while (0)
+
+/*
+ * SipHash-2-4 of one word with the secret, the other keys can not
+ * be worked out from the keys a client has got.
+ */
+static uint64_t fmap_siphash(uint64_t m)
+{
+	uint64_t v0 = fmap_secret[0] ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = fmap_secret[1] ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = fmap_secret[0] ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = fmap_secret[1] ^ 0x7465646279746573ULL;
+	uint64_t b = 8ULL << 56;
+
+	v3 ^= m;
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	v0 ^= m;
+
+	v3 ^= b;
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/*
+ * there is no entropy source in the system, seed the secret with
+ * the time and the addresses, and mix the time of each new key in.
+ */
+static void fmap_seed(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	fmap_secret[0] = ((uint64_t)ts.tv_sec << 32) ^ ts.tv_nsec ^
+		(unsigned long)&ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	fmap_secret[1] = ((uint64_t)ts.tv_nsec << 32) ^ ts.tv_sec ^
+		(unsigned long)fmap_keys;
+}
+
+static struct fmap_key *fmap_key_lookup(uint64_t key)
+{
+	struct fmap_key *fkey = fmap_keys[key % EXT4_FMAP_HASH];
+
+	for (; fkey; fkey = fkey->next) {
+		if (fkey->key == key)
+			return fkey;
+	}
+
+	return NULL;
+}
+
+static struct fmap_key *fmap_key_create(struct ext4_server *vs, uint32_t ino)
+{
+	struct fmap_key *fkey, **head;
+	struct timespec ts;
+
+	fkey = zalloc(sizeof(struct fmap_key));
+	if (!fkey)
+		return NULL;
+
+	fkey->vs = vs;
+	fkey->ino = ino;
+	fkey->refs = 1;
+
+	pthread_mutex_lock(&fmap_lock);
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		fmap_secret[1] += ts.tv_nsec;
+		fkey->key = fmap_siphash(((uint64_t)ino << 32) | fmap_seq++);
+	} while ((fkey->key == 0) || fmap_key_lookup(fkey->key));
+
+	head = &fmap_keys[fkey->key % EXT4_FMAP_HASH];
+	fkey->next = *head;
+	*head = fkey;
+
+	pthread_mutex_unlock(&fmap_lock);
+
+	return fkey;
+}
+
+static void fmap_key_put(struct fmap_key *fkey)
+{
+	struct fmap_key **pp;
+	int free_key = 0;
+
+	if (!fkey)
+		return;
+
+	pthread_mutex_lock(&fmap_lock);
+	if (--fkey->refs == 0) {
+		pp = &fmap_keys[fkey->key % EXT4_FMAP_HASH];
+		for (; *pp; pp = &(*pp)->next) {
+			if (*pp == fkey) {
+				*pp = fkey->next;
+				break;
+			}
+		}
+		free_key = 1;
+	}
+	pthread_mutex_unlock(&fmap_lock);
+
+	if (free_key)
+		free(fkey);
+}
+
+/*
+ * called with the file lock held, the file goes back to the pool
+ * after it is removed from the dirty list, so the flusher can not
+ * find it any more.
+ */
+static int handle_vfs_close_request(struct vfs_worker *w, struct lwext4_file *file)
+{
+	struct ext4_server *vs = w->vs;
+
+	/*
+	 * no one can write back the pages of the file after close,
+	 * drop them if the write back failed.
+	 */
+	if (file->dirty && vfs_flush_file(w, file)) {
+		ext4_pcache_invalidate(vs->pcache, (LWEXT4_FILE(file))->inode);
+		vfs_clear_dirty(vs, file);
+	}
+
+	if (file->dir)
+		ext4_dir_close(LWEXT4_DIR(file));
+	else
+		ext4_fclose(LWEXT4_FILE(file));
+
+	fmap_key_put(file->fkey);
+	file->fkey = NULL;
+
+	pthread_mutex_unlock(&file->lock);
+	put_lwext4_file(vs, file);
+
+	return 0;
+}
+
+/*
+ * file backed mmap, the pages of the file in the page cache are
+ * mapped to the clients read only, so the clean pages are shared
+ * by all the mappings of the file.
+ */
+static int handle_vfs_fmap_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	struct fmap_info *info = (struct fmap_info *)file->sbuf;
+	ext4_file *efile = LWEXT4_FILE(file);
+	int ret = 0;
+
+	if (!vs->pcache || !file->sbuf || file->dir || (fmap_endpoint <= 0))
+		ret = -ENODEV;
+	else if (proto->fmap.prot & (PROT_WRITE | PROT_EXEC))
+		ret = -EACCES;
+	else if ((file->flags & O_ACCMODE) == O_WRONLY)
+		ret = -EACCES;
+
+	/* one key for each opened file, dropped when it is closed */
+	if ((ret == 0) && !file->fkey) {
+		file->fkey = fmap_key_create(vs, efile->inode);
+		if (!file->fkey)
+			ret = -ENOMEM;
+	}
+
+	if (ret == 0) {
+		memset(info, 0, sizeof(struct fmap_info));
+		info->key = file->fkey->key;
+		info->ino = efile->inode;
+		info->size = efile->fsize;
+	}
+
+	kobject_reply_errcode(file->handle, proto->token, ret);
+
+	return 0;
+}
+
+static struct fmap_map *fmap_map_lookup(uint64_t id)
+{
+	struct fmap_map *map = fmap_maps[id % EXT4_FMAP_HASH];
+
+	for (; map; map = map->next) {
+		if (map->id == id)
+			return map;
+	}
+
+	return NULL;
+}
+
+static struct fmap_pin *fmap_map_find_pin(struct fmap_map *map, uint32_t index)
+{
+	uint32_t i;
+
+	for (i = 0; i < map->nr_pins; i++) {
+		if (map->pins[i].index == index)
+			return &map->pins[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * attach the mapping of pangu to the key which the client got, the
+ * mapping holds the key, so it is still valid after the client
+ * closed the file.
+ */
+static int fmap_map_attach(struct proto_fmap *fmap, struct fmap_map **pmap)
+{
+	struct fmap_map *map, **head;
+	struct fmap_key *fkey;
+
+	if (fmap_map_lookup(fmap->map))
+		return -EEXIST;
+
+	map = zalloc(sizeof(struct fmap_map));
+	if (!map)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&fmap_lock);
+	fkey = fmap_key_lookup(fmap->key);
+	if (fkey)
+		fkey->refs++;
+	pthread_mutex_unlock(&fmap_lock);
+
+	if (!fkey) {
+		free(map);
+		return -EACCES;
+	}
+
+	map->id = fmap->map;
+	map->fkey = fkey;
+	head = &fmap_maps[map->id % EXT4_FMAP_HASH];
+	map->next = *head;
+	*head = map;
+	*pmap = map;
+
+	return 0;
+}
+
+static void fmap_map_detach(struct fmap_map *map)
+{
+	struct ext4_server *vs = map->fkey->vs;
+	struct fmap_map **pp;
+	uint32_t i;
+
+	pp = &fmap_maps[map->id % EXT4_FMAP_HASH];
+	for (; *pp; pp = &(*pp)->next) {
+		if (*pp == map) {
+			*pp = map->next;
+			break;
+		}
+	}
+
+	for (i = 0; i < map->nr_pins; i++)
+		ext4_pcache_unpin(vs->pcache, map->pins[i].page);
+	vs->fmap_pinned -= map->nr_pins;
+
+	fmap_key_put(map->fkey);
+	free(map->pins);
+	free(map);
+}
+
+/*
+ * pin the page at index of the file for the mapping, reply its
+ * offset in the page cache PMA. the page is pinned once for each
+ * mapping, however many times pangu asks for it.
+ */
+static long fmap_map_get_page(struct fmap_map *map, uint32_t index)
+{
+	struct ext4_server *vs = map->fkey->vs;
+	struct pcache_page *page;
+	struct fmap_pin *pin;
+	ext4_file efile;
+	uint32_t max;
+	long ret;
+
+	pin = fmap_map_find_pin(map, index);
+	if (pin)
+		return pcache_page_offset(vs->pcache, pin->page);
+
+	/*
+	 * the pages pinned by the mappings can not be reclaimed, keep
+	 * half of the page cache for the readers.
+	 */
+	if (vs->fmap_pinned >= vs->pcache->nr_pages / 2)
+		return -ENOMEM;
+
+	if (map->nr_pins == map->max_pins) {
+		max = map->max_pins ? map->max_pins * 2 : EXT4_FMAP_PINS;
+		pin = realloc(map->pins, max * sizeof(struct fmap_pin));
+		if (!pin)
+			return -ENOMEM;
+
+		map->pins = pin;
+		map->max_pins = max;
+	}
+
+	ret = ext4_fopen_ino(&efile, vs->mount, map->fkey->ino, O_RDONLY);
+	if (ret)
+		return -ret;
+
+	efile.fpos = (uint64_t)index << PAGE_SHIFT;
+	ret = ext4_pcache_read(vs->pcache, &efile, PAGE_SIZE, &page);
+	ext4_fclose(&efile);
+	if (ret <= 0)
+		return ret ? ret : -ENXIO;
+
+	pin = &map->pins[map->nr_pins++];
+	pin->index = index;
+	pin->page = page;
+	vs->fmap_pinned++;
+
+	return pcache_page_offset(vs->pcache, page);
+}
+
+static int fmap_map_put_page(struct fmap_map *map, uint32_t index)
+{
+	struct ext4_server *vs = map->fkey->vs;
+	struct fmap_pin *pin;
+
+	pin = fmap_map_find_pin(map, index);
+	if (!pin)
+		return -ENOENT;
+
+	ext4_pcache_unpin(vs->pcache, pin->page);
+	vs->fmap_pinned--;
+	*pin = map->pins[--map->nr_pins];
+
+	return 0;
+}
+
+/*
+ * the requests of pangu on the fmap endpoint, no one else can
+ * write to it. the mapping must be attached to the key which the
+ * client got from PROTO_FMAP on its file.
+ */
+static int handle_fmap_request(int handle, struct proto *proto)
+{
+	struct proto_fmap *fmap = &proto->fmap;
+	struct fmap_map *map;
+	long ret;
+
+	if (proto->proto_id == PROTO_FMAP) {
+		ret = fmap_map_attach(fmap, &map);
+		if (ret == 0)
+			return kobject_reply_handle(handle, proto->token,
+					map->fkey->vs->pcache->handle, KR_RM);
+		goto out;
+	}
+
+	map = fmap_map_lookup(fmap->map);
+	if (!map || (map->fkey->key != fmap->key)) {
+		ret = -EACCES;
+		goto out;
+	}
+
+	switch (proto->proto_id) {
+	case PROTO_FPAGE:
+		ret = fmap_map_get_page(map, fmap->index);
+		break;
+	case PROTO_FPUT:
+		if (fmap->index == FMAP_DETACH) {
+			fmap_map_detach(map);
+			ret = 0;
+		} else {
+			ret = fmap_map_put_page(map, fmap->index);
+		}
+		break;
+	default:
+		ret = -ENOSYS;
+		break;
+	}
+out:
+	kobject_reply_errcode(handle, proto->token, ret);
+	return 0;
+}
+
+/*
+ * pangu asks for the pages of the mapped files of all the
+ * partitions on the fmap endpoint, and waits for the reply in its
+ * page fault path. the endpoint has its own thread, so a fault
+ * does not wait behind the requests of the files in the workers.
+ */
+static void *fmap_server(void *data)
+{
+	struct proto proto;
+	int ret;
+
+	for (;;) {
+		ret = sys_read_proto(fmap_endpoint, &proto, NULL, 0, -1);
+		if (ret == -EINVAL)
+			continue;
+		if (ret) {
+			pr_err("read fmap request failed %d\n", ret);
+			break;
+		}
+
+		handle_fmap_request(fmap_endpoint, &proto);
+	}
+
+	return NULL;
+}
+
+/*
+ * the server runs as root, only check the path exists and the
+ * owner permission bits of the inode.
+ */
+static int handle_vfs_access_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto, char *path)
+{
+	int amode = proto->access.amode;
+	struct stat st;
+	uint32_t ino;
+	uint8_t type;
+	int ret;
+
+	if (!vs->dcache)
+		return 0;
+
+	ret = ext4_dcache_lookup(vs->dcache, path, &ino, &type);
+	if (ret || (amode == F_OK))
+		return ret;
+
+	ret = ext4_dcache_getattr(vs->dcache, ino, &st);
+	if (ret)
+		return ret;
+
+	if (((amode & R_OK) && !(st.st_mode & S_IRUSR)) ||
+			((amode & W_OK) && !(st.st_mode & S_IWUSR)) ||
+			((amode & X_OK) && !(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))))
+		return -EACCES;
+
+	return 0;
+}
+
+static int handle_vfs_stat_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	ext4_file *efile = LWEXT4_FILE(file);
+	struct stat *st = (struct stat *)file->sbuf;
+	int ret;
+
+	if (!file->sbuf || !vs->dcache) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	ret = ext4_dcache_getattr(vs->dcache, efile->inode, st);
+	if (ret)
+		goto out;
+
+	/*
+	 * the dirty pages are not on the disk yet, the size of the
+	 * file is its logical size.
+	 */
+	if (!file->dir)
+		st->st_size = MAX((uint64_t)st->st_size, efile->fsize);
+out:
+	kobject_reply_errcode(file->handle, proto->token, ret);
+	return 0;
+}
+
+static int handle_vfs_ioctl_request(struct ext4_server *vs,
+		struct lwext4_file *file, struct proto *proto)
+{
+	struct ext4_bcache_stats stats;
+	int ret;
+
+	if (!file->sbuf) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	switch (proto->ioctl.cmd) {
+	case EXT4_IOC_BCACHE_STATS:
+		ret = ext4_mount_point_bcache_stats(vs->mount, &stats);
+		if (ret) {
+			ret = -ret;
+			break;
+		}
+		memcpy(file->sbuf, &stats, sizeof(stats));
+		ret = 0;
+		break;
+	default:
+		ret = -ENOTTY;
+		break;
+	}
+out:
+	kobject_reply_errcode(file->handle, proto->token, ret);
+	return 0;
+}
+
+static int handle_vfs_in_request(struct vfs_worker *w, struct lwext4_file *file)
+{
+	struct ext4_server *vs = w->vs;
+	struct proto proto;
+	int ret;
+
+	/*
+	 * the path of the request is relative to the service, put
+	 * the mount point of the partition before it for lwext4.
+	 */
+	memcpy(w->path, vs->mount, vs->mlen);
+	ret = sys_read_proto_with_string(file->handle, &proto,
+			w->path + vs->mlen, PAGE_SIZE - vs->mlen, 0);
+	if (ret)
+		return ret;
+
+	switch (proto.proto_id) {
+	case PROTO_OPEN:
+		ret = handle_vfs_open_request(vs, file, &proto, w->path);
+		break;
+	case PROTO_READ:
+		ret = handle_vfs_read_request(w, file, &proto);
+		break;
+	case PROTO_WRITE:
+		ret = handle_vfs_write_request(w, file, &proto);
+		break;
+	case PROTO_GETDENTS:
+		ret = handle_vfs_getdent_request(vs, file, &proto);
+		break;
+	case PROTO_LSEEK:
+		ret = handle_vfs_lseek_request(vs, file, &proto);
+		break;
+	case PROTO_IOCTL:
+		ret = handle_vfs_ioctl_request(vs, file, &proto);
+		break;
+	case PROTO_ACCESS:
+		ret = handle_vfs_access_request(vs, file, &proto, w->path);
+		kobject_reply_errcode(file->handle, proto.token, ret);
+		break;
+	case PROTO_STAT:
+		ret = handle_vfs_stat_request(vs, file, &proto);
+		break;
+	case PROTO_FMAP:
+		ret = handle_vfs_fmap_request(vs, file, &proto);
+		break;
+	case PROTO_FPAGE:
+	case PROTO_FPUT:
+		/* only pangu asks for the pages, on the fmap endpoint */
+		ret = -EPERM;
+		kobject_reply_errcode(file->handle, proto.token, ret);
+		break;
+	case PROTO_FSYNC:
+		ret = handle_vfs_fsync_request(w, file, &proto);
+		break;
+	case PROTO_UNLINK:
+		ret = handle_vfs_unlink_request(vs, file, &proto, w->path);
+		kobject_reply_errcode(file->handle, proto.token, ret);
+		break;
+	default:
+		ret = -ENOSYS;
+		pr_err("unsupport vfs proto %d\n", proto.proto_id);
+		kobject_reply_errcode(file->handle, proto.token, ret);
+		break;
+	}
+
+#if 0
+	if (ret)
+		dump_proto(&proto);
+#endif
+
+	return ret;
+}
+
+/*
+ * queue the pending window of the file for the reader thread,
+ * called with the file lock held, the window is taken from the
+ * file even if it is dropped.
+ */
+static void vfs_queue_readahead(struct ext4_server *vs, struct lwext4_file *file)
+{
+	struct vfs_ra *ra;
+
+	pthread_mutex_lock(&vs->lock);
+	if (vs->ra_reader && (vs->ra_tail - vs->ra_head < EXT4_RA_QUEUE)) {
+		ra = &vs->ra_queue[vs->ra_tail % EXT4_RA_QUEUE];
+		ra->file = *LWEXT4_FILE(file);
+		ra->ra = file->ra;
+		vs->ra_tail++;
+		pthread_cond_signal(&vs->ra_cond);
+	}
+	pthread_mutex_unlock(&vs->lock);
+
+	file->ra.pending = 0;
+}
+
+/*
+ * read the queued readahead windows, the files are not locked,
+ * each window is read through its own copy of the file.
+ */
+static void *ext4_reader(void *data)
+{
+	struct vfs_worker *w = data;
+	struct ext4_server *vs = w->vs;
+	struct vfs_ra ra;
+
+	for (;;) {
+		pthread_mutex_lock(&vs->lock);
+		while (vs->ra_head == vs->ra_tail)
+			pthread_cond_wait(&vs->ra_cond, &vs->lock);
+
+		ra = vs->ra_queue[vs->ra_head % EXT4_RA_QUEUE];
+		vs->ra_head++;
+		pthread_mutex_unlock(&vs->lock);
+
+		ext4_pcache_readahead(vs->pcache, &ra.file, &ra.ra, w->buf);
+	}
+
+	return NULL;
+}
+
+/*
+ * handle the pending requests of the file one by one, the file
+ * leaves the run queue when there is no more request, so one
+ * file is handled by one worker at a time, in order.
+ */
+static void vfs_handle_file(struct vfs_worker *w, struct lwext4_file *file)
+{
+	struct ext4_server *vs = w->vs;
+	int close;
+
+	for (;;) {
+		pthread_mutex_lock(&vs->lock);
+		if (file->nr_in) {
+			file->nr_in--;
+			close = 0;
+		} else if (file->wclose) {
+			close = 1;
+		} else {
+			file->queued = 0;
+			pthread_mutex_unlock(&vs->lock);
+			return;
+		}
+		pthread_mutex_unlock(&vs->lock);
+
+		pthread_mutex_lock(&file->lock);
+		if (close) {
+			handle_vfs_close_request(w, file);
+			return;
+		}
+
+		handle_vfs_in_request(w, file);
+
+		/*
+		 * the reply has been sent, let the reader thread read
+		 * the next window before the client asks for it.
+		 */
+		if (vs->pcache && !file->dir && !file->dirty && file->ra.pending)
+			vfs_queue_readahead(vs, file);
+		pthread_mutex_unlock(&file->lock);
+	}
+}
+
+static void *vfs_worker_thread(void *data)
+{
+	struct vfs_worker *w = data;
+	struct ext4_server *vs = w->vs;
+	struct lwext4_file *file;
+
+	for (;;) {
+		pthread_mutex_lock(&vs->lock);
+		while (!vs->run_head)
+			pthread_cond_wait(&vs->run_cond, &vs->lock);
+
+		file = vs->run_head;
+		vs->run_head = file->run_next;
+		if (!vs->run_head)
+			vs->run_tail = NULL;
+		file->run_next = NULL;
+		pthread_mutex_unlock(&vs->lock);
+
+		vfs_handle_file(w, file);
+	}
+
+	return NULL;
+}
+
+static int vfs_dispatch_event(struct ext4_server *vs, struct epoll_event *event)
+{
+	struct lwext4_file *file = event->data.ptr;
+
+	if (!file)
+		return -ENOENT;
+
+	if ((event->events != EPOLLIN) && (event->events != EPOLLWCLOSE))
+		return -EPROTO;
+
+	pthread_mutex_lock(&vs->lock);
+	if (event->events == EPOLLWCLOSE)
+		file->wclose = 1;
+	else
+		file->nr_in++;
+
+	if (!file->queued) {
+		file->queued = 1;
+		if (vs->run_tail)
+			vs->run_tail->run_next = file;
+		else
+			vs->run_head = file;
+		vs->run_tail = file;
+		pthread_cond_signal(&vs->run_cond);
+	}
+	pthread_mutex_unlock(&vs->lock);
+
+	return 0;
+}
+
+static int vfs_worker_init(struct ext4_server *vs, struct vfs_worker *w,
+		void *(*fn)(void *))
+{
+	w->vs = vs;
+	w->buf = memalign(PAGE_SIZE, PCACHE_BUF_SIZE);
+	if (!w->buf)
+		return -ENOMEM;
+
+	if (pthread_create(&w->thread, NULL, fn, w)) {
+		free(w->buf);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * the dispatcher only dispatches the events of its partition to
+ * the workers.
+ */
+static void *vfs_dispatcher(void *data)
+{
+	struct epoll_event events[VFS_MAX_EVENTS];
+	struct ext4_server *vs = data;
+	int cnt, i;
+
+	for (; ;) {
+		cnt = epoll_wait(vs->epfd, events, VFS_MAX_EVENTS, -1);
+		for (i = 0; i < cnt; i++)
+			vfs_dispatch_event(vs, &events[i]);
+	}
+
+	return NULL;
+}
+
+static int ext4_server_start(struct ext4_server *vs)
+{
+	struct lwext4_file *efile = &vs->root_file;
+	int epfd, rfd;
+	int i, nr = 0;
+
+	rfd = register_service("/", vs->name, SRV_PORT, 0);
+	if (rfd <= 0) {
+		pr_err("create service for ext4 partition %s failed\n", vs->name);
+		return -ENOMEM;
+	}
+
+	epfd = epoll_create(0);
+	if (epfd <= 0) {
 		pr_err("create epoll handle for vfs server failed\n");
 		unregister_service(rfd);
 		return epfd;
 	}
 
 	vs->epfd = epfd;
-	pr_info("ext4 server epfd:%d root_fd:%d\n", epfd, rfd);
+	pr_info("ext4 server /%s epfd:%d root_fd:%d\n", vs->name, epfd, rfd);
 
 	/*
 	 * listen on the root file.
@@ -387,36 +1860,165 @@ static int run_ext4_server(struct ext4_server *vs)
 	efile->handle = rfd;
 	efile->root = 1;
 	efile->dir = 1;
+	pthread_mutex_init(&efile->lock, NULL);
 	ext4_server_listen(vs, efile);
+	fill_ep_pool(vs);
 
-	i_am_ok();
-	pr_info("ext4 server start, waitting for request...\n");
+	/*
+	 * the reader starts before the workers which queue the
+	 * readahead windows to it.
+	 */
+	if (vs->pcache) {
+		if (vfs_worker_init(vs, &vs->reader, ext4_reader) == 0)
+			vs->ra_reader = 1;
+		else
+			pr_warn("create ext4 reader failed, no readahead\n");
+	}
 
-	for (; ;) {
-		cnt = epoll_wait(vs->epfd, events, VFS_MAX_EVENTS, -1);
-		if (cnt <= 0)
-			continue;
+	for (i = 0; i < EXT4_NR_WORKERS; i++) {
+		if (vfs_worker_init(vs, &vs->workers[i], vfs_worker_thread) == 0)
+			nr++;
+	}
 
-		for (i = 0; i < cnt; i++)
-			handle_vfs_server_event(vs, &events[i]);
+	if (nr == 0) {
+		pr_err("create ext4 worker failed\n");
+		return -ENOMEM;
 	}
 
-	return -1;
+	if (vfs_worker_init(vs, &vs->flusher, ext4_flusher))
+		pr_warn("create ext4 flusher failed\n");
+
+	pr_info("ext4 server /%s start with %d workers\n", vs->name, nr);
+
+	return 0;
 }
 
-int run_ext4_file_server(struct ext4_blockdev *bdev)
+static int ext4_server_mount(struct ext4_server *vs,
+		struct ext4_blockdev *part, size_t bcache_size)
+{
+	int r;
+
+	/*
+	 * the partitions share the interface of the disk, each one
+	 * gets a copy of it, so the bounce buffer of lwext4 is only
+	 * used under the lock of its own mount point.
+	 */
+	memcpy(&vs->bdif, part->bdif, sizeof(struct ext4_blockdev_iface));
+	vs->bdif.ph_refctr = 0;
+	vs->bdif.bread_ctr = vs->bdif.bwrite_ctr = 0;
+	vs->bdif.ph_bbuf = memalign(PAGE_SIZE, PAGE_BALIGN(vs->bdif.ph_bsize));
+	if (!vs->bdif.ph_bbuf)
+		return -ENOMEM;
+
+	memcpy(&vs->bdev, part, sizeof(struct ext4_blockdev));
+	vs->bdev.bdif = &vs->bdif;
+
+	r = ext4_device_register(&vs->bdev, vs->device);
+	if (r) {
+		pr_err("register ext4 partition %s fail\n", vs->device);
+		goto err_free_bbuf;
+	}
+
+	/* lwext4 gets the block cache size when mounting */
+	ext4_set_bcache_size(bcache_size);
+
+	r = ext4_mount(vs->device, vs->mount, 0);
+	if (r) {
+		pr_warn("mount partition %s fail %d\n", vs->device, r);
+		goto err_unregister;
+	}
+
+	/*
+	 * the workers call lwext4 concurrently, lwext4 serializes
+	 * the operations of the mount point with this lock. the
+	 * file data blocks are read without it, so the readers of
+	 * different files do not wait for each other's disk IO.
+	 */
+	r = ext4_mount_setup_locks(vs->mount, &ext4_mp_locks[vs->id]);
+	if (r) {
+		pr_err("setup ext4 mount locks fail\n");
+		exit(r);
+	}
+
+	r = ext4_recover(vs->mount);
+	if (r && (r != ENOTSUP))
+		pr_warn("ext4 journal recover failed %d\n", r);
+
+	/*
+	 * keep the dirty blocks in the block cache and batch the
+	 * journal transactions, the flusher writes them back.
+	 */
+	r = ext4_journal_start(vs->mount);
+	if (r)
+		pr_warn("ext4 journal start failed %d\n", r);
+
+	ext4_cache_write_back(vs->mount, 1);
+	ext4_journal_batch(vs->mount, true);
+
+	vs->pcache = ext4_pcache_create(EXT4_PCACHE_SIZE);
+	if (!vs->pcache)
+		pr_warn("ext4 page cache of %s disabled\n", vs->device);
+
+	vs->dcache = ext4_dcache_create(vs->mount, EXT4_DCACHE_DENTRIES, EXT4_DCACHE_ATTRS);
+	if (!vs->dcache)
+		pr_warn("ext4 dentry cache of %s disabled\n", vs->device);
+
+	return 0;
+
+err_unregister:
+	ext4_device_unregister(vs->device);
+err_free_bbuf:
+	free(vs->bdif.ph_bbuf);
+	return -ENODEV;
+}
+
+static struct ext4_server *create_ext4_server(int id)
 {
-	struct ext4_mbr_bdevs bdevs;
-	int r, i, cnt = 0;
-	struct ext4_blockdev *ext4_blkdev = NULL;
 	struct ext4_server *vs;
 
-	vs = malloc(sizeof(struct ext4_server));
+	vs = zalloc(sizeof(struct ext4_server));
 	if (!vs)
-		return -ENOMEM;
+		return NULL;
+
+	vs->id = id;
+	snprintf(vs->name, EXT4_NAME_MAX, "%c", EXT4_SERVICE + id);
+	snprintf(vs->device, EXT4_NAME_MAX, "vd%d", id);
+	snprintf(vs->mount, EXT4_NAME_MAX, "/%s/", vs->name);
+	vs->mlen = strlen(vs->mount) - 1;
+
+	pthread_mutex_init(&vs->lock, NULL);
+	pthread_cond_init(&vs->run_cond, NULL);
+	pthread_cond_init(&vs->ra_cond, NULL);
+
+	return vs;
+}
+
+/*
+ * mount all the ext4 partitions of the disk, the largest one is
+ * mounted first and served at "/c". the block cache is shared
+ * by the partitions evenly.
+ */
+int run_ext4_file_server(struct ext4_blockdev *bdev, size_t bcache_size,
+		int fmap_handle)
+{
+	struct ext4_server *servers[EXT4_MAX_PARTITION];
+	struct ext4_blockdev *parts[EXT4_MAX_PARTITION];
+	struct ext4_mbr_bdevs bdevs;
+	struct ext4_blockdev *part;
+	struct ext4_server *vs;
+	int r, i, cnt = 0, nr = 0, started = 0;
 
 	ext4_dmask_set(DEBUG_ALL);
 
+	fmap_seed();
+	if (fmap_handle > 0) {
+		fmap_endpoint = fmap_handle;
+		if (pthread_create(&fmap_thread, NULL, fmap_server, NULL)) {
+			pr_err("create fmap thread failed, no file mapping\n");
+			fmap_endpoint = -1;
+		}
+	}
+
 	r = ext4_mbr_scan(bdev, &bdevs);
 	if (r) {
 		pr_err("ext4 mbr scan failed\n");
@@ -425,47 +2027,85 @@ int run_ext4_file_server(struct ext4_blockdev *bdev)
 
 	pr_info("ext4_mbr_scan:\n");
 
-	for (i = 0; i < 4; i++) {
+	for (i = 0; i < EXT4_MAX_PARTITION; i++) {
+		part = &bdevs.partitions[i];
 		pr_info("mbr_entry %d:\n", i);
-		if (!bdevs.partitions[i].bdif) {
+		if (!part->bdif) {
 			pr_info("\tempty/unknown\n");
 			continue;
 		}
-		
+
 		pr_info("\toffeset: 0x%"PRIx64", %"PRIu64"MB\n",
-				bdevs.partitions[i].part_offset,
-				bdevs.partitions[i].part_offset / (1024 * 1024));
+				part->part_offset,
+				part->part_offset / (1024 * 1024));
 		pr_info("\tsize:    0x%"PRIx64", %"PRIu64"MB\n",
-				bdevs.partitions[i].part_size,
-				bdevs.partitions[i].part_size / (1024 * 1024));
-
-		if (ext4_blkdev == NULL)
-			ext4_blkdev = &bdevs.partitions[i];
-		else if (bdevs.partitions[i].part_size > ext4_blkdev->part_size)
-			ext4_blkdev = &bdevs.partitions[i];
+				part->part_size,
+				part->part_size / (1024 * 1024));
+
+		/* keep the largest one at the head */
+		if (cnt && (part->part_size > parts[0]->part_size)) {
+			parts[cnt] = parts[0];
+			parts[0] = part;
+		} else {
+			parts[cnt] = part;
+		}
 		cnt++;
 	}
 
-	if (cnt == 0 || ext4_blkdev == NULL) {
+	if (cnt == 0) {
 		pr_err("no ext4 partition found\n");
 		return -ENODEV;
 	}
 
-	if (cnt > 1)
-		pr_warn("only one partition will support\n");
+	if (bcache_size) {
+		ext4_user_set_bcache_bufs(MIN(bcache_size, EXT4_BCACHE_DMA_MAX) / PAGE_SIZE);
+		bcache_size /= cnt;
+		pr_info("ext4 block cache size %zuKB each partition\n", bcache_size >> 10);
+	}
 
-	memcpy(&vs->bdev, ext4_blkdev, sizeof(struct ext4_blockdev));
-	r = ext4_device_register(&vs->bdev, "vd0");
-	if (r) {
-		pr_err("register ext4 partition fail\n");
-		exit(r);
+	for (i = 0; i < cnt; i++) {
+		vs = create_ext4_server(nr);
+		if (!vs)
+			break;
+
+		if (ext4_server_mount(vs, parts[i], bcache_size)) {
+			free(vs);
+			continue;
+		}
+
+		servers[nr++] = vs;
 	}
 
-	r = ext4_mount("vd0", "/", 0);
-	if (r) {
-		pr_err("mount ext4 partition fail\n");
-		exit(r);
+	if (nr == 0) {
+		pr_err("no ext4 partition mounted\n");
+		return -ENODEV;
+	}
+
+	/*
+	 * start all the partitions before telling the root service,
+	 * the first one is dispatched by the main thread.
+	 */
+	for (i = 0; i < nr; i++) {
+		vs = servers[i];
+		if (ext4_server_start(vs))
+			continue;
+
+		if (started++ == 0) {
+			servers[0] = vs;
+			continue;
+		}
+
+		if (pthread_create(&vs->dispatcher, NULL, vfs_dispatcher, vs))
+			pr_err("create dispatcher of /%s failed\n", vs->name);
 	}
 
-	return run_ext4_server(vs);
+	if (started == 0)
+		return -ENOMEM;
+
+	i_am_ok();
+	pr_info("ext4 server start with %d partitions, waitting for request...\n", started);
+
+	vfs_dispatcher(servers[0]);
+
+	return -1;
 }
@@ -67,6 +67,16 @@ struct ext4_lock {
 
 /********************************FILE DESCRIPTOR*****************************/
 
+/**@brief   Number of extents cached in a file descriptor.*/
+#define EXT4_FILE_EXTENTS 4
+
+/**@brief   Cached run of data blocks of a file.*/
+struct ext4_file_extent {
+    uint32_t lblk;
+    uint32_t len;
+    uint64_t pblk;
+};
+
 /**@brief   File descriptor. */
 typedef struct ext4_file {
 
@@ -84,6 +94,12 @@ typedef struct ext4_file {
 
     /**@brief   Actual file position.*/
     uint64_t fpos;
+
+    /**@brief   Recently used extents, valid while extent_gen matches
+     *          the mapping generation of the inode.*/
+    struct ext4_file_extent extents[EXT4_FILE_EXTENTS];
+    uint32_t extent_gen;
+    uint32_t extent_hand;
 } ext4_file;
 
 /*****************************DIRECTORY DESCRIPTOR***************************/
@@ -130,6 +146,12 @@ int ext4_device_unregister(const char *dev_name);
  * @return  Standard error code.*/
 int ext4_device_unregister_all(void);
 
+/**@brief   Set the block cache size of the following mounts.
+ *
+ * @param   size Cache size in bytes, the cache holds at least
+ *          CONFIG_BLOCK_DEV_CACHE_SIZE blocks.*/
+void ext4_set_bcache_size(size_t size);
+
 /**@brief   Mount a block device with EXT4 partition to the mount point.
  *
  * @param   dev_name Block device name (@ref ext4_device_register).
@@ -174,6 +196,24 @@ int ext4_journal_start(const char *mount_point);
  * @return  Standard error code. */
 int ext4_journal_stop(const char *mount_point);
 
+/**@brief   Batch the journal transactions. In batch mode the file
+ *          operations share one transaction, which is committed by
+ *          @ref ext4_journal_commit or when it is large enough.
+ *
+ * @param   mount_pount Mount point.
+ * @param   on Enable/disable batch mode, disable commits the pending
+ *          transaction.
+ *
+ * @return  Standard error code. */
+int ext4_journal_batch(const char *mount_point, bool on);
+
+/**@brief   Commit the pending journal transaction.
+ *
+ * @param   mount_pount Mount point.
+ *
+ * @return  Standard error code. */
+int ext4_journal_commit(const char *mount_point);
+
 /**@brief   Journal recovery.
  * @warning Must be called after @ref ext4_mount.
  *
@@ -206,6 +246,15 @@ struct ext4_mount_stats {
 int ext4_mount_point_stats(const char *mount_point,
                struct ext4_mount_stats *stats);
 
+/**@brief   Get block cache stats of a mount point.
+ *
+ * @param   mount_pount Mount point.
+ * @param   stats Block cache stats.
+ *
+ * @return Standard error code. */
+int ext4_mount_point_bcache_stats(const char *mount_point,
+                  struct ext4_bcache_stats *stats);
+
 /**@brief   Setup OS lock routines.
  *
  * @param   mount_pount Mount point.
@@ -322,6 +371,17 @@ int ext4_fopen(ext4_file *file, const char *path, const char *flags);
  * @return  Standard error code.*/
 int ext4_fopen2(ext4_file *file, const char *path, int flags);
 
+/**@brief   Open a regular file by its inode, without the path walk.
+ *
+ * @param   file  File handle.
+ * @param   mount_point Mount point of the inode.
+ * @param   ino   Inode number.
+ * @param   flags File open flags, O_CREAT and O_TRUNC are not allowed.
+ *
+ * @return  Standard error code, EISDIR if the inode is not a file.*/
+int ext4_fopen_ino(ext4_file *file, const char *mount_point,
+           uint32_t ino, int flags);
+
 /**@brief   File close function.
  *
  * @param   file File handle.
@@ -338,7 +398,8 @@ int ext4_fclose(ext4_file *file);
  * @return  Standard error code.*/
 int ext4_ftruncate(ext4_file *file, uint64_t size);
 
-/**@brief   Read data from file.
+/**@brief   Read data from file. The whole data blocks are read
+ *          without the mount point lock, after they are mapped.
  *
  * @param   file File handle.
  * @param   buf  Output buffer.
@@ -395,6 +456,30 @@ uint64_t ext4_fsize(ext4_file *file);
 int ext4_raw_inode_fill(const char *path, uint32_t *ret_ino,
             struct ext4_inode *inode);
 
+/**@brief Get inode internals by the inode number.
+ *
+ * @param mount_point Mount point of the inode.
+ * @param ino     Inode number.
+ * @param inode   Inode internals.
+ *
+ * @return  Standard error code.*/
+int ext4_inode_get(const char *mount_point, uint32_t ino,
+           struct ext4_inode *inode);
+
+/**@brief Look up one entry of a directory.
+ *
+ * @param mount_point Mount point of the directory.
+ * @param dir_ino Inode number of the directory.
+ * @param name    Entry name, not null terminated.
+ * @param len     Entry name length.
+ * @param ino     Inode number of the entry.
+ * @param type    Entry type (@ref EXT4_DE_DIR etc.).
+ *
+ * @return  Standard error code, ENOENT if there is no such entry.*/
+int ext4_dir_lookup(const char *mount_point, uint32_t dir_ino,
+            const char *name, uint32_t len,
+            uint32_t *ino, uint8_t *type);
+
 /**@brief Check if inode exists.
  *
  * @param path    Parh to file/dir/link.
@@ -597,6 +682,15 @@ int ext4_dir_mk(const char *path);
  * @return  Standard error code.*/
 int ext4_dir_open(ext4_dir *dir, const char *path);
 
+/**@brief   Directory open by its inode, without the path walk.
+ *
+ * @param   dir  Directory handle.
+ * @param   mount_point Mount point of the inode.
+ * @param   ino  Inode number.
+ *
+ * @return  Standard error code, ENOTDIR if the inode is not a directory.*/
+int ext4_dir_open_ino(ext4_dir *dir, const char *mount_point, uint32_t ino);
+
 /**@brief   Directory close.
  *
  * @param   dir directory handle.
@@ -616,6 +710,13 @@ const ext4_direntry *ext4_dir_entry_next(ext4_dir *dir);
  * @param   dir Directory handle.*/
 void ext4_dir_entry_rewind(ext4_dir *dir);
 
+/**@brief   Directory seek.
+ *
+ * @param   dir Directory handle.
+ * @param   offset Offset of an entry, 0 for the first entry.
+ * @param   origin SEEK_SET, SEEK_CUR or SEEK_END.
+ *
+ * @return  Standard error code.*/
 int ext4_dir_seek(ext4_dir *dir, int64_t offset, uint32_t origin);
 
 #ifdef __cplusplus
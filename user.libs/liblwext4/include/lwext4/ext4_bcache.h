@@ -47,6 +47,7 @@ extern "C" {
 #include <stdbool.h>
 #include <misc/tree.h>
 #include <misc/queue.h>
+#include <ext4_blkdev.h>
 
 #define EXT4_BLOCK_ZERO()   \
     {.lb_id = 0, .data = 0}
@@ -76,11 +77,8 @@ struct ext4_buf {
     /**@brief   Data buffer.*/
     uint8_t *data;
 
-    /**@brief   LRU priority. (unused) */
-    uint32_t lru_prio;
-
-    /**@brief   LRU id.*/
-    uint32_t lru_id;
+    /**@brief   CLOCK reference bit, set when the buffer is accessed.*/
+    bool accessed;
 
     /**@brief   Reference count table*/
     uint32_t refctr;
@@ -91,11 +89,11 @@ struct ext4_buf {
     /**@brief   Whether or not buffer is on dirty list.*/
     bool on_dirty_list;
 
-    /**@brief   LBA tree node*/
-    RB_ENTRY(ext4_buf) lba_node;
+    /**@brief   LBA hash chain node*/
+    LIST_ENTRY(ext4_buf) hash_node;
 
-    /**@brief   LRU tree node*/
-    RB_ENTRY(ext4_buf) lru_node;
+    /**@brief   CLOCK ring node*/
+    TAILQ_ENTRY(ext4_buf) clock_node;
 
     /**@brief   Dirty list node*/
     SLIST_ENTRY(ext4_buf) dirty_node;
@@ -123,26 +121,35 @@ struct ext4_bcache {
     /**@brief   Item size in block cache*/
     uint32_t itemsize;
 
-    /**@brief   Last recently used counter*/
-    uint32_t lru_ctr;
-
     /**@brief   Currently referenced datablocks*/
     uint32_t ref_blocks;
 
     /**@brief   Maximum referenced datablocks*/
     uint32_t max_ref_blocks;
 
+    /**@brief   Cached datablocks which are not referenced*/
+    uint32_t unref_blocks;
+
     /**@brief   The blockdev binded to this block cache*/
     struct ext4_blockdev *bdev;
 
     /**@brief   The cache should not be shaked */
     bool dont_shake;
 
-    /**@brief   A tree holding all bufs*/
-    RB_HEAD(ext4_buf_lba, ext4_buf) lba_root;
+    /**@brief   Hash buckets count - 1, the count is power of 2*/
+    uint32_t hash_mask;
+
+    /**@brief   Hash table holding all bufs, indexed by LBA*/
+    LIST_HEAD(ext4_buf_hash, ext4_buf) *hash;
+
+    /**@brief   CLOCK ring holding all bufs*/
+    TAILQ_HEAD(ext4_buf_clock, ext4_buf) clock_ring;
+
+    /**@brief   CLOCK hand, next eviction candidate*/
+    struct ext4_buf *clock_hand;
 
-    /**@brief   A tree holding unreferenced bufs*/
-    RB_HEAD(ext4_buf_lru, ext4_buf) lru_root;
+    /**@brief   Hit/miss/eviction counters*/
+    struct ext4_bcache_stats stats;
 
     /**@brief   A singly-linked list holding dirty buffers*/
     SLIST_HEAD(ext4_buf_dirty, ext4_buf) dirty_list;
@@ -229,10 +236,10 @@ void ext4_bcache_cleanup(struct ext4_bcache *bc);
  * @return  standard error code*/
 int ext4_bcache_fini_dynamic(struct ext4_bcache *bc);
 
-/**@brief   Get a buffer with the lowest LRU counter in bcache.
+/**@brief   Get an unreferenced buffer to evict by the CLOCK algorithm.
  * @param   bc block cache descriptor
- * @return  buffer with the lowest LRU counter*/
-struct ext4_buf *ext4_buf_lowest_lru(struct ext4_bcache *bc);
+ * @return  buffer to evict, NULL if all buffers are referenced*/
+struct ext4_buf *ext4_bcache_clock_victim(struct ext4_bcache *bc);
 
 /**@brief   Drop unreferenced buffer from bcache.
  * @param   bc block cache descriptor
@@ -255,8 +262,6 @@ void ext4_bcache_invalidate_lba(struct ext4_bcache *bc,
                 uint32_t cnt);
 
 /**@brief   Find existing buffer from block cache memory.
- *          Unreferenced block allocation is based on LRU
- *          (Last Recently Used) algorithm.
  * @param   bc block cache descriptor
  * @param   b block to alloc
  * @param   lba logical block address
@@ -266,8 +271,8 @@ ext4_bcache_find_get(struct ext4_bcache *bc, struct ext4_block *b,
              uint64_t lba);
 
 /**@brief   Allocate block from block cache memory.
- *          Unreferenced block allocation is based on LRU
- *          (Last Recently Used) algorithm.
+ *          Unreferenced blocks are evicted by the CLOCK
+ *          algorithm, see ext4_block_cache_shake().
  * @param   bc block cache descriptor
  * @param   b block to alloc
  * @param   is_new block is new (needs to be read)
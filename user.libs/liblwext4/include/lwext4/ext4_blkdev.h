@@ -42,6 +42,8 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
 
 struct ext4_blockdev;
 
@@ -65,6 +67,24 @@ struct ext4_blockdev_iface {
     int (*bwrite)(struct ext4_blockdev *bdev, const void *buf,
               uint64_t blk_id, uint32_t blk_cnt);
 
+    /**@brief   Asynchronous block read function. Not mandatory field.
+     * @param   bdev block device
+     * @param   buf output buffer, must be valid until done is called
+     * @param   blk_id block id
+     * @param   blk_cnt block count
+     * @param   done completion callback, called with the status
+     * @param   arg argument of the completion callback*/
+    int (*bread_async)(struct ext4_blockdev *bdev, void *buf,
+               uint64_t blk_id, uint32_t blk_cnt,
+               void (*done)(void *arg, int status), void *arg);
+
+    /**@brief   Wait the asynchronous requests of one caller finished,
+     *          mandatory if bread_async is provided.
+     * @param   bdev block device.
+     * @param   pending count of the requests in flight, decreased
+     *          by the completion callbacks, return when it is 0*/
+    int (*bwait)(struct ext4_blockdev *bdev, int *pending);
+
     /**@brief   Close device function.
      * @param   bdev block device.*/
     int (*close)(struct ext4_blockdev *bdev);
@@ -151,7 +171,28 @@ struct ext4_blockdev {
         .part_size =  (__bcnt) * (__bsize),                            \
     }
 
-int run_ext4_file_server(struct ext4_blockdev *bdev);
+/**@brief   Block cache statistics, returned by EXT4_IOC_BCACHE_STATS.*/
+struct ext4_bcache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint32_t cnt;
+    uint32_t blocks;
+    uint32_t max_blocks;
+    uint32_t itemsize;
+};
+
+#define EXT4_IOC_BCACHE_STATS _IOR('E', 1, struct ext4_bcache_stats)
+
+/**@brief   Run the ext4 file server on the block device, every ext4
+ *          partition is served by its own service, "/c", "/d" ...
+ * @param   bdev block device
+ * @param   bcache_size block cache size in bytes of all the partitions,
+ *          0 for default
+ * @param   fmap_handle endpoint which pangu asks for the pages of the
+ *          mapped files on, file backed mmap is disabled if <= 0*/
+int run_ext4_file_server(struct ext4_blockdev *bdev, size_t bcache_size,
+		int fmap_handle);
 
 #ifdef __cplusplus
 }
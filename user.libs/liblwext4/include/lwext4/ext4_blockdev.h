@@ -114,6 +114,29 @@ int ext4_block_set(struct ext4_blockdev *bdev, struct ext4_block *b);
 int ext4_blocks_get_direct(struct ext4_blockdev *bdev, void *buf, uint64_t lba,
                uint32_t cnt);
 
+/**@brief   A group of asynchronous block reads of one caller.*/
+struct ext4_blocks_io {
+    int pending;
+    int status;
+};
+
+/**@brief   Asynchronous block read procedure (without cache), falls
+ *          back to the synchronous read if the device does not support it.
+ * @param   bdev block device descriptor
+ * @param   buf output buffer
+ * @param   lba logical block address
+ * @param   bio the group of the read, zeroed before the first read
+ * @return  standard error code*/
+int ext4_blocks_get_direct_async(struct ext4_blockdev *bdev, void *buf,
+               uint64_t lba, uint32_t cnt, struct ext4_blocks_io *bio);
+
+/**@brief   Wait the asynchronous block reads of the group finished,
+ *          the reads of the other callers are not waited.
+ * @param   bdev block device descriptor
+ * @param   bio the group of the reads
+ * @return  standard error code*/
+int ext4_blocks_wait(struct ext4_blockdev *bdev, struct ext4_blocks_io *bio);
+
 /**@brief   Block write procedure (without cache)
  * @param   bdev block device descriptor
  * @param   buf output buffer
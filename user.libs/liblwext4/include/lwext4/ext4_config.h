@@ -88,6 +88,12 @@ extern "C" {
 #define CONFIG_JOURNALING_ENABLE 1
 #endif
 
+/**@brief  Max metadata blocks of a batched journal transaction, see
+ *         @ref ext4_journal_batch*/
+#ifndef CONFIG_EXT4_TRANS_BATCH_BLOCKS
+#define CONFIG_EXT4_TRANS_BATCH_BLOCKS 256
+#endif
+
 /**@brief  Enable/disable xattr*/
 #ifndef CONFIG_XATTR_ENABLE
 #define CONFIG_XATTR_ENABLE 1
@@ -43,9 +43,8 @@
 extern "C" {
 #endif
 
-#include <ext4_config.h>
-
 #include <stdint.h>
+#include <stdbool.h>
 
 /**@brief   CRC32 algorithm.
  * @param   crc input feed
@@ -61,6 +60,27 @@ uint32_t ext4_crc32(uint32_t crc, const void *buf, uint32_t size);
  * @return  updated crc32c value*/
 uint32_t ext4_crc32c(uint32_t crc, const void *buf, uint32_t size);
 
+/**@brief   Table based CRC32 and CRC32C, the fallback of the above.
+ * @param   crc input feed
+ * @param   buf input buffer
+ * @param   size input buffer length (bytes)
+ * @return  updated crc value*/
+uint32_t ext4_crc32_sw(uint32_t crc, const void *buf, uint32_t size);
+uint32_t ext4_crc32c_sw(uint32_t crc, const void *buf, uint32_t size);
+
+/**@brief   CRC32 and CRC32C with the ARMv8 CRC32 instructions, only
+ *          valid if @ref ext4_crc32_hw_supported returns true.
+ * @param   crc input feed
+ * @param   buf input buffer
+ * @param   size input buffer length (bytes)
+ * @return  updated crc value*/
+uint32_t ext4_crc32_hw(uint32_t crc, const void *buf, uint32_t size);
+uint32_t ext4_crc32c_hw(uint32_t crc, const void *buf, uint32_t size);
+
+/**@brief   Check the CPU has the CRC32 instructions.
+ * @return  true if supported*/
+bool ext4_crc32_hw_supported(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -53,6 +53,9 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+/* slots of the block mapping generations, indexed by inode number */
+#define EXT4_EXTENT_GENS 64
+
 struct ext4_fs {
     bool read_only;
 
@@ -64,6 +67,12 @@ struct ext4_fs {
 
     uint32_t last_inode_bg_id;
 
+    /* bumped when the block mapping of an extent inode changes
+     * or blocks of the inode are freed, one slot for the inodes
+     * with the same number modulo EXT4_EXTENT_GENS, the others
+     * in the slot only see a spurious change */
+    uint32_t extent_gen[EXT4_EXTENT_GENS];
+
     struct jbd_fs *jbd_fs;
     struct jbd_journal *jbd_journal;
     struct jbd_trans *curr_trans;
@@ -116,6 +125,25 @@ static inline ext4_fsblk_t ext4_fs_bg_idx_to_addr(struct ext4_sblock *s,
     return ext4_get32(s, blocks_per_group) * bgid + index;
 }
 
+/**@brief Get the block mapping generation of the inode.
+ * @param fs Filesystem
+ * @param ino Inode number
+ * @return Generation of the mapping
+ */
+static inline uint32_t ext4_fs_extent_gen(struct ext4_fs *fs, uint32_t ino)
+{
+    return fs->extent_gen[ino % EXT4_EXTENT_GENS];
+}
+
+/**@brief Mark the block mapping of the inode changed.
+ * @param fs Filesystem
+ * @param ino Inode number
+ */
+static inline void ext4_fs_extent_gen_inc(struct ext4_fs *fs, uint32_t ino)
+{
+    fs->extent_gen[ino % EXT4_EXTENT_GENS]++;
+}
+
 /**@brief TODO: */
 static inline ext4_fsblk_t ext4_fs_first_bg_block_no(struct ext4_sblock *s,
                          uint32_t bgid)
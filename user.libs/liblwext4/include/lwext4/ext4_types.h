@@ -830,12 +830,15 @@ extern void *ext4_user_calloc(size_t numb, size_t size);
 extern void *ext4_user_free(void *mem);
 extern void *ext4_user_realloc(void *ptr, size_t size);
 extern void *ext4_user_alloc_bcache(size_t size);
+extern void ext4_user_free_bcache(void *mem);
+extern void ext4_user_set_bcache_bufs(size_t nr);
 
 #define ext4_malloc  ext4_user_malloc
 #define ext4_calloc  ext4_user_calloc
 #define ext4_realloc ext4_user_realloc
 #define ext4_free    ext4_user_free
 #define ext4_alloc_bcache ext4_user_alloc_bcache
+#define ext4_free_bcache ext4_user_free_bcache
 
 #else
 
@@ -844,6 +847,7 @@ extern void *ext4_user_alloc_bcache(size_t size);
 #define ext4_realloc realloc
 #define ext4_free    free
 #define ext4_alloc_bcache malloc
+#define ext4_free_bcache free
 
 #endif
 
@@ -52,6 +52,7 @@
 #include <ext4_dir_idx.h>
 #include <ext4_xattr.h>
 #include <ext4_journal.h>
+#include <ext4_extent.h>
 
 
 #include <stdlib.h>
@@ -94,6 +95,9 @@ struct ext4_mountpoint {
 
     /**@brief   Block cache.*/
     struct ext4_bcache bc;
+
+    /**@brief   Journal transactions are batched.*/
+    bool trans_batch;
 };
 
 /**@brief   Block devices descriptor.*/
@@ -359,11 +363,19 @@ static int ext4_unlink(struct ext4_mountpoint *mp,
 
 /****************************************************************************/
 
+/**@brief   Block cache size in bytes of the next mount, 0 for default.*/
+static size_t s_bcache_size;
+
+void ext4_set_bcache_size(size_t size)
+{
+    s_bcache_size = size;
+}
+
 int ext4_mount(const char *dev_name, const char *mount_point,
            bool read_only)
 {
     int r;
-    uint32_t bsize;
+    uint32_t bsize, bcnt;
     struct ext4_bcache *bc;
     struct ext4_blockdev *bd = 0;
     struct ext4_mountpoint *mp = 0;
@@ -405,26 +417,32 @@ int ext4_mount(const char *dev_name, const char *mount_point,
 
     r = ext4_block_init(bd);
     if (r != EOK)
-        return r;
+        goto Fail;
 
     r = ext4_fs_init(&mp->fs, bd, read_only);
     if (r != EOK) {
         ext4_block_fini(bd);
-        return r;
+        goto Fail;
     }
 
     bsize = ext4_sb_get_block_size(&mp->fs.sb);
     ext4_block_set_lb_size(bd, bsize);
     bc = &mp->bc;
 
-    r = ext4_bcache_init_dynamic(bc, CONFIG_BLOCK_DEV_CACHE_SIZE, bsize);
+    bcnt = CONFIG_BLOCK_DEV_CACHE_SIZE;
+    if (s_bcache_size / bsize > bcnt)
+        bcnt = s_bcache_size / bsize;
+
+    r = ext4_bcache_init_dynamic(bc, bcnt, bsize);
     if (r != EOK) {
         ext4_block_fini(bd);
-        return r;
+        goto Fail;
     }
 
-    if (bsize != bc->itemsize)
-        return ENOTSUP;
+    if (bsize != bc->itemsize) {
+        r = ENOTSUP;
+        goto Fail;
+    }
 
     /*Bind block cache to block device*/
     r = ext4_block_bind_bcache(bd, bc);
@@ -432,11 +450,16 @@ int ext4_mount(const char *dev_name, const char *mount_point,
         ext4_bcache_cleanup(bc);
         ext4_block_fini(bd);
         ext4_bcache_fini_dynamic(bc);
-        return r;
+        goto Fail;
     }
 
     bd->fs = &mp->fs;
     return r;
+
+Fail:
+    /*Release the mount point, it may be mounted again*/
+    memset(mp, 0, sizeof(struct ext4_mountpoint));
+    return r;
 }
 
 
@@ -517,6 +540,8 @@ Finish:
 }
 
 __unused
+static int __ext4_trans_stop(struct ext4_mountpoint *mp);
+
 static int __ext4_journal_stop(const char *mount_point)
 {
     int r = EOK;
@@ -528,6 +553,10 @@ static int __ext4_journal_stop(const char *mount_point)
     if (mp->fs.read_only)
         return EOK;
 
+    /*Commit the pending batched transaction*/
+    mp->trans_batch = false;
+    __ext4_trans_stop(mp);
+
     if (ext4_sb_feature_com(&mp->fs.sb,
                 EXT4_FCOM_HAS_JOURNAL)) {
         r = jbd_journal_stop(&mp->jbd_journal);
@@ -695,6 +724,12 @@ static int ext4_trans_stop(struct ext4_mountpoint *mp __unused)
 {
     int r = EOK;
 #if CONFIG_JOURNALING_ENABLE
+    struct jbd_trans *trans = mp->fs.curr_trans;
+
+    if (mp->trans_batch && trans &&
+        trans->data_cnt < CONFIG_EXT4_TRANS_BATCH_BLOCKS)
+        return EOK;
+
     r = __ext4_trans_stop(mp);
 #endif
     return r;
@@ -703,10 +738,53 @@ static int ext4_trans_stop(struct ext4_mountpoint *mp __unused)
 static void ext4_trans_abort(struct ext4_mountpoint *mp __unused)
 {
 #if CONFIG_JOURNALING_ENABLE
+    /*The batched transaction holds the changes of the former
+     * operations, commit it instead of dropping them.*/
+    if (mp->trans_batch) {
+        __ext4_trans_stop(mp);
+        return;
+    }
+
     __ext4_trans_abort(mp);
 #endif
 }
 
+int ext4_journal_batch(const char *mount_point, bool on)
+{
+    struct ext4_mountpoint *mp = ext4_get_mount(mount_point);
+    int r = EOK;
+
+    if (!mp)
+        return ENOENT;
+
+    EXT4_MP_LOCK(mp);
+    mp->trans_batch = on;
+#if CONFIG_JOURNALING_ENABLE
+    if (!on)
+        r = __ext4_trans_stop(mp);
+#endif
+    EXT4_MP_UNLOCK(mp);
+
+    return r;
+}
+
+int ext4_journal_commit(const char *mount_point)
+{
+    struct ext4_mountpoint *mp = ext4_get_mount(mount_point);
+    int r = EOK;
+
+    if (!mp)
+        return ENOENT;
+
+    EXT4_MP_LOCK(mp);
+#if CONFIG_JOURNALING_ENABLE
+    r = __ext4_trans_stop(mp);
+#endif
+    EXT4_MP_UNLOCK(mp);
+
+    return r;
+}
+
 
 int ext4_mount_point_stats(const char *mount_point,
                struct ext4_mount_stats *stats)
@@ -733,6 +811,21 @@ int ext4_mount_point_stats(const char *mount_point,
     return EOK;
 }
 
+int ext4_mount_point_bcache_stats(const char *mount_point,
+                  struct ext4_bcache_stats *stats)
+{
+    struct ext4_mountpoint *mp = ext4_get_mount(mount_point);
+
+    if (!mp)
+        return ENOENT;
+
+    EXT4_MP_LOCK(mp);
+    memcpy(stats, &mp->fs.bdev->bc->stats, sizeof(*stats));
+    EXT4_MP_UNLOCK(mp);
+
+    return EOK;
+}
+
 int ext4_mount_setup_locks(const char *mount_point,
                const struct ext4_lock *locks)
 {
@@ -923,6 +1016,12 @@ static int ext4_trunc_dir(struct ext4_mountpoint *mp,
  * NOTICE: if filetype is equal to EXT4_DIRENTRY_UNKNOWN,
  * any filetype of the target dir entry will be accepted.
  */
+static inline void ext4_file_extents_reset(ext4_file *f)
+{
+    memset(f->extents, 0, sizeof(f->extents));
+    f->extent_hand = 0;
+}
+
 static int ext4_generic_open2(ext4_file *f, const char *path, int flags,
                   int ftype, uint32_t *parent_inode,
                   uint32_t *name_off)
@@ -949,6 +1048,7 @@ static int ext4_generic_open2(ext4_file *f, const char *path, int flags,
         return EROFS;
 
     f->flags = flags;
+    ext4_file_extents_reset(f);
 
     /*Skip mount point*/
     path += strlen(mp->name);
@@ -1556,6 +1656,152 @@ int ext4_fopen(ext4_file *file, const char *path, const char *flags)
     return r;
 }
 
+static uint8_t ext4_inode_de_type(struct ext4_sblock *sb,
+                  struct ext4_inode *inode)
+{
+    switch (ext4_inode_type(sb, inode)) {
+    case EXT4_INODE_MODE_DIRECTORY:
+        return EXT4_DE_DIR;
+    case EXT4_INODE_MODE_FILE:
+        return EXT4_DE_REG_FILE;
+    case EXT4_INODE_MODE_SOFTLINK:
+        return EXT4_DE_SYMLINK;
+    case EXT4_INODE_MODE_CHARDEV:
+        return EXT4_DE_CHRDEV;
+    case EXT4_INODE_MODE_BLOCKDEV:
+        return EXT4_DE_BLKDEV;
+    case EXT4_INODE_MODE_FIFO:
+        return EXT4_DE_FIFO;
+    case EXT4_INODE_MODE_SOCKET:
+        return EXT4_DE_SOCK;
+    }
+    return EXT4_DE_UNKNOWN;
+}
+
+int ext4_dir_lookup(const char *mount_point, uint32_t dir_ino,
+            const char *name, uint32_t len,
+            uint32_t *ino, uint8_t *type)
+{
+    struct ext4_mountpoint *mp = ext4_get_mount(mount_point);
+    struct ext4_dir_search_result result;
+    struct ext4_inode_ref ref, child;
+    struct ext4_sblock *sb;
+    int r;
+
+    if (!mp)
+        return ENOENT;
+
+    sb = &mp->fs.sb;
+
+    EXT4_MP_LOCK(mp);
+    r = ext4_fs_get_inode_ref(&mp->fs, dir_ino, &ref);
+    if (r != EOK)
+        goto Finish;
+
+    if (ext4_inode_type(sb, ref.inode) != EXT4_INODE_MODE_DIRECTORY) {
+        ext4_fs_put_inode_ref(&ref);
+        r = ENOTDIR;
+        goto Finish;
+    }
+
+    r = ext4_dir_find_entry(&result, &ref, name, len);
+    if (r != EOK) {
+        ext4_dir_destroy_result(&ref, &result);
+        ext4_fs_put_inode_ref(&ref);
+        goto Finish;
+    }
+
+    *ino = ext4_dir_en_get_inode(result.dentry);
+    if (ext4_sb_feature_incom(sb, EXT4_FINCOM_FILETYPE)) {
+        *type = ext4_dir_en_get_inode_type(sb, result.dentry);
+    } else {
+        r = ext4_fs_get_inode_ref(&mp->fs, *ino, &child);
+        if (r == EOK) {
+            *type = ext4_inode_de_type(sb, child.inode);
+            ext4_fs_put_inode_ref(&child);
+        }
+    }
+
+    ext4_dir_destroy_result(&ref, &result);
+    ext4_fs_put_inode_ref(&ref);
+Finish:
+    EXT4_MP_UNLOCK(mp);
+    return r;
+}
+
+int ext4_inode_get(const char *mount_point, uint32_t ino,
+           struct ext4_inode *inode)
+{
+    struct ext4_mountpoint *mp = ext4_get_mount(mount_point);
+    struct ext4_inode_ref ref;
+    int r;
+
+    if (!mp)
+        return ENOENT;
+
+    EXT4_MP_LOCK(mp);
+    r = ext4_fs_get_inode_ref(&mp->fs, ino, &ref);
+    if (r == EOK) {
+        memcpy(inode, ref.inode, sizeof(struct ext4_inode));
+        ext4_fs_put_inode_ref(&ref);
+    }
+    EXT4_MP_UNLOCK(mp);
+
+    return r;
+}
+
+/*Open the inode which has been looked up, no path walk.*/
+static int ext4_generic_open_ino(ext4_file *f, const char *mount_point,
+                 uint32_t ino, int flags, uint8_t type)
+{
+    struct ext4_mountpoint *mp = ext4_get_mount(mount_point);
+    struct ext4_inode_ref ref;
+    uint8_t t;
+    int r;
+
+    f->mp = 0;
+
+    if (!mp)
+        return ENOENT;
+
+    if (flags & (O_CREAT | O_TRUNC))
+        return EINVAL;
+
+    EXT4_MP_LOCK(mp);
+    r = ext4_fs_get_inode_ref(&mp->fs, ino, &ref);
+    if (r != EOK) {
+        EXT4_MP_UNLOCK(mp);
+        return r;
+    }
+
+    t = ext4_inode_de_type(&mp->fs.sb, ref.inode);
+    if (t != type) {
+        if (type == EXT4_DE_DIR)
+            r = ENOTDIR;
+        else
+            r = (t == EXT4_DE_DIR) ? EISDIR : ENOENT;
+    } else {
+        f->mp = mp;
+        f->inode = ino;
+        f->flags = flags;
+        f->fsize = ext4_inode_get_size(&mp->fs.sb, ref.inode);
+        f->fpos = (flags & O_APPEND) ? f->fsize : 0;
+        ext4_file_extents_reset(f);
+    }
+
+    ext4_fs_put_inode_ref(&ref);
+    EXT4_MP_UNLOCK(mp);
+
+    return r;
+}
+
+int ext4_fopen_ino(ext4_file *file, const char *mount_point,
+           uint32_t ino, int flags)
+{
+    return ext4_generic_open_ino(file, mount_point, ino, flags,
+                     EXT4_DE_REG_FILE);
+}
+
 int ext4_fopen2(ext4_file *file, const char *path, int flags)
 {
     struct ext4_mountpoint *mp = ext4_get_mount(path);
@@ -1667,20 +1913,93 @@ int ext4_ftruncate(ext4_file *f, uint64_t size)
     return r;
 }
 
+/*
+ * map the data blocks of the file from iblock, return the first
+ * physical block and the number of blocks which are contiguous
+ * with it. the recently used extents are kept in the file, so the
+ * extent tree is not walked again for each block of a read. the
+ * cached extents are dropped once the mapping generation of the
+ * inode changes. holes and unwritten ranges return
+ * block 0 and are not cached.
+ */
+static int ext4_fmap_blocks(ext4_file *file, struct ext4_inode_ref *ref,
+                ext4_lblk_t iblock, ext4_fsblk_t *fblock,
+                uint32_t *count)
+{
+    struct ext4_fs *fs = ref->fs;
+    struct ext4_file_extent *ext;
+    uint32_t i;
+
+    if (file->extent_gen != ext4_fs_extent_gen(fs, file->inode)) {
+        ext4_file_extents_reset(file);
+        file->extent_gen = ext4_fs_extent_gen(fs, file->inode);
+    }
+
+    for (i = 0; i < EXT4_FILE_EXTENTS; i++) {
+        ext = &file->extents[i];
+        if (ext->len && (iblock >= ext->lblk) &&
+                (iblock - ext->lblk < ext->len)) {
+            *fblock = ext->pblk + (iblock - ext->lblk);
+            *count = ext->len - (iblock - ext->lblk);
+            return EOK;
+        }
+    }
+
+    *count = 1;
+
+#if CONFIG_EXTENT_ENABLE
+    if (ext4_inode_get_size(&fs->sb, ref->inode) &&
+        ext4_sb_feature_incom(&fs->sb, EXT4_FINCOM_EXTENTS) &&
+        ext4_inode_has_flag(ref->inode, EXT4_INODE_FLAG_EXTENTS)) {
+        uint32_t len;
+        int r;
+
+        r = ext4_extent_get_blocks(ref, iblock, EXT_MAX_BLOCKS,
+                       fblock, false, &len);
+        if (r != EOK || !*fblock || !len)
+            return r;
+
+        ext = &file->extents[file->extent_hand];
+        file->extent_hand = (file->extent_hand + 1) % EXT4_FILE_EXTENTS;
+        ext->lblk = iblock;
+        ext->len = len;
+        ext->pblk = *fblock;
+        *count = len;
+
+        return EOK;
+    }
+#endif
+
+    return ext4_fs_get_inode_dblk_idx(ref, iblock, fblock, true);
+}
+
+/*
+ * contiguous runs of the data blocks of one read, mapped with the
+ * mount lock held and read without it.
+ */
+#define EXT4_FREAD_RUNS 8
+
+struct ext4_fread_run {
+    ext4_fsblk_t fblock;
+    uint32_t count;
+    uint8_t *buf;
+};
+
 int ext4_fread(ext4_file *file, void *buf, size_t size, size_t *rcnt)
 {
     uint32_t unalg;
     uint32_t iblock_idx;
-    uint32_t iblock_last;
     uint32_t block_size;
 
     ext4_fsblk_t fblock;
-    ext4_fsblk_t fblock_start;
     uint32_t fblock_count;
 
+    struct ext4_fread_run runs[EXT4_FREAD_RUNS];
     uint8_t *u8_buf = buf;
-    int r;
+    struct ext4_blocks_io bio;
+    int r, rr;
     struct ext4_inode_ref ref;
+    uint32_t i;
 
     ext4_assert(file && file->mp);
 
@@ -1712,7 +2031,6 @@ int ext4_fread(ext4_file *file, void *buf, size_t size, size_t *rcnt)
         ? ((size_t)(file->fsize - file->fpos)) : size;
 
     iblock_idx = (uint32_t)((file->fpos) / block_size);
-    iblock_last = (uint32_t)((file->fpos + size) / block_size);
     unalg = (file->fpos) % block_size;
 
     /*If the size of symlink is smaller than 60 bytes*/
@@ -1741,7 +2059,8 @@ int ext4_fread(ext4_file *file, void *buf, size_t size, size_t *rcnt)
         if (size > (block_size - unalg))
             len = block_size - unalg;
 
-        r = ext4_fs_get_inode_dblk_idx(&ref, iblock_idx, &fblock, true);
+        r = ext4_fmap_blocks(file, &ref, iblock_idx, &fblock,
+                     &fblock_count);
         if (r != EOK)
             goto Finish;
 
@@ -1767,52 +2086,90 @@ int ext4_fread(ext4_file *file, void *buf, size_t size, size_t *rcnt)
         iblock_idx++;
     }
 
-    fblock_start = 0;
-    fblock_count = 0;
     while (size >= block_size) {
-        while (iblock_idx < iblock_last) {
-            r = ext4_fs_get_inode_dblk_idx(&ref, iblock_idx,
-                               &fblock, true);
+        ext4_lblk_t iblock_start = iblock_idx;
+        uint8_t *buf_start = u8_buf;
+        size_t size_start = size;
+        uint32_t gen = ext4_fs_extent_gen(fs, file->inode);
+        uint32_t nr = 0;
+
+        while ((size >= block_size) && (nr < EXT4_FREAD_RUNS)) {
+            r = ext4_fmap_blocks(file, &ref, iblock_idx, &fblock,
+                         &fblock_count);
             if (r != EOK)
                 goto Finish;
 
-            iblock_idx++;
-
-            if (!fblock_start)
-                fblock_start = fblock;
+            if (fblock_count > size / block_size)
+                fblock_count = size / block_size;
 
-            if ((fblock_start + fblock_count) != fblock)
-                break;
+            if (fblock != 0) {
+                runs[nr].fblock = fblock;
+                runs[nr].count = fblock_count;
+                runs[nr].buf = u8_buf;
+                nr++;
+            } else {
+                memset(u8_buf, 0, block_size * fblock_count);
+            }
 
-            fblock_count++;
+            iblock_idx += fblock_count;
+            size -= block_size * fblock_count;
+            u8_buf += block_size * fblock_count;
         }
 
-        r = ext4_blocks_get_direct(file->mp->fs.bdev, u8_buf, fblock_start,
-                       fblock_count);
-        if (r != EOK)
-            goto Finish;
+        /*
+         * the runs are mapped, read them without the mount lock
+         * and keep them all in flight. the blocks may be freed
+         * meanwhile, map and read them again if the generation
+         * of the mapping has changed.
+         */
+        if (nr) {
+            ext4_fs_put_inode_ref(&ref);
+            EXT4_MP_UNLOCK(file->mp);
+
+            memset(&bio, 0, sizeof(bio));
+            for (i = 0; (i < nr) && (r == EOK); i++)
+                r = ext4_blocks_get_direct_async(file->mp->fs.bdev,
+                        runs[i].buf, runs[i].fblock, runs[i].count, &bio);
+            rr = ext4_blocks_wait(file->mp->fs.bdev, &bio);
+            if (r == EOK)
+                r = rr;
+            if (r != EOK)
+                return r;
 
-        size -= block_size * fblock_count;
-        u8_buf += block_size * fblock_count;
-        file->fpos += block_size * fblock_count;
+            EXT4_MP_LOCK(file->mp);
+            r = ext4_fs_get_inode_ref(fs, file->inode, &ref);
+            if (r != EOK) {
+                EXT4_MP_UNLOCK(file->mp);
+                return r;
+            }
 
-        if (rcnt)
-            *rcnt += block_size * fblock_count;
+            if (gen != ext4_fs_extent_gen(fs, file->inode)) {
+                iblock_idx = iblock_start;
+                u8_buf = buf_start;
+                size = size_start;
+                continue;
+            }
+        }
 
-        fblock_start = fblock;
-        fblock_count = 1;
+        file->fpos += size_start - size;
+        if (rcnt)
+            *rcnt += size_start - size;
     }
 
     if (size) {
-        uint64_t off;
-        r = ext4_fs_get_inode_dblk_idx(&ref, iblock_idx, &fblock, true);
+        r = ext4_fmap_blocks(file, &ref, iblock_idx, &fblock,
+                     &fblock_count);
         if (r != EOK)
             goto Finish;
 
-        off = fblock * block_size;
-        r = ext4_block_readbytes(file->mp->fs.bdev, off, u8_buf, size);
-        if (r != EOK)
-            goto Finish;
+        if (fblock != 0) {
+            uint64_t off = fblock * block_size;
+            r = ext4_block_readbytes(file->mp->fs.bdev, off, u8_buf, size);
+            if (r != EOK)
+                goto Finish;
+        } else {
+            memset(u8_buf, 0, size);
+        }
 
         file->fpos += size;
 
@@ -3155,6 +3512,16 @@ Finish:
     return r;
 }
 
+int ext4_dir_open_ino(ext4_dir *dir, const char *mount_point, uint32_t ino)
+{
+    int r;
+
+    r = ext4_generic_open_ino(&dir->f, mount_point, ino, O_RDONLY,
+                  EXT4_DE_DIR);
+    dir->next_off = 0;
+    return r;
+}
+
 int ext4_dir_open(ext4_dir *dir, const char *path)
 {
     struct ext4_mountpoint *mp = ext4_get_mount(path);
@@ -3203,6 +3570,19 @@ const ext4_direntry *ext4_dir_entry_next(ext4_dir *dir)
         goto Finish;
     }
 
+    /* Skip the unused entry at the start of a block */
+    while (it.curr && !ext4_dir_en_get_inode(it.curr)) {
+        if (ext4_dir_iterator_next(&it) != EOK)
+            break;
+    }
+
+    if (!it.curr) {
+        dir->next_off = EXT4_DIR_ENTRY_OFFSET_TERM;
+        ext4_dir_iterator_fini(&it);
+        ext4_fs_put_inode_ref(&dir_inode);
+        goto Finish;
+    }
+
     memset(&dir->de.name, 0, sizeof(dir->de.name));
     name_length = ext4_dir_en_get_name_len(&dir->f.mp->fs.sb,
                            it.curr);
@@ -3234,15 +3614,51 @@ void ext4_dir_entry_rewind(ext4_dir *dir)
     dir->next_off = 0;
 }
 
+/*
+ * The offset may come from a client, walk the entries from the start
+ * of its block, then only the offset of an entry is used. If the
+ * entry has been removed, the next one is used.
+ */
+static int ext4_dir_seek_set(ext4_dir *dir, uint64_t offset)
+{
+    int r;
+    uint32_t block_size;
+    struct ext4_inode_ref dir_inode;
+    struct ext4_dir_iter it;
+
+    if ((offset == 0) || (offset == EXT4_DIR_ENTRY_OFFSET_TERM)) {
+        dir->next_off = offset;
+        return EOK;
+    }
+
+    EXT4_MP_LOCK(dir->f.mp);
+
+    r = ext4_fs_get_inode_ref(&dir->f.mp->fs, dir->f.inode, &dir_inode);
+    if (r != EOK)
+        goto Finish;
+
+    block_size = ext4_sb_get_block_size(&dir->f.mp->fs.sb);
+    r = ext4_dir_iterator_init(&it, &dir_inode,
+                   offset - (offset % block_size));
+    while ((r == EOK) && it.curr && (it.curr_off < offset))
+        r = ext4_dir_iterator_next(&it);
+
+    if (r == EOK)
+        dir->next_off = it.curr ? it.curr_off : EXT4_DIR_ENTRY_OFFSET_TERM;
+
+    ext4_dir_iterator_fini(&it);
+    ext4_fs_put_inode_ref(&dir_inode);
+
+Finish:
+    EXT4_MP_UNLOCK(dir->f.mp);
+    return r;
+}
+
 int ext4_dir_seek(ext4_dir *dir, int64_t offset, uint32_t origin)
 {
-	/*
-	 * TO BE DONE
-	 */
     switch (origin) {
     case SEEK_SET:
-	dir->next_off = offset;
-        return EOK;
+        return ext4_dir_seek_set(dir, offset);
     case SEEK_CUR:
 	dir->next_off += offset;
         return EOK;
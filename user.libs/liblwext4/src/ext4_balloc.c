@@ -154,6 +154,9 @@ int ext4_balloc_free_block(struct ext4_inode_ref *inode_ref, ext4_fsblk_t baddr)
     struct ext4_fs *fs = inode_ref->fs;
     struct ext4_sblock *sb = &fs->sb;
 
+    /* the unlocked reads of the freed block are retried */
+    ext4_fs_extent_gen_inc(fs, inode_ref->index);
+
     uint32_t bg_id = ext4_balloc_get_bgid_of_block(sb, baddr);
     uint32_t index_in_group = ext4_fs_addr_to_idx_bg(sb, baddr);
 
@@ -239,6 +242,9 @@ int ext4_balloc_free_blocks(struct ext4_inode_ref *inode_ref,
     struct ext4_fs *fs = inode_ref->fs;
     struct ext4_sblock *sb = &fs->sb;
 
+    /* the unlocked reads of the freed blocks are retried */
+    ext4_fs_extent_gen_inc(fs, inode_ref->index);
+
     /* Compute indexes */
     uint32_t bg_first = ext4_balloc_get_bgid_of_block(sb, first);
 
@@ -44,40 +44,37 @@
 #include <string.h>
 #include <stdlib.h>
 
-static int ext4_bcache_lba_compare(struct ext4_buf *a, struct ext4_buf *b)
+static inline uint32_t ext4_bcache_hash(struct ext4_bcache *bc, uint64_t lba)
 {
-     if (a->lba > b->lba)
-         return 1;
-     else if (a->lba < b->lba)
-         return -1;
-     return 0;
+    return (uint32_t)((lba * 0x9E3779B97F4A7C15ULL) >> 32) & bc->hash_mask;
 }
 
-static int ext4_bcache_lru_compare(struct ext4_buf *a, struct ext4_buf *b)
-{
-    if (a->lru_id > b->lru_id)
-        return 1;
-    else if (a->lru_id < b->lru_id)
-        return -1;
-    return 0;
-}
-
-RB_GENERATE_INTERNAL(ext4_buf_lba, ext4_buf, lba_node,
-             ext4_bcache_lba_compare, static inline)
-RB_GENERATE_INTERNAL(ext4_buf_lru, ext4_buf, lru_node,
-             ext4_bcache_lru_compare, static inline)
-
 int ext4_bcache_init_dynamic(struct ext4_bcache *bc, uint32_t cnt,
                  uint32_t itemsize)
 {
+    uint32_t buckets = 16;
+
     ext4_assert(bc && cnt && itemsize);
 
     memset(bc, 0, sizeof(struct ext4_bcache));
 
+    /* About one buffer in each hash chain when the cache is full. */
+    while (buckets < cnt)
+        buckets <<= 1;
+
+    bc->hash = ext4_calloc(buckets, sizeof(*bc->hash));
+    if (!bc->hash)
+        return ENOMEM;
+
+    bc->hash_mask = buckets - 1;
+    TAILQ_INIT(&bc->clock_ring);
+
     bc->cnt = cnt;
     bc->itemsize = itemsize;
     bc->ref_blocks = 0;
     bc->max_ref_blocks = 0;
+    bc->stats.cnt = cnt;
+    bc->stats.itemsize = itemsize;
 
     return EOK;
 }
@@ -85,7 +82,7 @@ int ext4_bcache_init_dynamic(struct ext4_bcache *bc, uint32_t cnt,
 void ext4_bcache_cleanup(struct ext4_bcache *bc)
 {
     struct ext4_buf *buf, *tmp;
-    RB_FOREACH_SAFE(buf, ext4_buf_lba, &bc->lba_root, tmp) {
+    TAILQ_FOREACH_SAFE(buf, &bc->clock_ring, clock_node, tmp) {
         ext4_block_flush_buf(bc->bdev, buf);
         ext4_bcache_drop_buf(bc, buf);
     }
@@ -93,6 +90,9 @@ void ext4_bcache_cleanup(struct ext4_bcache *bc)
 
 int ext4_bcache_fini_dynamic(struct ext4_bcache *bc)
 {
+    if (bc->hash)
+        ext4_free(bc->hash);
+
     memset(bc, 0, sizeof(struct ext4_bcache));
     return EOK;
 }
@@ -101,19 +101,17 @@ int ext4_bcache_fini_dynamic(struct ext4_bcache *bc)
  *
  *  This is ext4_bcache, the module handling basic buffer-cache stuff.
  *
- *  Buffers in a bcache are sorted by their LBA and stored in a
- *  RB-Tree(lba_root).
+ *  Buffers in a bcache are indexed by their LBA in a hash table
+ *  (hash), the lookup is O(1).
  *
- *  Bcache also maintains another RB-Tree(lru_root) right now, where
- *  buffers are sorted by their LRU id.
+ *  All the buffers are also linked in a ring (clock_ring), which is
+ *  scanned by the CLOCK hand to find the buffer to evict. A buffer
+ *  gets a second chance if it has been accessed since the hand
+ *  passed it last time, referenced buffers are always skipped.
  *
  *  A singly-linked list is used to track those dirty buffers which are
  *  ready to be flushed. (Those buffers which are dirty but also referenced
  *  are not considered ready to be flushed.)
- *
- *  When a buffer is not referenced, it will be stored in both lba_root
- *  and lru_root, while it will only be stored in lba_root when it is
- *  referenced.
  */
 
 static struct ext4_buf *
@@ -127,7 +125,7 @@ ext4_buf_alloc(struct ext4_bcache *bc, uint64_t lba)
 
     buf = ext4_calloc(1, sizeof(struct ext4_buf));
     if (!buf) {
-        ext4_free(data);
+        ext4_free_bcache(data);
         return NULL;
     }
 
@@ -139,23 +137,59 @@ ext4_buf_alloc(struct ext4_bcache *bc, uint64_t lba)
 
 static void ext4_buf_free(struct ext4_buf *buf)
 {
-    ext4_free(buf->data);
+    ext4_free_bcache(buf->data);
     ext4_free(buf);
 }
 
 static struct ext4_buf *
 ext4_buf_lookup(struct ext4_bcache *bc, uint64_t lba)
 {
-    struct ext4_buf tmp = {
-        .lba = lba
-    };
+    struct ext4_buf *buf;
 
-    return RB_FIND(ext4_buf_lba, &bc->lba_root, &tmp);
+    LIST_FOREACH(buf, &bc->hash[ext4_bcache_hash(bc, lba)], hash_node) {
+        if (buf->lba == lba)
+            return buf;
+    }
+
+    return NULL;
 }
 
-struct ext4_buf *ext4_buf_lowest_lru(struct ext4_bcache *bc)
+static struct ext4_buf *ext4_bcache_clock_next(struct ext4_bcache *bc,
+                           struct ext4_buf *buf)
 {
-    return RB_MIN(ext4_buf_lru, &bc->lru_root);
+    struct ext4_buf *next = TAILQ_NEXT(buf, clock_node);
+
+    return next ? next : TAILQ_FIRST(&bc->clock_ring);
+}
+
+struct ext4_buf *ext4_bcache_clock_victim(struct ext4_bcache *bc)
+{
+    struct ext4_buf *buf = bc->clock_hand;
+    uint32_t scan;
+
+    if (!bc->unref_blocks)
+        return NULL;
+
+    if (!buf)
+        buf = TAILQ_FIRST(&bc->clock_ring);
+
+    /*
+     * Each buffer is passed at most twice, the first pass clears
+     * the accessed bit.
+     */
+    for (scan = 0; scan < 2 * bc->ref_blocks; scan++) {
+        if (!buf->refctr) {
+            if (!buf->accessed) {
+                bc->clock_hand = ext4_bcache_clock_next(bc, buf);
+                return buf;
+            }
+            buf->accessed = false;
+        }
+        buf = ext4_bcache_clock_next(bc, buf);
+    }
+
+    bc->clock_hand = buf;
+    return NULL;
 }
 
 void ext4_bcache_drop_buf(struct ext4_bcache *bc, struct ext4_buf *buf)
@@ -166,9 +200,14 @@ void ext4_bcache_drop_buf(struct ext4_bcache *bc, struct ext4_buf *buf)
                 "lba: %" PRIu64 ", refctr: %" PRIu32 "\n",
                 buf->lba, buf->refctr);
     } else
-        RB_REMOVE(ext4_buf_lru, &bc->lru_root, buf);
+        bc->unref_blocks--;
 
-    RB_REMOVE(ext4_buf_lba, &bc->lba_root, buf);
+    if (bc->clock_hand == buf) {
+        bc->clock_hand = TAILQ_NEXT(buf, clock_node);
+    }
+
+    LIST_REMOVE(buf, hash_node);
+    TAILQ_REMOVE(&bc->clock_ring, buf, clock_node);
 
     /*Forcibly drop dirty buffer.*/
     if (ext4_bcache_test_flag(buf, BC_DIRTY))
@@ -176,6 +215,7 @@ void ext4_bcache_drop_buf(struct ext4_bcache *bc, struct ext4_buf *buf)
 
     ext4_buf_free(buf);
     bc->ref_blocks--;
+    bc->stats.blocks = bc->ref_blocks;
 }
 
 void ext4_bcache_invalidate_buf(struct ext4_bcache *bc,
@@ -196,12 +236,22 @@ void ext4_bcache_invalidate_lba(struct ext4_bcache *bc,
                 uint32_t cnt)
 {
     uint64_t end = from + cnt - 1;
-    struct ext4_buf *tmp = ext4_buf_lookup(bc, from), *buf;
-    RB_FOREACH_FROM(buf, ext4_buf_lba, tmp) {
-        if (buf->lba > end)
-            break;
+    struct ext4_buf *buf;
+    uint64_t lba;
 
-        ext4_bcache_invalidate_buf(bc, buf);
+    /* Walk the cached buffers if the range is bigger than the cache. */
+    if (cnt > bc->ref_blocks) {
+        TAILQ_FOREACH(buf, &bc->clock_ring, clock_node) {
+            if (buf->lba >= from && buf->lba <= end)
+                ext4_bcache_invalidate_buf(bc, buf);
+        }
+        return;
+    }
+
+    for (lba = from; lba <= end; lba++) {
+        buf = ext4_buf_lookup(bc, lba);
+        if (buf)
+            ext4_bcache_invalidate_buf(bc, buf);
     }
 }
 
@@ -213,15 +263,13 @@ ext4_bcache_find_get(struct ext4_bcache *bc, struct ext4_block *b,
     if (buf) {
         /* If buffer is not referenced. */
         if (!buf->refctr) {
-            /* Assign new value to LRU id and increment LRU counter
-             * by 1*/
-            buf->lru_id = ++bc->lru_ctr;
-            RB_REMOVE(ext4_buf_lru, &bc->lru_root, buf);
+            bc->unref_blocks--;
             if (ext4_bcache_test_flag(buf, BC_DIRTY))
                 ext4_bcache_remove_dirty_node(bc, buf);
 
         }
 
+        buf->accessed = true;
         ext4_bcache_inc_ref(buf);
 
         b->lb_id = lba;
@@ -237,16 +285,27 @@ int ext4_bcache_alloc(struct ext4_bcache *bc, struct ext4_block *b,
     /* Try to search the buffer with exaxt LBA. */
     struct ext4_buf *buf = ext4_bcache_find_get(bc, b, b->lb_id);
     if (buf) {
+        bc->stats.hits++;
         *is_new = false;
         return EOK;
     }
 
+    bc->stats.misses++;
+
     /* We need to allocate one buffer.*/
     buf = ext4_buf_alloc(bc, b->lb_id);
     if (!buf)
         return ENOMEM;
 
-    RB_INSERT(ext4_buf_lba, &bc->lba_root, buf);
+    LIST_INSERT_HEAD(&bc->hash[ext4_bcache_hash(bc, b->lb_id)],
+             buf, hash_node);
+
+    /* Insert behind the hand, it will be checked at last. */
+    if (bc->clock_hand)
+        TAILQ_INSERT_BEFORE(bc->clock_hand, buf, clock_node);
+    else
+        TAILQ_INSERT_TAIL(&bc->clock_ring, buf, clock_node);
+
     /* One more buffer in bcache now. :-) */
     bc->ref_blocks++;
 
@@ -254,11 +313,11 @@ int ext4_bcache_alloc(struct ext4_bcache *bc, struct ext4_block *b,
     if (bc->max_ref_blocks < bc->ref_blocks)
         bc->max_ref_blocks = bc->ref_blocks;
 
+    bc->stats.blocks = bc->ref_blocks;
+    bc->stats.max_blocks = bc->max_ref_blocks;
 
     ext4_bcache_inc_ref(buf);
-    /* Assign new value to LRU id and increment LRU counter
-     * by 1*/
-    buf->lru_id = ++bc->lru_ctr;
+    buf->accessed = true;
 
     b->buf = buf;
     b->data = buf->data;
@@ -287,7 +346,7 @@ int ext4_bcache_free(struct ext4_bcache *bc, struct ext4_block *b)
 
     /* We are the last one touching this buffer, do the cleanups. */
     if (!buf->refctr) {
-        RB_INSERT(ext4_buf_lru, &bc->lru_root, buf);
+        bc->unref_blocks++;
         /* This buffer is ready to be flushed. */
         if (ext4_bcache_test_flag(buf, BC_DIRTY) &&
             ext4_bcache_test_flag(buf, BC_UPTODATE)) {
@@ -192,11 +192,13 @@ int ext4_block_cache_shake(struct ext4_blockdev *bdev)
 
     bdev->bc->dont_shake = true;
 
-    while (!RB_EMPTY(&bdev->bc->lru_root) &&
+    while (bdev->bc->unref_blocks &&
         ext4_bcache_is_full(bdev->bc)) {
 
-        buf = ext4_buf_lowest_lru(bdev->bc);
-        ext4_assert(buf);
+        buf = ext4_bcache_clock_victim(bdev->bc);
+        if (!buf)
+            break;
+
         if (ext4_bcache_test_flag(buf, BC_DIRTY)) {
             r = ext4_block_flush_buf(bdev, buf);
             if (r != EOK)
@@ -205,6 +207,7 @@ int ext4_block_cache_shake(struct ext4_blockdev *bdev)
         }
 
         ext4_bcache_drop_buf(bdev->bc, buf);
+        bdev->bc->stats.evictions++;
     }
     bdev->bc->dont_shake = false;
     return r;
@@ -292,6 +295,68 @@ int ext4_blocks_get_direct(struct ext4_blockdev *bdev, void *buf, uint64_t lba,
     return ext4_bdif_bread(bdev, buf, pba, pb_cnt * cnt);
 }
 
+/*
+ * The callback may run on the thread which reaps the device, the
+ * status is set before the pending count is released, the waiter
+ * reads it after it sees the count reach 0.
+ */
+static void ext4_bdif_async_done(void *arg, int status)
+{
+    struct ext4_blocks_io *bio = arg;
+
+    if (status != EOK && bio->status == EOK)
+        bio->status = EIO;
+
+    __atomic_sub_fetch(&bio->pending, 1, __ATOMIC_RELEASE);
+}
+
+int ext4_blocks_get_direct_async(struct ext4_blockdev *bdev, void *buf,
+               uint64_t lba, uint32_t cnt, struct ext4_blocks_io *bio)
+{
+    uint64_t pba;
+    uint32_t pb_cnt;
+    int r;
+
+    ext4_assert(bdev && buf && bio);
+
+    if (!bdev->bdif->bread_async)
+        return ext4_blocks_get_direct(bdev, buf, lba, cnt);
+
+    pba = (lba * bdev->lg_bsize + bdev->part_offset) / bdev->bdif->ph_bsize;
+    pb_cnt = bdev->lg_bsize / bdev->bdif->ph_bsize;
+
+    __atomic_add_fetch(&bio->pending, 1, __ATOMIC_RELAXED);
+
+    ext4_bdif_lock(bdev);
+    r = bdev->bdif->bread_async(bdev, buf, pba, pb_cnt * cnt,
+                    ext4_bdif_async_done, bio);
+    bdev->bdif->bread_ctr++;
+    ext4_bdif_unlock(bdev);
+
+    if (r != EOK)
+        __atomic_sub_fetch(&bio->pending, 1, __ATOMIC_RELAXED);
+
+    return r;
+}
+
+int ext4_blocks_wait(struct ext4_blockdev *bdev, struct ext4_blocks_io *bio)
+{
+    int r = EOK;
+
+    if (!bdev->bdif->bread_async)
+        return EOK;
+
+    ext4_assert(bdev->bdif->bwait);
+
+    if (__atomic_load_n(&bio->pending, __ATOMIC_ACQUIRE)) {
+        ext4_bdif_lock(bdev);
+        r = bdev->bdif->bwait(bdev, &bio->pending);
+        ext4_bdif_unlock(bdev);
+    }
+
+    return (r != EOK) ? r : bio->status;
+}
+
 int ext4_blocks_set_direct(struct ext4_blockdev *bdev, const void *buf,
                uint64_t lba, uint32_t cnt)
 {
@@ -44,6 +44,12 @@
 
 #include "ext4_crc32.h"
 
+#include <string.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
 static const uint32_t crc32_tab[] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
     0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
@@ -172,13 +178,163 @@ static inline uint32_t crc32(uint32_t crc, const void *buf, uint32_t size,
     return (crc);
 }
 
+#if defined(__aarch64__)
+
+#define CRC32_HW_ATTR __attribute__((target("+crc")))
+
+/* ARMv8 CRC32 instructions, 8 bytes a time after the head is aligned */
+static inline CRC32_HW_ATTR uint32_t crc32_hw(uint32_t crc, const void *buf,
+                          uint32_t size, bool castagnoli)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint64_t v;
+
+    while (size && ((uintptr_t)p & 7)) {
+        if (castagnoli)
+            __asm__("crc32cb %w0, %w0, %w1" : "+r"(crc) : "r"(*p));
+        else
+            __asm__("crc32b %w0, %w0, %w1" : "+r"(crc) : "r"(*p));
+        p++;
+        size--;
+    }
+
+    while (size >= 8) {
+        memcpy(&v, p, 8);
+        if (castagnoli)
+            __asm__("crc32cx %w0, %w0, %x1" : "+r"(crc) : "r"(v));
+        else
+            __asm__("crc32x %w0, %w0, %x1" : "+r"(crc) : "r"(v));
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        if (castagnoli)
+            __asm__("crc32cb %w0, %w0, %w1" : "+r"(crc) : "r"(*p));
+        else
+            __asm__("crc32b %w0, %w0, %w1" : "+r"(crc) : "r"(*p));
+        p++;
+    }
+
+    return crc;
+}
+
+static CRC32_HW_ATTR uint32_t crc32_arm(uint32_t crc, const void *buf,
+                    uint32_t size)
+{
+    return crc32_hw(crc, buf, size, false);
+}
+
+static CRC32_HW_ATTR uint32_t crc32c_arm(uint32_t crc, const void *buf,
+                     uint32_t size)
+{
+    return crc32_hw(crc, buf, size, true);
+}
+
+/*
+ * Check the instructions against the tables once, with all the
+ * alignments and the tails, before they are used for the metadata.
+ */
+static bool crc32_hw_selftest(void)
+{
+    uint8_t buf[80];
+    uint32_t off, len;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)(i * 0x9d + 0x3b);
+
+    for (off = 0; off < 8; off++) {
+        for (len = 0; len <= sizeof(buf) - 8; len++) {
+            if (crc32c_arm(~0u, buf + off, len) !=
+                crc32(~0u, buf + off, len, crc32c_tab))
+                return false;
+            if (crc32_arm(~0u, buf + off, len) !=
+                crc32(~0u, buf + off, len, crc32_tab))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool ext4_crc32_hw_supported(void)
+{
+    return !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+}
+
+/*
+ * The self test only guards against a broken implementation, the
+ * equivalence is checked by tools/crctest on the host and by
+ * crcbench on the target, which also measures the throughput.
+ */
+static int crc32_hw_state = -1;
+
+static bool crc32_hw_enabled(void)
+{
+    int state = crc32_hw_state;
+
+    if (state < 0) {
+        state = ext4_crc32_hw_supported() && crc32_hw_selftest();
+        if (!state && ext4_crc32_hw_supported())
+            ext4_dbg(DEBUG_EXT4, DBG_WARN
+                 "crc32 instructions self test failed\n");
+        crc32_hw_state = state;
+    }
+
+    return state;
+}
+
+#else
+
+bool ext4_crc32_hw_supported(void)
+{
+    return false;
+}
+
+static inline bool crc32_hw_enabled(void)
+{
+    return false;
+}
+
+#define crc32_arm(crc, buf, size) crc32(crc, buf, size, crc32_tab)
+#define crc32c_arm(crc, buf, size) crc32(crc, buf, size, crc32c_tab)
+
+#endif
+
+uint32_t ext4_crc32_sw(uint32_t crc, const void *buf, uint32_t size)
+{
+    return crc32(crc, buf, size, crc32_tab);
+}
+
+uint32_t ext4_crc32c_sw(uint32_t crc, const void *buf, uint32_t size)
+{
+    return crc32(crc, buf, size, crc32c_tab);
+}
+
+uint32_t ext4_crc32_hw(uint32_t crc, const void *buf, uint32_t size)
+{
+    return crc32_arm(crc, buf, size);
+}
+
+uint32_t ext4_crc32c_hw(uint32_t crc, const void *buf, uint32_t size)
+{
+    return crc32c_arm(crc, buf, size);
+}
+
 uint32_t ext4_crc32(uint32_t crc, const void *buf, uint32_t size)
 {
+    if (crc32_hw_enabled())
+        return crc32_arm(crc, buf, size);
+
     return crc32(crc, buf, size, crc32_tab);
 }
 
 uint32_t ext4_crc32c(uint32_t crc, const void *buf, uint32_t size)
 {
+    if (crc32_hw_enabled())
+        return crc32c_arm(crc, buf, size);
+
     return crc32(crc, buf, size, crc32c_tab);
 }
 
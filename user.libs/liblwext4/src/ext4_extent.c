@@ -1709,6 +1709,8 @@ int ext4_extent_remove_space(struct ext4_inode_ref *inode_ref, ext4_lblk_t from,
     int32_t depth = ext_depth(inode_ref->inode);
     int32_t i;
 
+    ext4_fs_extent_gen_inc(inode_ref->fs, inode_ref->index);
+
     ret = ext4_find_extent(inode_ref, from, &path, 0);
     if (ret != EOK)
         goto out;
@@ -2069,6 +2071,7 @@ int ext4_extent_get_blocks(struct ext4_inode_ref *inode_ref, ext4_lblk_t iblock,
                 zero_range = max_blocks;
 
             newblock = iblock - ee_block + ee_start;
+            ext4_fs_extent_gen_inc(inode_ref->fs, inode_ref->index);
             err = ext4_ext_zero_unwritten_range(inode_ref, newblock,
                                 zero_range);
             if (err != EOK)
@@ -2091,6 +2094,8 @@ int ext4_extent_get_blocks(struct ext4_inode_ref *inode_ref, ext4_lblk_t iblock,
         goto out2;
     }
 
+    ext4_fs_extent_gen_inc(inode_ref->fs, inode_ref->index);
+
     /* find next allocated block so that we know how many
      * blocks we can allocate without ovelapping next extent */
     next = ext4_ext_next_allocated_block(path);
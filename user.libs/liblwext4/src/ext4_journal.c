@@ -1348,7 +1348,7 @@ static void jbd_journal_flush_trans(struct jbd_trans *trans)
             ext4_block_set(fs->bdev, &block);
     }
 
-    ext4_free(tmp_data);
+    ext4_free_bcache(tmp_data);
 }
 
 static void
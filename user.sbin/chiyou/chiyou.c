@@ -196,7 +196,7 @@ static int do_handle_chiyou_event(struct proto *proto, char *buf, int *right)
 		break;
 	case PROTO_GET_IRQ:
 		ret = handle_get_irq(dnode, dinfo->index);
-		*right = KR_RW;
+		*right = KR_RWCM;
 		break;
 	case PROTO_GET_DMA_CHANEL:
 		ret = handle_get_dma_channel(dnode, dinfo->index);
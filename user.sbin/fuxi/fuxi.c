@@ -52,6 +52,7 @@ struct vreq {
 	struct vnode *node;
 	struct vreq *next;
 	struct list_head *pdata;
+	off_t pos;			// index of pdata, the getdents cookie.
 	void *buf;
 };
 
@@ -176,6 +177,7 @@ static struct vreq *create_new_vreq(struct vnode *node)
 	 */
 	vreq->node = node;
 	vreq->pdata = node->child.next;
+	vreq->pos = 0;
 
 	return vreq;
 
@@ -345,6 +347,51 @@ static void handle_register_service_request(struct vreq *vreq, struct proto *pro
 	}
 }
 
+/*
+ * fill the entries from pdata, d_off of the entry is the index of
+ * the next one.
+ */
+static int fill_dirents(struct vreq *vreq, unsigned char *buf, int size)
+{
+	struct vnode *node = vreq->node;
+	struct dirent *de;
+	struct vnode *next;
+	int len, used = 0;
+
+	while (vreq->pdata != &node->child) {
+		next = list_entry(vreq->pdata, struct vnode, list);
+		len = BALIGN(DIRENT_SIZE(strlen(next->name) + 1), sizeof(long));
+		if (used + len > size)
+			break;
+
+		de = (struct dirent *)(buf + used);
+		de->d_ino = node->d_ino;
+		de->d_off = vreq->pos + 1;
+		de->d_reclen = len;
+		de->d_type = DT_SRV;
+		strcpy(de->d_name, next->name);
+
+		used += len;
+		vreq->pdata = vreq->pdata->next;
+		vreq->pos++;
+	}
+
+	return used;
+}
+
+static void seek_dirents(struct vreq *vreq, off_t pos)
+{
+	struct vnode *node = vreq->node;
+
+	vreq->pdata = node->child.next;
+	vreq->pos = 0;
+
+	while ((vreq->pos < pos) && (vreq->pdata != &node->child)) {
+		vreq->pdata = vreq->pdata->next;
+		vreq->pos++;
+	}
+}
+
 static int __handle_open_request(struct vreq *vreq, struct proto *proto, char *buf, int *type)
 {
 	struct vnode *cur = vreq->node, *next;
@@ -380,6 +427,10 @@ static int __handle_open_request(struct vreq *vreq, struct proto *proto, char *b
 			if (new_vreq != NULL) {
 				*type = SRV_DIR;
 				handle = new_vreq->handle;
+				if (proto->open.flags & PROTO_OPEN_PREFETCH)
+					*(long *)new_vreq->buf = fill_dirents(new_vreq,
+						new_vreq->buf + sizeof(long),
+						PAGE_SIZE - sizeof(long));
 			}
 
 			return handle;
@@ -444,11 +495,7 @@ static void handle_open_request(struct vreq *vreq, struct proto *proto, char *bu
 static void handle_getdent_request(struct vreq *vreq, struct proto *proto, char *buf)
 {
 	struct vnode *node = vreq->node;
-	unsigned char *tmp = vreq->buf;
-	struct dirent *de;
-	int ret = 0, len;
-	struct vnode *next;
-	int size_left = PAGE_SIZE;
+	int ret = 0;
 
 	if (node->type != SRV_DIR) {
 		ret = -EBADF;
@@ -460,47 +507,29 @@ static void handle_getdent_request(struct vreq *vreq, struct proto *proto, char
 		goto out;
 	}
 
-	for (;;) {
-		if (vreq->pdata == &vreq->node->child)
-			break;
-
-		next = list_entry(vreq->pdata, struct vnode, list);
-		if (next == NULL)
-			break;
-
-		len = DIRENT_SIZE(strlen(next->name) + 1);
-		if (size_left < len)
-			break;
-
-		de = (struct dirent *)tmp;
-		de->d_ino = node->d_ino;
-		de->d_off = node->d_ino;
-		de->d_reclen = len;
-		de->d_type = DT_SRV;
-		strcpy(de->d_name, next->name);
-
-		tmp += len;
-		size_left -= len;
-		vreq->pdata = vreq->pdata->next;
-	}
+	if (proto->getdents.off != vreq->pos)
+		seek_dirents(vreq, proto->getdents.off);
 
-	ret = PAGE_SIZE - size_left;
+	ret = fill_dirents(vreq, vreq->buf, PAGE_SIZE);
 out:
 	kobject_reply(vreq->handle, proto->token, ret, 0, 0);
 }
 
-static int handle_remote_access(struct vnode *node, struct proto *proto, char *buf)
+/*
+ * forward the path request to the service which owns the path,
+ * with the remaining part of the path.
+ */
+static int handle_remote_path(struct vnode *node, struct proto *proto, char *buf)
 {
 	struct proto rproto;
 
-	rproto.proto_id = PROTO_ACCESS;
-	rproto.access.amode = proto->access.amode;
+	memcpy(&rproto, proto, sizeof(struct proto));
 
 	return sys_send_proto_with_data(node->handle,
 			&rproto, buf, strlen(buf), 2000);
 }
 
-static int __handle_access_request(struct vreq *vreq, struct proto *proto, char *buf)
+static int __handle_path_request(struct vreq *vreq, struct proto *proto, char *buf)
 {
 	struct vnode *cur = vreq->node, *next;
 	int amode = proto->access.amode;
@@ -515,6 +544,9 @@ static int __handle_access_request(struct vreq *vreq, struct proto *proto, char
 		 * one is directory, other is service.
 		 */
 		if (*pathrem == '\0') {
+			if (proto->proto_id != PROTO_ACCESS)
+				return -EPERM;
+
 			if (cur->type == SRV_NOTIFY)
 				return ((amode & R_OK) == amode);
 			else if (cur->type == SRV_PORT)
@@ -541,16 +573,20 @@ static int __handle_access_request(struct vreq *vreq, struct proto *proto, char
 		 * if this node is a service node, open it with remote call.
 		 */
 		if ((next->type == SRV_PORT))
-			return handle_remote_access(next, proto, pathrem);
+			return handle_remote_path(next, proto, pathrem);
 	}
 
 	return -ENOENT;
 }
 
-static void handle_access_request(struct vreq *vreq,
+/*
+ * PROTO_ACCESS and PROTO_UNLINK, the nodes of fuxi itself can
+ * not be removed.
+ */
+static void handle_path_request(struct vreq *vreq,
 		struct proto *proto, char *path)
 {
-	int ret = __handle_access_request(vreq, proto, path);
+	int ret = __handle_path_request(vreq, proto, path);
 	kobject_reply_errcode(vreq->handle, proto->token, ret);
 }
 
@@ -564,7 +600,7 @@ static void handle_lseek_request(struct vreq *vreq,
 	 * TBD
 	 */
 	if (node->type == SRV_DIR) {
-		vreq->pdata = node->child.next;
+		seek_dirents(vreq, 0);
 		ret = 0;
 	}
 
@@ -592,7 +628,8 @@ static int handle_event(struct epoll_event *event)
 		handle_open_request(vreq, &proto, string_buffer);
 		break;
 	case PROTO_ACCESS:
-		handle_access_request(vreq, &proto, string_buffer);
+	case PROTO_UNLINK:
+		handle_path_request(vreq, &proto, string_buffer);
 		break;
 	case PROTO_GETDENTS:
 		handle_getdent_request(vreq, &proto, string_buffer);
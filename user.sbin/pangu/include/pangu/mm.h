@@ -3,6 +3,7 @@
 
 #include <minos/types.h>
 #include <minos/list.h>
+#include <pangu/rbtree.h>
 
 #define VMA_PERM_R	(1 << 0)
 #define VMA_PERM_W	(1 << 1)
@@ -14,6 +15,22 @@
 
 struct process;
 struct proto;
+struct fmap_info;
+
+/*
+ * the file backed part of a vma, the pages are mapped from the
+ * page cache of the file server on demand. poff records the page
+ * offset in the page cache PMA of each page, -1 if not mapped.
+ */
+struct vma_file {
+	uint64_t key;
+	uint64_t map;		/* mapping id in the file server */
+	int pma_handle;
+	uint32_t ino;
+	uint32_t pgoff;		/* page index of the file at vma start */
+	size_t nr_pages;
+	long poff[0];
+};
 
 struct vma {
 	unsigned long start;
@@ -21,7 +38,16 @@ struct vma {
 	int anon;
 	int perm;
 	int pma_handle;
-	struct list_head list;
+	struct vma_file *file;
+
+	/*
+	 * the tree this vma is linked to, vma_free or vma_used,
+	 * max_free is the biggest free vma size in the subtree
+	 * of the vma_free tree.
+	 */
+	struct rb_root *tree;
+	size_t max_free;
+	struct rb_node node;
 };
 
 #define vma_size(vma)	\
@@ -57,6 +83,8 @@ struct vma *request_vma(struct process *proc, int pma_handle,
 
 void release_vma(struct process *proc, struct vma *vma);
 
+void release_vma_tree(struct rb_root *root);
+
 void vspace_init(struct process *proc, unsigned long elf_end);
 
 struct vma *find_vma(struct process *proc, unsigned long base);
@@ -67,11 +95,20 @@ int process_mm_init(struct process *proc, int elf_pma,
 		unsigned long elf_base, size_t elf_size);
 
 long pangu_mmap(struct process *proc, struct proto *proto, void *data);
+long pangu_munmap(struct process *proc, struct proto *proto, void *data);
 long pangu_brk(struct process *proc, struct proto *proto, void *data);
 long pangu_mprotect(struct process *proc, struct proto *proto, void *data);
 
 long handle_user_page_fault(struct process *proc,
 		uint64_t virt_addr, unsigned long info, long token);
 
+int fmap_vma_init(struct process *proc, struct vma *vma,
+		struct fmap_info *info, off_t offset);
+
+int fmap_page_fault(struct process *proc, struct vma *vma,
+		unsigned long virt, int right);
+
+void fmap_vma_release(struct process *proc, struct vma *vma);
+
 
 #endif
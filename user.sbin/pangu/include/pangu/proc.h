@@ -52,8 +52,8 @@ struct process {
 	/*
 	 * mmap used for mmap.
 	 */
-	struct list_head vma_free;
-	struct list_head vma_used;
+	struct rb_root vma_free;
+	struct rb_root vma_used;
 
 	/*
 	 * heap area.
@@ -85,6 +85,7 @@ extern int fuxi_handle;
 extern int nvwa_handle;
 extern int chiyou_handle;
 extern int proc_epfd;
+extern unsigned long pangu_hwcap;
 
 struct epoll_event;
 struct process_proto;
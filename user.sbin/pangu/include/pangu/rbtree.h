@@ -0,0 +1,51 @@
+#ifndef __PANGU_RBTREE_H__
+#define __PANGU_RBTREE_H__
+
+#include <minos/types.h>
+
+#define RB_RED		0
+#define RB_BLACK	1
+
+struct rb_node {
+	struct rb_node *parent;
+	struct rb_node *left;
+	struct rb_node *right;
+	int color;
+};
+
+struct rb_root {
+	struct rb_node *node;
+};
+
+/*
+ * recompute the augmented value of the node from its
+ * children, called when the subtree of the node changed.
+ */
+typedef void (*rb_augment_t)(struct rb_node *node);
+
+#define RB_ROOT		(struct rb_root) { NULL, }
+
+#define rb_entry(ptr, type, member) \
+	(container_of(ptr, type, member))
+
+static inline void rb_link_node(struct rb_node *node,
+		struct rb_node *parent, struct rb_node **link)
+{
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->color = RB_RED;
+	*link = node;
+}
+
+void rb_insert_color(struct rb_root *root,
+		struct rb_node *node, rb_augment_t augment);
+
+void rb_erase(struct rb_root *root,
+		struct rb_node *node, rb_augment_t augment);
+
+struct rb_node *rb_first(struct rb_root *root);
+struct rb_node *rb_last(struct rb_root *root);
+struct rb_node *rb_next(struct rb_node *node);
+struct rb_node *rb_prev(struct rb_node *node);
+
+#endif
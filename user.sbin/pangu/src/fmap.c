@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2021 Min Le (lemin9538@gmail.com)
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include <minos/debug.h>
+#include <minos/list.h>
+#include <minos/kobject.h>
+#include <minos/proto.h>
+
+#include <pangu/kmalloc.h>
+#include <pangu/proc.h>
+#include <pangu/mm.h>
+
+#define FMAP_TIMEOUT		5000
+
+/*
+ * the endpoint to the file server of the rootfs, only pangu can
+ * write to it, so the server trusts the requests on it. the id of
+ * each mapping is unique in the server.
+ */
+extern int fmap_handle;
+static uint64_t fmap_next_map;
+
+static long fmap_server_request(struct vma_file *file, int id, uint32_t index)
+{
+	struct proto proto;
+
+	memset(&proto, 0, sizeof(struct proto));
+	proto.proto_id = id;
+	proto.fmap.key = file->key;
+	proto.fmap.map = file->map;
+	proto.fmap.index = index;
+
+	return kobject_write(fmap_handle, &proto,
+			sizeof(struct proto), NULL, 0, FMAP_TIMEOUT);
+}
+
+int fmap_vma_init(struct process *proc, struct vma *vma,
+		struct fmap_info *info, off_t offset)
+{
+	size_t nr_pages = vma_size(vma) >> PAGE_SHIFT;
+	struct vma_file *file;
+	size_t i;
+	long ret;
+
+	if (fmap_handle <= 0)
+		return -ENODEV;
+
+	if ((uint64_t)offset >= PAGE_BALIGN(info->size))
+		return -ENXIO;
+
+	file = kzalloc(sizeof(struct vma_file) + nr_pages * sizeof(long));
+	if (!file)
+		return -ENOMEM;
+
+	file->key = info->key;
+	file->ino = info->ino;
+	file->map = ++fmap_next_map;
+	file->pgoff = offset >> PAGE_SHIFT;
+	file->nr_pages = nr_pages;
+	for (i = 0; i < nr_pages; i++)
+		file->poff[i] = -1;
+
+	/*
+	 * the server checks the key which the client passed, and
+	 * replies the handle of its page cache for this mapping.
+	 */
+	ret = fmap_server_request(file, PROTO_FMAP, 0);
+	if (ret <= 0) {
+		/* the handle may fail to be sent after the attach */
+		fmap_server_request(file, PROTO_FPUT, FMAP_DETACH);
+		kfree(file);
+		return ret ? ret : -ENODEV;
+	}
+
+	file->pma_handle = ret;
+	vma->perm = KR_R;
+	vma->file = file;
+
+	return 0;
+}
+
+/*
+ * the server pins the page for the mapping, the page in the page
+ * cache is shared by all the processes which map the file.
+ */
+int fmap_page_fault(struct process *proc, struct vma *vma,
+		unsigned long virt, int right)
+{
+	struct vma_file *file = vma->file;
+	size_t index = (virt - vma->start) >> PAGE_SHIFT;
+	long offset;
+	int ret;
+
+	if ((right & vma->perm) != right)
+		return -EPERM;
+
+	if (file->poff[index] >= 0)
+		return 0;
+
+	offset = fmap_server_request(file, PROTO_FPAGE, file->pgoff + index);
+	if (offset < 0) {
+		pr_err("get page %zu of file %u failed %ld\n",
+				file->pgoff + index, file->ino, offset);
+		return (int)offset;
+	}
+
+	ret = sys_map_offset(proc->proc_handle, file->pma_handle,
+			virt, PAGE_SIZE, vma->perm, offset);
+	if (ret) {
+		fmap_server_request(file, PROTO_FPUT, file->pgoff + index);
+		return ret;
+	}
+
+	file->poff[index] = offset;
+
+	return 0;
+}
+
+/*
+ * unmap the pages, then detach the mapping, the server unpins all
+ * the pages of the mapping.
+ */
+void fmap_vma_release(struct process *proc, struct vma *vma)
+{
+	struct vma_file *file = vma->file;
+	unsigned long virt;
+	size_t i;
+
+	if (!file)
+		return;
+
+	for (i = 0; i < file->nr_pages; i++) {
+		if (file->poff[i] < 0)
+			continue;
+
+		virt = vma->start + (i << PAGE_SHIFT);
+		sys_unmap(proc->proc_handle, file->pma_handle,
+				virt, PAGE_SIZE);
+	}
+
+	fmap_server_request(file, PROTO_FPUT, FMAP_DETACH);
+	kobject_close(file->pma_handle);
+	kfree(file);
+	vma->file = NULL;
+}
@@ -20,6 +20,8 @@
 #include <pangu/proc.h>
 #include <pangu/mm.h>
 
+static int anon_pma_handle = -1;
+
 #define vma_init(vma, _base, _end)	\
 	do {				\
 		vma->pma_handle = -1;	\
@@ -27,55 +29,188 @@
 		vma->end = _end;	\
 	} while (0)
 
+static inline size_t free_vma_max(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct vma, node)->max_free : 0;
+}
+
+/*
+ * the free vma tree is augmented with the biggest free size
+ * in the subtree, then the first fit can be found in O(logn).
+ */
+static void free_vma_augment(struct rb_node *node)
+{
+	struct vma *vma = rb_entry(node, struct vma, node);
+	size_t max = vma_size(vma);
+
+	if (free_vma_max(node->left) > max)
+		max = free_vma_max(node->left);
+	if (free_vma_max(node->right) > max)
+		max = free_vma_max(node->right);
+
+	vma->max_free = max;
+}
+
+static void insert_vma(struct rb_root *root, struct vma *vma,
+		rb_augment_t augment)
+{
+	struct rb_node **link = &root->node, *parent = NULL;
+	struct vma *tmp;
+
+	while (*link) {
+		parent = *link;
+		tmp = rb_entry(parent, struct vma, node);
+		if (vma->start < tmp->start)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+
+	rb_link_node(&vma->node, parent, link);
+	rb_insert_color(root, &vma->node, augment);
+	vma->tree = root;
+}
+
+static void erase_vma(struct vma *vma, rb_augment_t augment)
+{
+	rb_erase(vma->tree, &vma->node, augment);
+	vma->tree = NULL;
+}
+
+static inline void insert_free_vma(struct process *proc, struct vma *vma)
+{
+	insert_vma(&proc->vma_free, vma, free_vma_augment);
+}
+
+static inline void erase_free_vma(struct vma *vma)
+{
+	erase_vma(vma, free_vma_augment);
+}
+
+/*
+ * find the vma whose start address is the biggest one which
+ * is not bigger than the base.
+ */
+static struct vma *floor_vma(struct rb_root *root, unsigned long base)
+{
+	struct rb_node *node = root->node;
+	struct vma *vma, *out = NULL;
+
+	while (node) {
+		vma = rb_entry(node, struct vma, node);
+		if (base < vma->start) {
+			node = node->left;
+		} else {
+			out = vma;
+			node = node->right;
+		}
+	}
+
+	return out;
+}
+
+/*
+ * find the lowest free vma whose size is bigger than the
+ * requested size.
+ */
+static struct vma *first_fit_vma(struct rb_root *root, size_t size)
+{
+	struct rb_node *node = root->node;
+	struct vma *vma;
+
+	if (free_vma_max(node) < size)
+		return NULL;
+
+	while (node) {
+		if (free_vma_max(node->left) >= size) {
+			node = node->left;
+			continue;
+		}
+
+		vma = rb_entry(node, struct vma, node);
+		if (vma_size(vma) >= size)
+			return vma;
+
+		node = node->right;
+	}
+
+	return NULL;
+}
+
 static void __release_vma(struct process *proc, struct vma *vma)
 {
-	struct vma *cur, *tmp;
+	struct vma *prev, *next;
 
 	vma->pma_handle = -1;
 	vma->anon = 0;
+	vma->file = NULL;
 
-	if (vma->list.next != NULL) {
+	if (vma->tree != NULL) {
 		pr_err("vma is not is in use\n");
 		return;
 	}
 
 	/*
-	 * try to merge the vma to a bigger one
+	 * try to merge the vma with its neighbour free vma.
 	 */
-repeat:
-	list_for_each_entry_safe(cur, tmp, &proc->vma_free, list) {
-		if (cur->start == vma->end) {
-			list_del(&cur->list);
-			vma->end = cur->end;
-			kfree(cur);
-			goto repeat;
-		}
+	prev = floor_vma(&proc->vma_free, vma->start);
+	if (prev && (prev->end == vma->start)) {
+		erase_free_vma(prev);
+		vma->start = prev->start;
+		kfree(prev);
+	}
 
-		if (vma->start == cur->end) {
-			list_del(&cur->list);
-			vma->start = cur->start;
-			kfree(cur);
-			goto repeat;
-		}
+	next = floor_vma(&proc->vma_free, vma->end);
+	if (next && (next->start == vma->end)) {
+		erase_free_vma(next);
+		vma->end = next->end;
+		kfree(next);
 	}
 
-	list_add(&proc->vma_free, &vma->list);
+	insert_free_vma(proc, vma);
 }
 
 void release_vma(struct process *proc, struct vma *vma)
 {
-
-	if (vma->list.next != NULL)
-		list_del(&vma->list);
+	if (vma->tree != NULL)
+		erase_vma(vma, NULL);
 
 	return __release_vma(proc, vma);
 }
 
+void release_vma_tree(struct rb_root *root)
+{
+	struct rb_node *node = root->node, *parent;
+
+	while (node) {
+		if (node->left) {
+			node = node->left;
+			continue;
+		}
+
+		if (node->right) {
+			node = node->right;
+			continue;
+		}
+
+		parent = node->parent;
+		if (parent && (parent->left == node))
+			parent->left = NULL;
+		else if (parent)
+			parent->right = NULL;
+
+		kfree(rb_entry(node, struct vma, node));
+		node = parent;
+	}
+
+	root->node = NULL;
+}
+
 static struct vma *split_vma(struct process *proc, struct vma *vma,
 		unsigned long base, unsigned long end)
 {
 	size_t left_size, right_size;
-	struct vma *left, *right;
+	struct vma *left = NULL, *right;
 
 	left_size = base - vma->start;
 	right_size = vma->end - end;
@@ -88,7 +223,6 @@ static struct vma *split_vma(struct process *proc, struct vma *vma,
 		if (!left)
 			goto out_err;
 		vma_init(left, vma->start, base);
-		list_add(&proc->vma_free, &left->list);
 	}
 
 	if (right_size > 0) {
@@ -96,19 +230,22 @@ static struct vma *split_vma(struct process *proc, struct vma *vma,
 		if (!right)
 			goto out_err_right;
 		vma_init(right, end, vma->end);
-		list_add(&proc->vma_free, &right->list);
+		insert_free_vma(proc, right);
 	}
 
+	if (left)
+		insert_free_vma(proc, left);
+
 	vma->start = base;
 	vma->end = end;
 
 	return vma;
 
 out_err_right:
-	list_del(&left->list);
-	kfree(left);
+	if (left)
+		kfree(left);
 out_err:
-	list_add(&proc->vma_free, &vma->list);
+	insert_free_vma(proc, vma);
 	return NULL;
 }
 
@@ -116,33 +253,33 @@ struct vma *__request_vma(struct process *proc, unsigned long base,
 		size_t size, unsigned int perm, int anon)
 {
 	unsigned long new_base = base, new_end = base + size;
-	struct vma *vma, *old, *out = NULL;
+	struct vma *out;
 
 	if ((base != 0) && (!IS_PAGE_ALIGN(base))) {
 		pr_err("%s invalid request address 0x%lx\n", __func__, base);
 		return NULL;
 	}
 
-	list_for_each_entry_safe(vma, old, &proc->vma_free, list) {
-		if (base == 0) {
-			new_base = vma->start;
-			new_end = vma->start + size;
-		}
-
-		if ((new_base >= vma->start) && (new_end <= vma->end)) {
-			out = vma;
-			break;
+	if (base == 0) {
+		out = first_fit_vma(&proc->vma_free, size);
+		if (out) {
+			new_base = out->start;
+			new_end = out->start + size;
 		}
+	} else {
+		out = floor_vma(&proc->vma_free, base);
+		if (out && (new_end > out->end))
+			out = NULL;
 	}
 
 	if (!out) return NULL;
 
-	list_del(&vma->list);
+	erase_free_vma(out);
 	out = split_vma(proc, out, new_base, new_end);
 	if (out) {
 		out->perm = perm;
 		out->anon = anon;
-		list_add_tail(&proc->vma_used, &out->list);
+		insert_vma(&proc->vma_used, out, NULL);
 	}
 
 	return out;
@@ -160,6 +297,38 @@ int create_pma(int type, int right, unsigned long base, size_t size)
 	return kobject_create(KOBJ_TYPE_PMA, (unsigned long)&args);
 }
 
+/*
+ * register the anon region to kernel, then the page fault in
+ * this region will handled by kernel directly. if failed, the
+ * page fault will still send to pangu, so it is not a fatal
+ * error.
+ */
+static void register_anon_region(struct process *proc,
+		unsigned long base, size_t size, int perm)
+{
+	int ret;
+
+	if (anon_pma_handle <= 0) {
+		anon_pma_handle = create_pma(PMA_TYPE_ANON, KR_RWX, 0, 0);
+		if (anon_pma_handle <= 0)
+			return;
+	}
+
+	ret = sys_map(proc->proc_handle, anon_pma_handle, base, size, perm);
+	if (ret)
+		pr_err("register anon region 0x%lx for %d failed %d\n",
+				base, proc_pid(proc), ret);
+}
+
+static void unregister_anon_region(struct process *proc,
+		unsigned long base, size_t size)
+{
+	if (anon_pma_handle <= 0)
+		return;
+
+	sys_unmap(proc->proc_handle, anon_pma_handle, base, size);
+}
+
 struct vma *request_vma(struct process *proc, int pma_handle,
 			unsigned long base, size_t size,
 			unsigned int perm, int anon)
@@ -176,8 +345,10 @@ struct vma *request_vma(struct process *proc, int pma_handle,
 	 * else allocate a pma for this mapping to share with
 	 * other process or orther usage.
 	 */
-	if (anon && pma_handle <= 0)
+	if (anon && pma_handle <= 0) {
+		register_anon_region(proc, vma->start, size, perm);
 		return vma;
+	}
 
 	if (pma_handle <= 0) {
 		vma->pma_handle = create_pma(PMA_TYPE_NORMAL, perm, 0, size);
@@ -202,12 +373,10 @@ struct vma *request_vma(struct process *proc, int pma_handle,
 
 struct vma *find_vma(struct process *proc, unsigned long base)
 {
-	struct vma *vma;
+	struct vma *vma = floor_vma(&proc->vma_used, base);
 
-	list_for_each_entry(vma, &proc->vma_used, list) {
-		if ((base >= vma->start) && (base < vma->end))
-			return vma;
-	}
+	if (vma && (base < vma->end))
+		return vma;
 
 	return NULL;
 }
@@ -269,6 +438,38 @@ void *map_self_memory(int pma_handle, size_t size, int perm)
 	return (void *)vma->start;
 }
 
+/*
+ * the file backed mapping, the pages are mapped from the page
+ * cache of the file server when the process touches them.
+ */
+static long pangu_mmap_file(struct process *proc, struct proto *proto,
+		struct fmap_info *info)
+{
+	size_t len = BALIGN(proto->mmap.len, PAGE_SIZE);
+	struct vma *vma;
+	int ret;
+
+	if ((proto->mmap.prot & (PROT_WRITE | PROT_EXEC)) ||
+			!(proto->mmap.prot & PROT_READ))
+		return -EACCES;
+
+	if ((len == 0) || (proto->mmap.offset < 0) ||
+			!IS_PAGE_ALIGN(proto->mmap.offset))
+		return -EINVAL;
+
+	vma = __request_vma(proc, 0, len, KR_R, 0);
+	if (!vma)
+		return -ENOMEM;
+
+	ret = fmap_vma_init(proc, vma, info, proto->mmap.offset);
+	if (ret) {
+		release_vma(proc, vma);
+		return ret;
+	}
+
+	return (long)vma->start;
+}
+
 long pangu_mmap(struct process *proc, struct proto *proto, void *data)
 {
 	size_t len = proto->mmap.len;
@@ -277,11 +478,16 @@ long pangu_mmap(struct process *proc, struct proto *proto, void *data)
 	int perm = 0;
 	void *addr = (void *)-1;
 
-	if ((proto->mmap.addr != NULL) || (proto->mmap.fd != -1)) {
+	if (proto->mmap.addr != NULL) {
 		pr_err("only support map anon mapping for process\n");
 		goto out;
 	}
 
+	if (proto->mmap.fd != -1) {
+		addr = (void *)pangu_mmap_file(proc, proto, data);
+		goto out;
+	}
+
 	if (prot & PROT_EXEC)
 		perm |= KOBJ_RIGHT_EXEC;
 	if (prot & PROT_WRITE)
@@ -299,14 +505,51 @@ out:
 	return 0;
 }
 
+/*
+ * only the whole vma of a mmap can be unmapped now.
+ */
+long pangu_munmap(struct process *proc, struct proto *proto, void *data)
+{
+	unsigned long start = (unsigned long)proto->munmap.start;
+	size_t len = BALIGN(proto->munmap.len, PAGE_SIZE);
+	struct vma *vma = find_vma(proc, start);
+	int ret = 0;
+
+	if (!vma || (vma->start != start) || (vma_size(vma) != len)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (vma->file) {
+		fmap_vma_release(proc, vma);
+	} else if (vma->anon && (vma->pma_handle <= 0)) {
+		unregister_anon_region(proc, vma->start, len);
+	} else {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	release_vma(proc, vma);
+out:
+	return kobject_reply_errcode(proc->proc_handle, proto->token, ret);
+}
+
 static unsigned long __pangu_brk(struct process *proc, struct proto *proto, void *data)
 {
 	unsigned long addr = (unsigned long)proto->brk.addr;
+	unsigned long old_end, new_end;
 
 	if (addr == 0)
 		return (long)proc->brk_cur;
 	if ((addr < proc->brk_start) || (addr >= proc->brk_end))
 		return -1;
+
+	old_end = PAGE_BALIGN(proc->brk_cur);
+	new_end = PAGE_BALIGN(addr);
+	if (new_end > old_end)
+		register_anon_region(proc, old_end, new_end - old_end, KR_RWX);
+	else if (new_end < old_end)
+		unregister_anon_region(proc, new_end, old_end - new_end);
 	proc->brk_cur = addr;
 
 	return addr;
@@ -337,6 +580,8 @@ long pangu_mprotect(struct process *proc, struct proto *proto, void *data)
 		vma->perm |= KOBJ_RIGHT_WRITE;
 	if (prot & PROT_READ)
 		vma->perm |= KOBJ_RIGHT_READ;
+
+	register_anon_region(proc, vma->start, vma_size(vma), vma->perm);
 out:
 	return kobject_reply_errcode(proc->proc_handle, proto->token, ret);
 }
@@ -356,7 +601,7 @@ static int get_fault_addr(struct process *proc, unsigned long virt, int *perm)
 	vma = &proc->anon_stack_vma;
 	if ((virt >= vma->start) && (virt < vma->end)) {
 		*perm = vma->perm;
-		return virt;
+		return 0;
 	}
 
 	vma = find_vma(proc, virt);
@@ -383,6 +628,13 @@ long handle_user_page_fault(struct process *proc, uint64_t virt_addr,
 {
 	unsigned long start = PAGE_ALIGN(virt_addr);
 	int ret, perm = 0, right = info & KOBJ_RIGHT_MASK;
+	struct vma *vma;
+
+	vma = find_vma(proc, start);
+	if (vma && vma->file) {
+		ret = fmap_page_fault(proc, vma, start, right);
+		goto out;
+	}
 
 	ret = get_fault_addr(proc, start, &perm);
 	if (ret) {
@@ -412,8 +664,8 @@ void vspace_init(struct process *proc, unsigned long elf_end)
 {
 	struct vma *vma;
 
-	init_list(&proc->vma_free);
-	init_list(&proc->vma_used);
+	proc->vma_free = RB_ROOT;
+	proc->vma_used = RB_ROOT;
 
 	vma = kzalloc(sizeof(struct vma));
 	if (!vma) {
@@ -424,9 +676,8 @@ void vspace_init(struct process *proc, unsigned long elf_end)
 	/*
 	 * mmap region
 	 */
-	vma->start = PROCESS_MMAP_BOTTOM;
-	vma->end = PROCESS_MMAP_TOP;
-	list_add(&proc->vma_free, &vma->list);
+	vma_init(vma, PROCESS_MMAP_BOTTOM, PROCESS_MMAP_TOP);
+	insert_free_vma(proc, vma);
 
 	/*
 	 * brk region
@@ -486,6 +737,7 @@ static int stack_vma_init(struct process *proc)
 			PROCESS_STACK_INIT_SIZE);
 	vma->anon = 1;
 	vma->perm = KR_RW;
+	register_anon_region(proc, vma->start, vma_size(vma), vma->perm);
 
 	return 0;
 }
@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/epoll.h>
+#include <sys/auxv.h>
 #include <assert.h>
 
 #include <minos/kobject.h>
@@ -29,6 +30,14 @@ int proc_epfd;
 int fuxi_handle;
 int nvwa_handle;
 int chiyou_handle;
+int fmap_handle;
+
+/*
+ * the cpu features come from the kernel with the auxv of pangu,
+ * pass them to the processes, process.c can not include
+ * sys/auxv.h since its elf.h conflicts with pangu/elf.h.
+ */
+unsigned long pangu_hwcap;
 
 int setup_mem_handle;
 
@@ -265,14 +274,31 @@ static int load_fuxi_service(void)
 
 static int load_rootfs_driver(void)
 {
+	struct handle_desc hdesc[1];
 	char *path = NULL;
-	int ret;
+	int handle, ret;
+
+	/*
+	 * the endpoint for the file backed mmap, pangu asks the rootfs
+	 * driver for the pages of the mapped files through it. only
+	 * pangu can write to it, the driver can only read it.
+	 */
+	handle = kobject_create_endpoint(0);
+	if (handle <= 0)
+		return handle;
+
+	hdesc[0].handle = handle;
+	hdesc[0].right = KR_R;
 
 	ret = bootarg_parse_string("rootfs", &path);
 	path = ret ? rootfs_default : path;
-	rootfs_proc = load_ramdisk_process(path, NULL, 0, TASK_FLAGS_DRV);
-	if (rootfs_proc == NULL)
+	rootfs_proc = load_ramdisk_process(path, hdesc, 1, TASK_FLAGS_DRV);
+	if (rootfs_proc == NULL) {
+		kobject_close(handle);
 		return -ENOENT;
+	}
+
+	fmap_handle = handle;
 
 	return kobject_ctl(rootfs_proc->proc_handle,
 			KOBJ_PROCESS_GRANT_RIGHT, PROC_FLAGS_VMCTL);
@@ -297,6 +323,7 @@ int main(int argc, char **argv)
 		return -EINVAL;
 	}
 
+	pangu_hwcap = getauxval(AT_HWCAP);
 	heap_base = bootdata->heap_start;
 	heap_end = bootdata->heap_end;
 	dump_boot_info();
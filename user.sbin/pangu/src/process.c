@@ -193,7 +193,7 @@ static void *setup_auxv(struct process *proc, void *top, int flags)
 
 	NEW_AUX_ENT(auxp, AT_NULL, 0);
 	NEW_AUX_ENT(auxp, AT_PAGESZ, PAGE_SIZE);
-	NEW_AUX_ENT(auxp, AT_HWCAP, 0);		// TBD cpu feature.
+	NEW_AUX_ENT(auxp, AT_HWCAP, pangu_hwcap);
 
 	/*
 	 * pass the fuxi handle to this process, so it can connect
@@ -441,8 +441,8 @@ void self_init(int proc_handle, unsigned long vma_base, unsigned long vma_end)
 	self->pid = alloc_pid();
 	assert(self->pid == 1);
 
-	init_list(&self->vma_free);
-	init_list(&self->vma_used);
+	self->vma_free = RB_ROOT;
+	self->vma_used = RB_ROOT;
 	init_list(&self->children);
 	init_list(&self->wait_head);
 	self->proc_handle = proc_handle;
@@ -453,22 +453,26 @@ void self_init(int proc_handle, unsigned long vma_base, unsigned long vma_end)
 
 	vma->start = vma_base;
 	vma->end = vma_end;
-	list_add(&self->vma_free, &vma->list);
+	release_vma(self, vma);
 }
 
 static void proc_mm_deinit(struct process *proc)
 {
-	struct vma *vma, *tmp;
+	struct rb_node *node;
+	struct vma *vma;
 
-	list_for_each_entry_safe(vma, tmp, &proc->vma_free, list) {
-		list_del(&vma->list);
-		kfree(vma);
+	/*
+	 * the pages of the file mappings are pinned by the file
+	 * server, unmap them and let the server unpin them.
+	 */
+	for (node = rb_first(&proc->vma_used); node; node = rb_next(node)) {
+		vma = rb_entry(node, struct vma, node);
+		if (vma->file)
+			fmap_vma_release(proc, vma);
 	}
 
-	list_for_each_entry_safe(vma, tmp, &proc->vma_used, list) {
-		list_del(&vma->list);
-		kfree(vma);
-	}
+	release_vma_tree(&proc->vma_free);
+	release_vma_tree(&proc->vma_used);
 
 	kobject_close(proc->elf_vma.pma_handle);
 	kobject_close(proc->init_stack_vma.pma_handle);
@@ -887,6 +891,7 @@ static syscall_hdl proc_syscall_handles[] = {
 	[PROTO_IAMOK_ID]	= pangu_iamok,
 	[PROTO_ELF_INFO_ID]	= pangu_elf_info,
 	[PROTO_MMAP_ID]		= pangu_mmap,
+	[PROTO_MUNMAP_ID]	= pangu_munmap,
 	[PROTO_EXECV_ID]	= pangu_execv,
 	[PROTO_BRK_ID]		= pangu_brk,
 	[PROTO_PROCCNT_ID]	= pangu_proccnt,
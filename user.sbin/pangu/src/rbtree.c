@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2021 Min Le (lemin9538@gmail.com)
+ */
+
+#include <stdio.h>
+
+#include <pangu/rbtree.h>
+
+#define rb_is_black(node)	(!(node) || ((node)->color == RB_BLACK))
+#define rb_is_red(node)		(!rb_is_black(node))
+
+static void rb_replace_child(struct rb_root *root, struct rb_node *parent,
+		struct rb_node *old, struct rb_node *new)
+{
+	if (!parent)
+		root->node = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+static void rb_rotate_left(struct rb_root *root,
+		struct rb_node *node, rb_augment_t augment)
+{
+	struct rb_node *right = node->right;
+
+	node->right = right->left;
+	if (right->left)
+		right->left->parent = node;
+
+	right->parent = node->parent;
+	rb_replace_child(root, node->parent, node, right);
+	right->left = node;
+	node->parent = right;
+
+	if (augment) {
+		augment(node);
+		augment(right);
+	}
+}
+
+static void rb_rotate_right(struct rb_root *root,
+		struct rb_node *node, rb_augment_t augment)
+{
+	struct rb_node *left = node->left;
+
+	node->left = left->right;
+	if (left->right)
+		left->right->parent = node;
+
+	left->parent = node->parent;
+	rb_replace_child(root, node->parent, node, left);
+	left->right = node;
+	node->parent = left;
+
+	if (augment) {
+		augment(node);
+		augment(left);
+	}
+}
+
+/*
+ * update the augmented value from the node to the root, the
+ * rotation will keep the value of the subtree top unchanged
+ * so only the path of the inserted or removed node need to
+ * be updated.
+ */
+static void rb_augment_path(struct rb_node *node, rb_augment_t augment)
+{
+	if (!augment)
+		return;
+
+	while (node) {
+		augment(node);
+		node = node->parent;
+	}
+}
+
+void rb_insert_color(struct rb_root *root,
+		struct rb_node *node, rb_augment_t augment)
+{
+	struct rb_node *parent, *gparent, *uncle;
+
+	rb_augment_path(node, augment);
+
+	while ((parent = node->parent) && (parent->color == RB_RED)) {
+		gparent = parent->parent;
+
+		if (parent == gparent->left) {
+			uncle = gparent->right;
+			if (rb_is_red(uncle)) {
+				uncle->color = RB_BLACK;
+				parent->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->right) {
+				rb_rotate_left(root, parent, augment);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rb_rotate_right(root, gparent, augment);
+		} else {
+			uncle = gparent->left;
+			if (rb_is_red(uncle)) {
+				uncle->color = RB_BLACK;
+				parent->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->left) {
+				rb_rotate_right(root, parent, augment);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rb_rotate_left(root, gparent, augment);
+		}
+	}
+
+	root->node->color = RB_BLACK;
+}
+
+static void rb_erase_color(struct rb_root *root, struct rb_node *node,
+		struct rb_node *parent, rb_augment_t augment)
+{
+	struct rb_node *other;
+
+	while (rb_is_black(node) && (node != root->node)) {
+		if (parent->left == node) {
+			other = parent->right;
+			if (rb_is_red(other)) {
+				other->color = RB_BLACK;
+				parent->color = RB_RED;
+				rb_rotate_left(root, parent, augment);
+				other = parent->right;
+			}
+
+			if (rb_is_black(other->left) && rb_is_black(other->right)) {
+				other->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (rb_is_black(other->right)) {
+				other->left->color = RB_BLACK;
+				other->color = RB_RED;
+				rb_rotate_right(root, other, augment);
+				other = parent->right;
+			}
+
+			other->color = parent->color;
+			parent->color = RB_BLACK;
+			other->right->color = RB_BLACK;
+			rb_rotate_left(root, parent, augment);
+			node = root->node;
+			break;
+		} else {
+			other = parent->left;
+			if (rb_is_red(other)) {
+				other->color = RB_BLACK;
+				parent->color = RB_RED;
+				rb_rotate_right(root, parent, augment);
+				other = parent->left;
+			}
+
+			if (rb_is_black(other->left) && rb_is_black(other->right)) {
+				other->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (rb_is_black(other->left)) {
+				other->right->color = RB_BLACK;
+				other->color = RB_RED;
+				rb_rotate_left(root, other, augment);
+				other = parent->left;
+			}
+
+			other->color = parent->color;
+			parent->color = RB_BLACK;
+			other->left->color = RB_BLACK;
+			rb_rotate_right(root, parent, augment);
+			node = root->node;
+			break;
+		}
+	}
+
+	if (node)
+		node->color = RB_BLACK;
+}
+
+void rb_erase(struct rb_root *root,
+		struct rb_node *node, rb_augment_t augment)
+{
+	struct rb_node *child, *parent, *old = node;
+	int color;
+
+	if (node->left && node->right) {
+		/*
+		 * replace the node with its successor.
+		 */
+		node = node->right;
+		while (node->left)
+			node = node->left;
+
+		child = node->right;
+		parent = node->parent;
+		color = node->color;
+
+		if (child)
+			child->parent = parent;
+		if (parent == old) {
+			parent->right = child;
+			parent = node;
+		} else {
+			parent->left = child;
+		}
+
+		node->parent = old->parent;
+		node->color = old->color;
+		node->left = old->left;
+		node->right = old->right;
+
+		rb_replace_child(root, old->parent, old, node);
+		old->left->parent = node;
+		if (old->right)
+			old->right->parent = node;
+	} else {
+		child = node->left ? node->left : node->right;
+		parent = node->parent;
+		color = node->color;
+
+		if (child)
+			child->parent = parent;
+		rb_replace_child(root, parent, node, child);
+	}
+
+	rb_augment_path(parent, augment);
+
+	if (color == RB_BLACK)
+		rb_erase_color(root, child, parent, augment);
+}
+
+struct rb_node *rb_first(struct rb_root *root)
+{
+	struct rb_node *node = root->node;
+
+	if (!node)
+		return NULL;
+
+	while (node->left)
+		node = node->left;
+
+	return node;
+}
+
+struct rb_node *rb_last(struct rb_root *root)
+{
+	struct rb_node *node = root->node;
+
+	if (!node)
+		return NULL;
+
+	while (node->right)
+		node = node->right;
+
+	return node;
+}
+
+struct rb_node *rb_next(struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->right) {
+		node = node->right;
+		while (node->left)
+			node = node->left;
+		return node;
+	}
+
+	while ((parent = node->parent) && (node == parent->right))
+		node = parent;
+
+	return parent;
+}
+
+struct rb_node *rb_prev(struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->left) {
+		node = node->left;
+		while (node->right)
+			node = node->right;
+		return node;
+	}
+
+	while ((parent = node->parent) && (node == parent->left))
+		node = parent;
+
+	return parent;
+}